@@ -10,16 +10,32 @@ enum {
 	DEBUG = BIT(0),
 	DRY_RUN = BIT(1),
 	REPL = BIT(2),
+	NO_OPT = BIT(3),
+	STATS = BIT(4),
+	NO_JIT = BIT(5),
+	BUILD = BIT(6),
+	NO_INFER = BIT(7),
+	EXPLAIN_OPT = BIT(8),
+	CLOSURES = BIT(9),
 };
 
 #ifndef TENT_MAIN_CPP_FILE
 extern uint64_t runtime_flags;
+extern uint64_t max_call_depth;
+extern uint64_t gc_threshold;
 #endif
 
+#define DEFAULT_MAX_CALL_DEPTH 1000000
+// containers made between automatic cycle collections
+#define DEFAULT_GC_THRESHOLD 100000
+
 #define IS_FLAG_SET(f) ((runtime_flags & f) != 0)
 #define SET_FLAG(f) (runtime_flags |= f)
+#define CLEAR_FLAG(f) (runtime_flags &= ~(uint64_t)(f))
 
 void parseArgs(int32_t argc, char **argv);
+// for an executable made by `tent build`: every argument is the program's
+void parseEmbeddedArgs(int32_t argc, char **argv);
 void printUsage(void);
 // returns a pair of the search dir in which suffix was found, and the actual suffix
 // (which might be different from 'suffix' if is_dylib_prefix = true)
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "jit.hpp"
+#include "memo.hpp"
 #include "opcodes.hpp"
 #include "span.hpp"
 #include "types.hpp"
 #include "visitor.hpp"
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -118,10 +121,48 @@ public:
   TypeDic(Span s);
 };
 
+class TypeBits : public ASTNode {
+public:
+  void print(int indent) override;
+  Value accept(ASTVisitor &visitor) override;
+
+  TypeBits(Span s);
+};
+
+class TypeDeque : public ASTNode {
+public:
+  void print(int indent) override;
+  Value accept(ASTVisitor &visitor) override;
+
+  TypeDeque(Span s);
+};
+
+class TypeHeap : public ASTNode {
+public:
+  void print(int indent) override;
+  Value accept(ASTVisitor &visitor) override;
+
+  TypeHeap(Span s);
+};
+
+class TypeSet : public ASTNode {
+public:
+  void print(int indent) override;
+  Value accept(ASTVisitor &visitor) override;
+
+  TypeSet(Span s);
+};
+
 class Variable : public ASTNode {
 public:
   std::string name;
   ASTPtr value;
+  uint32_t nameId;
+  // offset of this name in the last frame it was looked up in
+  uint32_t slotHint = 0;
+  // parameter of an inlined form's body this reads (see InlineBody)
+  static constexpr uint32_t NOT_INLINED = UINT32_MAX;
+  uint32_t inlineParam = NOT_INLINED;
 
   void print(int indent) override;
   Value accept(ASTVisitor &visitor) override;
@@ -129,10 +170,19 @@ public:
   Variable(std::string varName, Span s, ASTPtr varValue = nullptr);
 };
 
+// The type inference pass (see infer.hpp) marks arithmetic it proved int or
+// float all the way down with that type, and each operand with its shape,
+// so the evaluator can work the expression out on raw numbers instead of
+// building a Value for every node.
+enum class StaticType : uint8_t { Unknown, Int, Dec };
+enum class OperandShape : uint8_t { Literal, Var, Unary, Binary };
+
 class UnaryOp : public ASTNode {
 public:
   TokenType op;
   ASTPtr operand;
+  StaticType staticType = StaticType::Unknown;
+  OperandShape operandShape = OperandShape::Literal;
 
   void print(int indent) override;
   Value accept(ASTVisitor &visitor) override;
@@ -140,11 +190,36 @@ public:
   UnaryOp(TokenType opOp, ASTPtr opOperand, Span s);
 };
 
+class BinaryOp;
+
+// A result of an operation the optimizer keeps instead of recomputing (see
+// hoist.hpp). An Invariant's value holds for the rest of the run of its
+// loop; a Use reuses the value its Def stored earlier in the same block, as
+// long as 'epoch' still matches the evaluator's.
+struct ExprCache {
+  enum Role : uint8_t { Invariant, Def, Use };
+
+  Role role = Invariant;
+  bool valid = false;
+  uint64_t epoch = 0;
+  Value value;
+  BinaryOp *def = nullptr; // Use
+};
+
 class BinaryOp : public ASTNode {
 public:
   TokenType op;
   ASTPtr left;
   ASTPtr right;
+  StaticType staticType = StaticType::Unknown;
+  OperandShape leftShape = OperandShape::Literal;
+  OperandShape rightShape = OperandShape::Literal;
+  std::unique_ptr<ExprCache> cache;
+  // both operands are literals or variables, so evaluating one cannot
+  // reassign the other; the variables among them are read in place
+  bool readsOnly = false;
+  Variable *leftVar = nullptr;
+  Variable *rightVar = nullptr;
 
   void print(int indent) override;
   Value accept(ASTVisitor &visitor) override;
@@ -152,12 +227,50 @@ public:
   BinaryOp(TokenType opOp, ASTPtr opLeft, ASTPtr opRight, Span s);
 };
 
+// the statements that can change control flow, told apart once at parse
+// time so the evaluator can dispatch on them without casting
+enum class StmtKind : uint8_t {
+  Expr,
+  NoOp,
+  If,
+  While,
+  For,
+  Return,
+  Yield,
+  Break,
+  Continue,
+  Fused // see FusedStmt
+};
+
+// Statement (and condition) shapes the optimizer runs as one fused step
+// instead of walking their nodes, each counted under --stats.
+enum class Superinstruction : uint8_t {
+  UpdateSlot,    // x = x + e, x += e (and -, *)
+  IncrementSlot, // the same with an int literal for e
+  StoreIndex,    // v@i = e
+  CompareBranch, // if/while on a variable against a variable or int literal
+  Count
+};
+
+// Operands of a StmtKind::Fused statement, pointing into its expression.
+struct FusedStmt {
+  Superinstruction kind = Superinstruction::UpdateSlot;
+  TokenType op = TokenType::ADD; // ADD, SUB or MUL
+  bool compound = false;         // written `x op= e`, not `x = x op e`
+  Variable *target = nullptr;
+  ASTNode *index = nullptr;   // StoreIndex
+  ASTNode *operand = nullptr; // e; null for IncrementSlot
+  tn_int_t imm = 0;           // IncrementSlot
+};
+
 class ExpressionStmt : public ASTNode {
 public:
   ASTPtr expr;
   bool noOp;
   bool isBreak;
   bool isContinue;
+  StmtKind kind;
+  FusedStmt fused;
 
   void print(int indent) override;
   Value accept(ASTVisitor &visitor) override;
@@ -166,9 +279,38 @@ public:
                  bool exprIsBreak = false, bool exprIsContinue = false);
 };
 
+// An if/while condition taken apart once at parse time, so the evaluator
+// can branch on comparisons, &&, || and ! directly instead of building a
+// bool Value for every step. The nodes point into the condition's AST.
+struct Condition {
+  enum Kind : uint8_t { Expr, Compare, And, Or, Not };
+
+  Kind kind = Expr;
+  // under && or ||, where any number counts (0 is false), not just a bool
+  bool operand = false;
+  TokenType op = TokenType::EQEQ; // Compare
+  ASTNode *expr = nullptr;         // Expr; left-hand side of Compare
+  ASTNode *rhs = nullptr;          // Compare
+  std::unique_ptr<Condition> left; // And, Or, Not
+  std::unique_ptr<Condition> right; // And, Or
+  // Compare set up by the optimizer as a CompareBranch: 'expr' is a
+  // Variable, and so is 'rhs' unless it is the int literal 'imm'
+  bool fused = false;
+  bool rhsImm = false;
+  tn_int_t imm = 0;
+  // Compare whose sides type inference proved both int or both float
+  StaticType staticType = StaticType::Unknown;
+  OperandShape lhsShape = OperandShape::Literal;
+  OperandShape rhsShape = OperandShape::Literal;
+
+  static std::unique_ptr<Condition> compile(ASTNode *node,
+                                            bool isOperand = false);
+};
+
 class IfStmt : public ASTNode {
 public:
   ASTPtr condition;
+  std::unique_ptr<Condition> test;
   std::vector<ExpressionStmt> thenClauseStmts;
   std::vector<ExpressionStmt> elseClauseStmts;
 
@@ -182,7 +324,15 @@ public:
 class WhileStmt : public ASTNode {
 public:
   ASTPtr condition;
+  std::unique_ptr<Condition> test;
   std::vector<ExpressionStmt> stmts;
+  // operations in the condition and body kept for a whole run of the loop
+  std::vector<BinaryOp *> invariants;
+  // iterations the interpreter has run, until the loop is compiled
+  uint32_t iterations = 0;
+  std::unique_ptr<JitLoop> jit;
+  // could not be compiled, or deoptimized too often
+  bool jitFailed = false;
 
   void print(int indent) override;
   Value accept(ASTVisitor &visitor) override;
@@ -194,8 +344,11 @@ public:
 class ForStmt : public ASTNode {
 public:
   std::string var;
+  uint32_t varId;
+  uint32_t varSlotHint = 0;
   ASTPtr iter;
   std::vector<ExpressionStmt> stmts;
+  std::vector<BinaryOp *> invariants;
 
   void print(int indent) override;
   Value accept(ASTVisitor &visitor) override;
@@ -225,12 +378,48 @@ public:
   ReturnStmt(ASTPtr stmtValue, Span s);
 };
 
+class YieldStmt : public ASTNode {
+public:
+  ASTPtr value;
+
+  void print(int indent) override;
+  Value accept(ASTVisitor &visitor) override;
+
+  YieldStmt(ASTPtr stmtValue, Span s);
+};
+
+// The body of a small form reduced by the optimizer to what it returns: the
+// value of the first guard whose test holds, otherwise 'result'. A call to
+// the form evaluates it straight over the arguments, without a frame.
+struct InlineBody {
+  struct Guard {
+    const Condition *test;
+    ReturnStmt *ret;
+  };
+
+  std::vector<Guard> guards;
+  ReturnStmt *result = nullptr;
+};
+
 class FunctionStmt : public ASTNode {
 public:
   std::string name;
   std::vector<ASTPtr> params;
   std::vector<ExpressionStmt> stmts;
   ASTPtr returnValue;
+  // locals of a call, computed by the evaluator on the first call
+  std::vector<uint32_t> frameLayout;
+  bool hasFrameLayout = false;
+  // the body yields: a call returns a generator instead of running it
+  bool isGenerator;
+  // set by the optimizer when calls can skip the frame (see InlineBody)
+  std::unique_ptr<InlineBody> inlineBody;
+  // declared `@memo`: calls with the same arguments reuse the first result
+  std::unique_ptr<MemoCache> memo;
+  // calls the interpreter has run, until the form is compiled
+  uint32_t calls = 0;
+  std::unique_ptr<JitForm> jit;
+  bool jitFailed = false;
 
   void print(int indent) override;
   Value accept(ASTVisitor &visitor) override;
@@ -245,6 +434,8 @@ public:
   std::string name;
   std::vector<ASTPtr> params;
   std::vector<ExpressionStmt> stmts;
+  std::vector<uint32_t> frameLayout;
+  bool hasFrameLayout = false;
 
   void print(int indent) override;
   Value accept(ASTVisitor &visitor) override;
@@ -272,3 +463,6 @@ public:
 
   Program(std::vector<ExpressionStmt> &&programStatements, Span s);
 };
+
+// a literal or a variable: evaluating it runs no code that could assign
+bool reads_only(const ASTNode *node);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-size bit array backing the `bits` type. Elements are stored one bit
+// per index in 64-bit words, so bulk operations (range set/clear, popcount,
+// scanning for the next set bit) work a whole word at a time.
+class Bits {
+  std::vector<uint64_t> words;
+  size_t nbits;
+
+  void clearTail();
+
+public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  explicit Bits(size_t size = 0, bool value = false);
+
+  size_t size() const { return nbits; }
+
+  bool get(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+  void set(size_t i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+  void clear(size_t i) { words[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+  void flip(size_t i) { words[i >> 6] ^= uint64_t(1) << (i & 63); }
+  void assign(size_t i, bool value) { value ? set(i) : clear(i); }
+
+  // apply to every index in [start, stop) that is start + k * step
+  void setRange(size_t start, size_t stop, size_t step = 1);
+  void clearRange(size_t start, size_t stop, size_t step = 1);
+
+  size_t popcount() const;
+  // first set index >= from, or npos if there is none
+  size_t findNextSet(size_t from) const;
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// `tent build`: makes 'output' an executable running the program in
+// 'sourceFile'. The program and the .tent modules it loads are embedded in
+// a C++ translation unit, along with a C++ translation of each form simple
+// enough (see AotTranslator), which the system C++ compiler links against
+// the tent runtime library. Returns the exit status for main().
+int build_program(const std::string &sourceFile, const std::string &output,
+                  const std::vector<std::string> &searchDirs);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <deque>
+
+#include "opcodes.hpp"
+#include "span.hpp"
+#include "types.hpp"
+
+class ASTNode;
+class Evaluator;
+class Program;
+class Variable;
+
+// One node of the closure tree `--closures` evaluates expressions through.
+// 'run' is picked once for the node's shape and calls the closures of its
+// operands directly, with the operator, the variable and the spans it needs
+// bound in, so evaluating the node costs one indirect call instead of
+// evalExpr's accept()/visit() double dispatch. 'node' stays the source of
+// truth: a shape without a closure of its own (a call, an assignment, an
+// operation the optimizer marked...) runs as `node->accept()`.
+struct Closure {
+  using Fn = Value (*)(Evaluator &, const Closure &);
+
+  Fn run = nullptr;
+  ASTNode *node = nullptr;
+  const Closure *lhs = nullptr; // or the operand of a unary operator
+  const Closure *rhs = nullptr;
+  Variable *var = nullptr; // a variable, or the one a vector index reads
+  TokenType op = TokenType::ADD;
+  Value imm; // a literal's value
+  Span span;
+  Span operandSpan;
+};
+
+// Compiles every expression in 'program' that has a closure of its own,
+// into 'closures' (which must outlive the program), and points the node's
+// 'compiled' at it for evalExpr to run.
+void compile_closures(Program &program, std::deque<Closure> &closures);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "types.hpp"
+
+// Storage for the `deque`, `heap` and `set` types. All three keep their
+// elements in one contiguous std::vector.
+
+// Double-ended queue on a power-of-two ring buffer: O(1) push/pop at both
+// ends and O(1) indexing.
+class ValueDeque {
+  std::vector<Value> ring;
+  size_t head = 0;
+  size_t count = 0;
+
+  size_t slot(size_t i) const { return (head + i) & (ring.size() - 1); }
+  void grow();
+
+public:
+  size_t size() const { return count; }
+
+  const Value &operator[](size_t i) const { return ring[slot(i)]; }
+  void set(size_t i, Value value) { ring[slot(i)] = std::move(value); }
+  const Value &front() const { return ring[head]; }
+  const Value &back() const { return ring[slot(count - 1)]; }
+
+  void pushBack(Value value);
+  void pushFront(Value value);
+  Value popBack();
+  Value popFront();
+};
+
+// Binary heap of (key, item) entries ordered by compare_values() on the key,
+// smallest first for a min-heap and largest first for a max-heap.
+class ValueHeap {
+public:
+  struct Entry {
+    Value key;
+    Value item;
+  };
+
+private:
+  std::vector<Entry> entries;
+  bool isMax;
+
+public:
+  explicit ValueHeap(bool maxHeap) : isMax(maxHeap) {}
+
+  size_t size() const { return entries.size(); }
+  bool maxHeap() const { return isMax; }
+  const Entry &top() const { return entries.front(); }
+
+  void push(Value key, Value item);
+  Entry pop();
+};
+
+// Hash set of orderable values (numbers and strings) using open addressing
+// with linear probing. Numbers that compare equal are the same element, so
+// 1, 1.0 and true share a slot.
+class ValueSet {
+  enum SlotState : uint8_t { EMPTY, FULL, DELETED };
+
+  std::vector<Value> slots;
+  std::vector<uint8_t> states;
+  size_t count = 0;
+  size_t used = 0; // FULL + DELETED, drives rehashing
+
+  size_t find(const Value &val) const;
+  void rehash(size_t capacity);
+
+public:
+  size_t size() const { return count; }
+
+  bool contains(const Value &val) const;
+  bool insert(const Value &val);
+  bool erase(const Value &val);
+  std::vector<Value> values() const;
+};
+
+// hash consistent with compare_values(): equal values hash the same
+size_t hash_orderable_val(const Value &val);
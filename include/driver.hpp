@@ -0,0 +1,32 @@
+#pragma once
+
+#include "jit.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// A program `tent build` compiled into an executable of its own: the source
+// of its main file and of the .tent modules it loads, and the forms it could
+// translate to C++. The program runs on the interpreter linked in with it,
+// which calls the translated forms wherever they are called with ints.
+struct EmbeddedSource {
+  // the main file's name, or the name a module is loaded by
+  const char *name;
+  const char *text;
+};
+
+struct EmbeddedProgram {
+  EmbeddedSource main;
+  const EmbeddedSource *modules;
+  size_t moduleCount;
+  const PrecompiledForm *forms;
+  size_t formCount;
+  // where the native libraries it loads were found when it was built
+  const char *const *libraryDirs;
+  size_t libraryDirCount;
+};
+
+// main() of the tent executable
+int32_t tent_main(int32_t argc, char **argv);
+// main() of one made by `tent build`
+int32_t tent_main_embedded(int32_t argc, char **argv,
+                           const EmbeddedProgram &program);
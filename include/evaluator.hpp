@@ -1,25 +1,21 @@
 #pragma once
 
 #include "ast.hpp"
+#include "closure.hpp"
 #include "diagnostics.hpp"
+#include "frame.hpp"
 #include "native.hpp"
 #include "opcodes.hpp"
 #include "types.hpp"
 #include "visitor.hpp"
+#include <array>
 #include <functional>
 #include <optional>
+#include <ostream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 
-struct CallFrame {
-  std::unordered_map<std::string, Value> locals;
-  std::string callableName;
-  Span callSite;
-  std::string callsiteFilename;
-  std::string moduleKey;
-};
-
 struct ModuleState {
   std::string key;
   std::string name;
@@ -30,38 +26,135 @@ struct ModuleState {
   bool initialized = false;
 };
 
+// How executing a statement left control flow. Anything but Normal stops
+// the enclosing block and is handled by the nearest loop (Break, Continue),
+// call (Return, TailCall) or the program (Exit).
+enum class Completion : uint8_t {
+  Normal,
+  Break,
+  Continue,
+  Return,
+  TailCall, // the current frame was switched over to the callee
+  Yield,    // a generator produced its next element
+  Exit
+};
+
+class GeneratorIter;
+struct GenCursor;
+struct BinaryKernels;
+class ClosureCompiler;
+
 class Evaluator : public ASTVisitor {
+  friend class GeneratorIter;
+  friend struct BinaryKernels;
+  friend class ClosureCompiler;
+
   std::string source;
 
   bool program_should_terminate = false;
 
-  std::vector<CallFrame> callStack;
+  FrameStack callStack;
+  // Calls of inlined forms push no frame on callStack. Their arguments go on
+  // inlineArgs and a header on inlineFrames (its base indexing inlineArgs),
+  // which only tracebacks read.
+  std::vector<Value> inlineArgs;
+  std::vector<CallFrame> inlineFrames;
   std::unordered_map<std::string, Value> variables;
   std::unordered_map<std::string, FunctionStmt *> functions;
   std::unordered_map<std::string, ClassStmt *> classes;
   std::unordered_map<std::string, ModuleState> modules;
   std::unordered_set<std::string> modules_in_progress;
-  std::vector<std::string> module_context_stack;
+  std::vector<ModuleState *> module_context_stack;
   std::unordered_map<
       std::string,
       std::unordered_map<
           std::string,
-          std::function<Value(const Value &, const std::vector<Value> &)>>>
+          std::function<Value(const Value &, std::vector<Value> &)>>>
       nativeMethods;
+  // string methods that change their receiver: a variable's own string, or
+  // a temporary copy when called on any other expression
+  std::unordered_map<
+      std::string,
+      std::function<Value(Value &, std::vector<Value> &)>>
+      strMutators;
 
   Diagnostics &diags;
   std::string filename;
+  // stable copy of 'filename' that call frames point at
+  const std::string *filenameRef;
+  const std::string mainFilename;
   const std::vector<std::string> file_search_dirs;
+  // sources of .tent modules a built executable carries, by load name
+  std::unordered_map<std::string, std::string> embeddedModules;
+  // every program run so far, the main one and loaded modules, kept for as
+  // long as the forms and classes they declare (and --stats) point into them
   std::vector<ASTPtr> loaded_programs;
+  // every @memo form declared so far, for --stats
+  std::vector<FunctionStmt *> memoForms;
+  // times each superinstruction ran fused, for --stats
+  std::array<uint64_t, (size_t)Superinstruction::Count> superHits{};
+  // hot loops and forms are compiled (see jit.hpp) unless --no-jit
+  const bool jitEnabled;
+  struct {
+    uint64_t loops = 0;
+    uint64_t forms = 0;
+    // includes compiled calls given up and run over in the interpreter
+    uint64_t deopts = 0;
+  } jitStats;
+
+  // arithmetic type inference marked (see infer.hpp), worked out on raw
+  // numbers; a fallback is one that met a variable holding something else
+  struct {
+    uint64_t typed = 0;
+    uint64_t fallbacks = 0;
+  } inferStats;
+
+  // results of operations hoisted out of loops or reused within a block
+  // (see hoist.hpp) instead of evaluated again
+  uint64_t reusedValues = 0;
+  // moved on whenever a block is entered halfway (a compiled loop resuming
+  // in the interpreter), past a Def it skipped
+  uint64_t cseEpoch = 1;
 
+  // the closure trees of every program run under --closures
+  std::deque<Closure> closures;
+
+  template <typename T>
+  bool evalRaw(ASTNode *node, OperandShape shape, T &out);
+  template <typename T> bool evalRawBinary(BinaryOp &node, T &out);
+  template <typename T> bool evalRawCached(BinaryOp &node, T &out);
+  bool evalTyped(BinaryOp &node, Value &out);
+  const Value *keptValue(const ExprCache &cache) const;
+  void keepValue(BinaryOp &node, const Value &result);
+  Value evalCached(BinaryOp &node);
+  Value evalBinary(BinaryOp &node);
   Value evalBinaryOp(const Value &left, const Value &right, TokenType op);
   Value evalUnaryOp(const Value &operand, TokenType op);
-  Value evalStmt(ExpressionStmt &stmt);
+  // value of the last expression statement, or the value being returned
+  // or exited with
+  Value completionValue;
+
+  Completion execStmt(ExpressionStmt &stmt);
+  bool execFused(ExpressionStmt &stmt);
+  Completion execBlock(std::vector<ExpressionStmt> &stmts);
+  Completion execIf(IfStmt &node);
+  Completion execWhile(WhileStmt &node);
+  bool runCompiledLoop(WhileStmt &node, Completion &completion);
+  Completion resumeAfterDeopt(const std::vector<JitResumeStep> &path,
+                              size_t depth);
+  Value *compiledBinding(Variable &var, bool written);
+  Completion execFor(ForStmt &node);
+  Completion execReturn(ReturnStmt &node);
+  bool evalCondition(const Condition &cond);
+  bool conditionTruth(const Value &value, const Condition &cond,
+                      const Span &span);
+  Value evalLogical(BinaryOp &node);
   Value evalExpr(ASTNode *node);
   std::vector<TracebackFrame> collectTraceback() const;
+  void checkCallDepth(const ASTNode &callSite);
   void reportRuntimeError(const std::string &msg, const Span &span,
                           const std::string &hint = "");
-  std::optional<std::string> activeModuleKey() const;
+  ModuleState *activeModule() const;
   ModuleState *getModuleState(const std::string &moduleKey);
   const ModuleState *getModuleState(const std::string &moduleKey) const;
   std::string moduleBindingNameFor(const std::string &target) const;
@@ -69,10 +162,53 @@ class Evaluator : public ASTVisitor {
                         const std::string &moduleKey, const Span &span);
   Value callNative(const NativeFn &fn, const std::vector<ASTPtr> &params);
   Value executeFunction(FunctionStmt *func, const std::vector<ASTPtr> &params,
-                        const Span &span, const std::string &callableName,
-                        const std::string &moduleKey);
+                        const ASTNode &callSite, ModuleState *module,
+                        const std::string *qualifier = nullptr);
   Value instantiateClass(ClassStmt *classDef, const std::vector<ASTPtr> &params,
-                         const Span &span, const std::string &moduleKey);
+                         const ASTNode &callSite, ModuleState *module);
+  Value callInlined(FunctionStmt *func, const std::vector<ASTPtr> &params,
+                    const ASTNode &callSite, ModuleState *module,
+                    const std::string *qualifier);
+  Value runForm(FunctionStmt *func, const std::vector<ASTPtr> &params,
+                std::vector<Value> *args, const ASTNode &callSite,
+                ModuleState *module, const std::string *qualifier);
+  Value callMemoized(FunctionStmt *func, const std::vector<ASTPtr> &params,
+                     const ASTNode &callSite, ModuleState *module,
+                     const std::string *qualifier);
+  Value callCompiled(FunctionStmt *func, const std::vector<ASTPtr> &params,
+                     const ASTNode &callSite, ModuleState *module,
+                     const std::string *qualifier);
+  void bindArguments(FunctionStmt *func, const std::vector<ASTPtr> &params,
+                     size_t base, std::vector<Value> *args = nullptr);
+  void prepareFrameLayout(FunctionStmt *func);
+  Value makeGenerator(FunctionStmt *func, const std::vector<ASTPtr> &params,
+                      const ASTNode &callSite, ModuleState *module,
+                      const std::string *qualifier);
+  bool resumeGenerator(GeneratorIter &gen, Value &out);
+  Completion runGenerator(GeneratorIter &gen);
+  bool stepGeneratorFor(ForStmt &node, GenCursor &cur);
+  Value makeRange(FunctionCall &node);
+  FunctionStmt *findForm(const std::string &name, ModuleState *&module);
+  FunctionStmt *findFormIn(ModuleState *state, const std::string &name,
+                          ModuleState *&module);
+  bool enterTailCall(ASTNode *expr);
+  Value *lookupVariable(Variable &var);
+  Value *resolveVariableRef(Variable &var, bool createFallback = false);
+  Value &assignTarget(Variable &var);
+  Value *stringReceiver(BinaryOp &node);
+  const Value &readOperand(Variable *var, ASTNode *node, Value &copy);
+  Value compoundAssign(BinaryOp &node, Variable &var, const Value &right);
+
+  bool checkIntArgs(const std::string &signature,
+                    const std::vector<Value> &args, size_t required,
+                    size_t optional, const Span &span);
+  bool checkSliceArgs(const std::string &signature,
+                      const std::vector<Value> &args, size_t size,
+                      const Span &span, size_t &start, size_t &stop);
+  void registerBitsMethods();
+  void registerVecSortMethods();
+  void registerContainerMethods();
+  void registerCapacityMethods();
 
   void exitErrors();
 
@@ -88,6 +224,10 @@ class Evaluator : public ASTVisitor {
   Value visit(TypeBool &node) override;
   Value visit(TypeVec &node) override;
   Value visit(TypeDic &node) override;
+  Value visit(TypeBits &node) override;
+  Value visit(TypeDeque &node) override;
+  Value visit(TypeHeap &node) override;
+  Value visit(TypeSet &node) override;
   Value visit(Variable &node) override;
   Value visit(UnaryOp &node) override;
   Value visit(BinaryOp &node) override;
@@ -96,6 +236,7 @@ class Evaluator : public ASTVisitor {
   Value visit(ForStmt &node) override;
   Value visit(FunctionCall &node) override;
   Value visit(ReturnStmt &node) override;
+  Value visit(YieldStmt &node) override;
   Value visit(FunctionStmt &node) override;
   Value visit(ClassStmt &node) override;
   Value visit(LoadStmt &node) override;
@@ -107,6 +248,10 @@ class Evaluator : public ASTVisitor {
 
 public:
   Value evalProgram(ASTPtr program, const std::vector<std::string> args = {});
+  // what --stats reports once the program has run
+  void printStats(std::ostream &out) const;
+  // `load name;` runs 'source' instead of looking for the file
+  void embedModule(const std::string &name, std::string source);
 
   Evaluator(std::string input, Diagnostics &diagnostics, std::string fname,
             std::vector<std::string> search_dirs);
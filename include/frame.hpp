@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "span.hpp"
+#include "types.hpp"
+
+class ASTNode;
+class ExpressionStmt;
+struct ModuleState;
+
+using ASTPtr = std::unique_ptr<ASTNode>;
+
+struct FrameSlot {
+  uint32_t name;
+  bool defined;
+  Value value;
+};
+
+enum class FrameKind : uint8_t { Form, Method, Class };
+
+// Header of one active call. Its locals are the window [base, base + count)
+// of the FrameStack's slot array; the header itself owns no storage unless a
+// local shows up that the frame layout did not predict (see overflow).
+//
+// The traceback label ("form m.f()", "method C.f()", ...) is not built here;
+// collectTraceback derives it from 'kind', 'callee' and 'qualifier' only when
+// an error is actually reported.
+struct CallFrame {
+  size_t base = 0;
+  size_t count = 0;
+  FrameKind kind = FrameKind::Form;
+  ASTNode *callee = nullptr; // FunctionStmt, or ClassStmt for Class
+  // module name for "form m.f()" or class name for methods; may be null
+  const std::string *qualifier = nullptr;
+  const ASTNode *callSite = nullptr;
+  const std::string *callsiteFilename = nullptr;
+  ModuleState *module = nullptr;
+  std::unique_ptr<std::unordered_map<uint32_t, Value>> overflow;
+};
+
+// Every local of every active call lives in one contiguous slot array, and
+// call headers in a second array; both are reserved up front and only ever
+// grow, so calling and returning do not allocate once they are warm.
+//
+// A call is built in two steps: its slots are appended on top of the caller's
+// (while the arguments are still evaluated in the caller's scope), then the
+// header is pushed, which makes the new window the current scope.
+class FrameStack {
+  std::vector<FrameSlot> slots;
+  std::vector<CallFrame> frames;
+
+public:
+  FrameStack() {
+    slots.reserve(4096);
+    frames.reserve(256);
+  }
+
+  bool empty() const { return frames.empty(); }
+  size_t depth() const { return frames.size(); }
+  CallFrame &top() { return frames.back(); }
+  const CallFrame &top() const { return frames.back(); }
+  const std::vector<CallFrame> &all() const { return frames; }
+
+  size_t slotTop() const { return slots.size(); }
+  FrameSlot &slotAt(size_t i) { return slots[i]; }
+
+  void addSlot(uint32_t name) { slots.push_back(FrameSlot{name, false, {}}); }
+  void addSlot(FrameSlot slot) { slots.push_back(std::move(slot)); }
+  void addSlot(uint32_t name, Value value) {
+    slots.push_back(FrameSlot{name, true, std::move(value)});
+  }
+  // index of the first slot named 'name' at or after 'base', or slotTop()
+  size_t findSlotSince(size_t base, uint32_t name) const;
+
+  // makes the slots from 'frame.base' to the top the current scope
+  void pushFrame(CallFrame frame);
+  // drops the current frame together with its slots
+  void popFrame();
+  // drops slots added at or after 'base' that never became a frame
+  void truncate(size_t base);
+  // tail call: the slots from 'argBase' to the top (built above the current
+  // frame) become the current frame's whole window, replacing its locals
+  void replaceTop(size_t argBase);
+
+  // A defined local of the current frame, or nullptr. 'hint' caches the
+  // name's offset in the window for the next lookup from the same node.
+  Value *lookup(uint32_t name, uint32_t &hint);
+  // the storage for local 'name' of the current frame, marked as defined
+  Value &define(uint32_t name, uint32_t &hint);
+  Value &define(uint32_t name) {
+    uint32_t hint = 0;
+    return define(name, hint);
+  }
+
+  // calls fn(name, value) for every defined local of the current frame
+  template <typename F> void forEachLocal(F &&fn) {
+    CallFrame &frame = frames.back();
+    for (size_t i = frame.base; i < frame.base + frame.count; i++) {
+      if (slots[i].defined)
+        fn(slots[i].name, slots[i].value);
+    }
+
+    if (frame.overflow) {
+      for (auto &[name, value] : *frame.overflow)
+        fn(name, value);
+    }
+  }
+};
+
+// Names a call of a form (or class body) with these params and statements
+// can bind as locals: the params, then every plain assignment target and for
+// loop variable in the body. Nested forms and classes are not included.
+std::vector<uint32_t> frame_layout(const std::vector<ASTPtr> &params,
+                                   const std::vector<ExpressionStmt> &stmts);
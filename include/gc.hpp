@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "rc.hpp"
+
+// Cycle collection for vectors and dictionaries.
+//
+// A container is freed as soon as its last handle goes (see RcPtr), unless
+// it is part of a cycle: a vector that holds itself, or two dictionaries
+// that hold each other, keep each other's counts above zero forever. Every
+// container is therefore also tracked here, and gc_collect() finds the ones
+// that only other tracked containers refer to (trial deletion: a
+// container's count minus the references from inside tracked containers is
+// what holds it from outside), keeps whatever those outside references
+// reach, and empties the rest so their counts fall to zero.
+//
+// The evaluator collects between statements once gc_threshold containers
+// were made since the last collection (--gc-threshold), and on request from
+// the `gc` module (`gc.collect()`, `gc.stats()`).
+class Collectable : public RcObject {
+public:
+  enum class Kind : uint8_t { Vec, Dic };
+
+private:
+  Kind kind;
+  Collectable *gcPrev = nullptr;
+  Collectable *gcNext = nullptr;
+
+  friend class CycleCollector;
+
+  inline void track();
+  inline void untrack();
+
+protected:
+  explicit Collectable(Kind k) : kind(k) { track(); }
+  Collectable(const Collectable &other) : RcObject(other), kind(other.kind) {
+    track();
+  }
+  Collectable &operator=(const Collectable &) { return *this; }
+  ~Collectable() { untrack(); }
+};
+
+// every container alive, newest first; inline, and exported by the
+// executable, so that the native libraries share them
+inline Collectable *gc_objects = nullptr;
+inline uint64_t gc_tracked = 0;
+// containers made since the last collection
+inline uint64_t gc_allocated = 0;
+
+struct GcStats {
+  uint64_t collections = 0;
+  uint64_t freed = 0;
+};
+
+inline GcStats gc_stats;
+
+void Collectable::track() {
+  gcNext = gc_objects;
+  if (gc_objects != nullptr)
+    gc_objects->gcPrev = this;
+  gc_objects = this;
+  gc_tracked++;
+  gc_allocated++;
+}
+
+void Collectable::untrack() {
+  if (gcPrev != nullptr)
+    gcPrev->gcNext = gcNext;
+  else
+    gc_objects = gcNext;
+  if (gcNext != nullptr)
+    gcNext->gcPrev = gcPrev;
+  gc_tracked--;
+}
+
+// Frees every container that is only reachable from containers that are
+// themselves unreachable; returns how many it freed.
+size_t gc_collect();
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+class Program;
+
+// Loop-invariant code motion and common-subexpression elimination.
+//
+// In the body (and condition) of a while or for loop, an operation whose
+// operands the loop can never change is marked invariant: its first
+// evaluation in a run of the loop is kept, and every later iteration reuses
+// it. Within a run of plain statements, an operation repeating an earlier
+// one over the same, unchanged operands reuses the earlier result.
+//
+// Only side-effect-free operations are reused: arithmetic, comparisons,
+// indexing and a few read-only methods (`v.len()`), never calls. A loop that
+// calls forms or natives, or mutates any container, keeps recomputing
+// whatever they could change. Evaluation stays lazy, so an operation that
+// fails still fails where and when it did. The bodies of generators are left
+// alone. With --explain-opt each reuse is reported to stderr.
+// Skipped under --no-opt.
+void hoist_invariants(Program &program, const std::string &filename);
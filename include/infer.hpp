@@ -0,0 +1,17 @@
+#pragma once
+
+class Program;
+
+// Flow-sensitive local type inference. Walks the top level of a program and
+// the body of each form, following what every variable holds through
+// assignments, ifs and loops (to a fixed point), and marks the arithmetic
+// and comparisons whose operands it proves are all ints or all floats (see
+// StaticType). A form's parameters take the types of the arguments of every
+// call to it in the program.
+//
+// A mark is a strong hint, not a guarantee: a form can also be called from
+// another module, and a name a form never assigns reads a global. The
+// evaluator still checks each variable it reads and falls back to the
+// general path when one turns out to hold something else, so marks never
+// change what a program does. Skipped under --no-opt and --no-infer.
+void infer_types(Program &program);
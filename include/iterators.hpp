@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame.hpp"
+#include "types.hpp"
+
+class Evaluator;
+
+// range(start, stop, step): the ints from 'start' up to (or, for a negative
+// step, down to) 'stop', exclusive. Nothing is materialized; a range can be
+// iterated any number of times.
+class RangeIter : public ValueIter {
+  tn_int_t start;
+  tn_int_t stop;
+  tn_int_t step;
+  tn_int_t cur;
+
+public:
+  RangeIter(tn_int_t rangeStart, tn_int_t rangeStop, tn_int_t rangeStep)
+      : start(rangeStart), stop(rangeStop), step(rangeStep), cur(rangeStart) {}
+
+  std::shared_ptr<ValueIter> begin() override;
+  bool next(Value &out) override;
+  std::string describe() const override;
+};
+
+// Where a suspended generator is inside one block of its body. A loop's
+// block also keeps what decides the loop's next iteration.
+struct GenCursor {
+  std::vector<ExpressionStmt> *stmts;
+  size_t pc = 0;
+  ASTNode *loop = nullptr; // the WhileStmt or ForStmt running this block
+  bool isFor = false;
+  Value iter;           // for: the value iterated, or the iterator walked
+  size_t index = 0;     // for: iterations started so far
+  std::string lastKey;  // for: dictionary key of the previous iteration
+
+  explicit GenCursor(std::vector<ExpressionStmt> *block,
+                     ASTNode *loopNode = nullptr)
+      : stmts(block), loop(loopNode) {}
+};
+
+// The iterator a call of a form containing `yield` returns. Its frame lives
+// here between elements: each next() puts the saved slots back on the call
+// stack, runs the body from 'cursors' up to the next yield, and takes the
+// slots off again.
+class GeneratorIter : public ValueIter {
+public:
+  Evaluator &evaluator;
+  FunctionStmt *func;
+  ModuleState *module;
+  const std::string *qualifier;
+  const ASTNode *callSite;
+  const std::string *callsiteFilename;
+
+  std::vector<FrameSlot> slots;
+  std::vector<GenCursor> cursors;
+  bool started = false;
+  bool running = false;
+  bool done = false;
+
+  GeneratorIter(Evaluator &eval, FunctionStmt *genFunc, ModuleState *genModule,
+                const std::string *genQualifier, const ASTNode *genCallSite,
+                const std::string *genCallsiteFilename)
+      : evaluator(eval), func(genFunc), module(genModule),
+        qualifier(genQualifier), callSite(genCallSite),
+        callsiteFilename(genCallsiteFilename) {}
+
+  bool next(Value &out) override;
+  std::string describe() const override;
+};
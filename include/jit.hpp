@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Variable;
+class ExpressionStmt;
+class WhileStmt;
+class FunctionStmt;
+
+// A baseline template JIT: loops and forms the evaluator finds hot are
+// translated statement by statement into x86-64 machine code, specialised
+// on the types their variables hold when they are compiled. Only int and
+// float arithmetic, comparisons, vec element reads and writes, if, while,
+// break and continue (and, in forms, return and calls to the form itself)
+// are compiled; anything else leaves the loop or form to the interpreter.
+//
+// Only x86-64 Linux is supported; elsewhere jit_available() is false and
+// nothing is ever compiled.
+
+enum class JitType : uint8_t { Int, Dec, Vec };
+
+// A variable a compiled loop uses, bound to the interpreter's storage for
+// it each time the loop is entered and written back when it exits.
+struct JitBinding {
+  Variable *var;
+  JitType type;
+  bool written;
+};
+
+// Where the interpreter picks up after a compiled loop deoptimizes: the
+// statement at 'index' in 'block'. A path of them leads from the loop's
+// body down through the ifs and whiles the statement is nested in.
+struct JitResumeStep {
+  std::vector<ExpressionStmt> *block;
+  size_t index;
+};
+
+// Machine code in pages of its own, executable but no longer writable.
+class JitCode {
+  void *mem = nullptr;
+  size_t size = 0;
+
+public:
+  JitCode() = default;
+  JitCode(const JitCode &) = delete;
+  JitCode &operator=(const JitCode &) = delete;
+  ~JitCode();
+
+  bool load(const std::vector<uint8_t> &bytes);
+  // calls the code's entry point with the context and 'slots'
+  uint32_t call(void *context, int64_t *slots) const;
+};
+
+struct JitLoop {
+  std::vector<JitBinding> bindings;
+  // by deopt id, from 1; an empty path means the loop's own condition
+  std::vector<std::vector<JitResumeStep>> resumePoints;
+  uint32_t deopts = 0;
+  JitCode code;
+
+  // Runs the loop over 'slots', one per binding holding the int, the bits
+  // of the float or the ValueVec pointer. Returns 0 once the loop is done,
+  // or the id of the statement it stopped in front of: one whose vec index
+  // was out of bounds, whose element was not an int, or that divides by
+  // zero, which the interpreter then runs (and reports) itself.
+  uint32_t run(int64_t *slots) const;
+};
+
+// A form `tent build` translated to C++ ahead of time, for int arguments
+// and an int result. Called like JitForm::run, with the same contract.
+using PrecompiledFn = bool (*)(const int64_t *args, int64_t depthLimit,
+                               int64_t &result);
+
+// Identifies the form by where its definition starts, which parsing the
+// embedded source again reproduces.
+struct PrecompiledForm {
+  const char *file;
+  uint32_t line;
+  uint32_t column;
+  uint32_t arity;
+  bool recursive;
+  PrecompiledFn run;
+};
+
+struct JitForm {
+  std::vector<JitType> params;
+  JitType result = JitType::Int;
+  // the body calls the form again by name
+  bool recursive = false;
+  uint32_t aborts = 0;
+  JitCode code;
+  // runs instead of 'code' for a precompiled form
+  PrecompiledFn precompiled = nullptr;
+
+  // Runs a call with 'args' (ints and float bits), at most 'depthLimit'
+  // calls deep. A compiled form only reads its own parameters and locals,
+  // so a call that gives up (too deep, dividing by zero, or reaching the
+  // end of the body without a return) returns false having changed nothing,
+  // and the interpreter runs it over again.
+  bool run(const int64_t *args, int64_t depthLimit, int64_t &result) const;
+};
+
+bool jit_available();
+// 'typeOf' reports the type a variable the loop uses holds now, or false
+// when it holds nothing the JIT handles; null if the loop cannot be
+// compiled
+std::unique_ptr<JitLoop>
+jit_compile_loop(WhileStmt &loop,
+                 const std::function<bool(Variable &, JitType &)> &typeOf);
+// null if the form cannot be compiled for arguments of these types
+std::unique_ptr<JitForm> jit_compile_form(FunctionStmt &func,
+                                          const std::vector<JitType> &params);
+
+// Makes the forms of a built executable available to
+// jit_precompiled_form, which is null unless the form defined at 'line'
+// and 'column' of 'file' is one of them. Works without the JIT.
+void jit_add_precompiled(const PrecompiledForm *forms, size_t count);
+std::unique_ptr<JitForm> jit_precompiled_form(const std::string &file,
+                                              size_t line, size_t column,
+                                              size_t arity);
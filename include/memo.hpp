@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+
+// Results of one `@memo` form, keyed by its arguments, evicting the least
+// recently used entry once 'capacity' are held.
+//
+// Only calls whose arguments are all scalars (int, float, bool, string or
+// null) are looked up, and only scalar results are stored: a cached vec
+// could be changed by one caller behind the next one's back.
+class MemoCache {
+  struct Entry {
+    std::string key;
+    Value result;
+  };
+
+  // most recently used first; the index points into it
+  std::list<Entry> entries;
+  std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+  size_t capacity;
+
+public:
+  static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+
+  explicit MemoCache(size_t maxEntries = DEFAULT_CAPACITY)
+      : capacity(maxEntries) {}
+
+  size_t size() const { return entries.size(); }
+
+  // Encodes 'args' into 'key'. False if one of them is not a scalar, in
+  // which case the call is not cached.
+  static bool makeKey(const std::vector<Value> &args, std::string &key);
+
+  // the cached result for 'key', or nullptr; counts a hit or a miss
+  const Value *find(const std::string &key);
+  // stores 'result' unless it is not a scalar
+  void insert(std::string key, const Value &result);
+};
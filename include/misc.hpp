@@ -5,6 +5,7 @@
 
 struct Value;
 class ASTVisitor;
+struct Closure;
 
 inline void printIndent(int indent) { printf("%*s", indent, " "); }
 
@@ -22,7 +23,13 @@ public:
 
   virtual Value accept(ASTVisitor &visitor) = 0;
 
+  // what evalExpr runs instead of accept() under --closures (see closure.hpp)
+  const Closure *compiled = nullptr;
+
   friend class Evaluator;
+  friend class AotTranslator;
+  friend class Hoister;
+  friend class ClosureCompiler;
 
   virtual ~ASTNode() = default;
 };
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Process-wide table of identifier names. Each distinct name gets a small
+// integer id once (when its AST node is built), so the evaluator compares and
+// stores ids instead of hashing strings at run time.
+uint32_t intern_name(const std::string &name);
+const std::string &interned_name(uint32_t id);
@@ -7,4 +7,7 @@
 
 using NativeFn = Value(*)(const std::vector<Value>&);
 
-extern std::unordered_map<std::string, NativeFn> nativeFunctions;
\ No newline at end of file
+extern std::unordered_map<std::string, NativeFn> nativeFunctions;
+
+// the builtin `gc` module: collect() and stats()
+void registerGcFunctions(std::unordered_map<std::string, NativeFn> &functions);
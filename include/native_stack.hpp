@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Runs 'fn' on a new thread whose native stack is 'bytes' long and returns
+// its result. The stack is reserved address space that the OS only backs
+// with memory as deep recursion actually touches it. Falls back to calling
+// 'fn' on the current thread if such a thread cannot be created.
+int run_on_large_stack(size_t bytes, const std::function<int()> &fn);
+
+// Lowest address the current thread's stack may safely grow down to: the
+// end of the stack run_on_large_stack mapped, less a margin for the native
+// code that runs between two checks (and for reporting the error). 0 on
+// threads it did not start, whose bounds are unknown.
+uintptr_t native_stack_limit();
+
+// Whether the current thread's stack has grown past native_stack_limit().
+bool native_stack_exhausted();
@@ -48,7 +48,7 @@ enum class TokenType: TokenTypeSize {
 	OPEN_BRACKET, CLOSE_BRACKET,
 	COMMA, SEM, NEWLINE,
 	LOAD,
-	FORM, WITH, RETURN,
+	FORM, WITH, RETURN, YIELD,
 	IF, ELSE,
 	WHILE, BREAK, CONTINUE,
 	INT_HEX, INT_DEC, INT_OCT, INT_BIN,
@@ -75,7 +75,12 @@ enum class TokenType: TokenTypeSize {
 	TYPE_VEC,
 	TYPE_DIC,
 
-	COLON
+	COLON,
+
+	TYPE_BITS,
+	TYPE_DEQUE,
+	TYPE_HEAP,
+	TYPE_SET
 };
 
 inline std::string tokenTypeToString(TokenType type) {
@@ -147,6 +152,7 @@ inline std::string tokenTypeToString(TokenType type) {
         case TokenType::FORM: return "form keyword";
         case TokenType::WITH: return "with keyword";
         case TokenType::RETURN: return "return keyword";
+        case TokenType::YIELD: return "yield keyword";
         case TokenType::IF: return "if keyword";
         case TokenType::ELSE: return "else keyword";
         case TokenType::WHILE: return "while keyword";
@@ -180,6 +186,11 @@ inline std::string tokenTypeToString(TokenType type) {
 
         case TokenType::COLON: return "colon (:)";
 
+        case TokenType::TYPE_BITS: return "bits type";
+        case TokenType::TYPE_DEQUE: return "deque type";
+        case TokenType::TYPE_HEAP: return "heap type";
+        case TokenType::TYPE_SET: return "set type";
+
         default: return "unknown token";
     }
 }
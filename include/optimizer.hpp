@@ -0,0 +1,9 @@
+#pragma once
+
+class Program;
+
+// Rewrites a parsed program before it runs, without changing what it does:
+// marks the small forms whose calls can be inlined (see InlineBody) and the
+// statements and conditions that run as superinstructions (see FusedStmt).
+// Skipped under --no-opt.
+void optimize_program(Program &program);
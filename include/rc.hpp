@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+template <typename T> class RcPtr;
+
+// Base of the objects behind the runtime's container handles (see RcPtr).
+// The reference count lives in the object and is a plain integer: the
+// evaluator runs on a single thread, so copying a handle (returning a
+// variable, passing an argument) is an ordinary increment instead of the
+// locked one std::shared_ptr pays for every copy. No container is ever
+// handed to another thread (the parallel sort only moves numbers and
+// strings), so the count never needs to be atomic.
+class RcObject {
+  mutable uint32_t refs = 0;
+
+  template <typename T> friend class RcPtr;
+
+  void retain() const { refs++; }
+
+  // true once the last handle is gone
+  bool release() const { return --refs == 0; }
+
+protected:
+  RcObject() = default;
+  // a copy is a new object, with no handles to it yet
+  RcObject(const RcObject &) {}
+  RcObject &operator=(const RcObject &) { return *this; }
+  ~RcObject() = default;
+
+public:
+  uint32_t useCount() const { return refs; }
+};
+
+// An owning handle to a T derived from RcObject, with the interface of the
+// std::shared_ptr it replaces. The object is deleted as a T, so a handle
+// must always name the object's own type.
+template <typename T> class RcPtr {
+  T *ptr = nullptr;
+
+public:
+  RcPtr() = default;
+  RcPtr(std::nullptr_t) {}
+  explicit RcPtr(T *object) : ptr(object) {
+    if (ptr)
+      ptr->retain();
+  }
+  RcPtr(const RcPtr &other) : ptr(other.ptr) {
+    if (ptr)
+      ptr->retain();
+  }
+  RcPtr(RcPtr &&other) noexcept : ptr(other.ptr) { other.ptr = nullptr; }
+  ~RcPtr() {
+    if (ptr && ptr->release())
+      delete ptr;
+  }
+
+  RcPtr &operator=(const RcPtr &other) {
+    RcPtr(other).swap(*this);
+    return *this;
+  }
+  RcPtr &operator=(RcPtr &&other) noexcept {
+    RcPtr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  void swap(RcPtr &other) noexcept { std::swap(ptr, other.ptr); }
+  void reset() { RcPtr().swap(*this); }
+
+  T *get() const { return ptr; }
+  T &operator*() const { return *ptr; }
+  T *operator->() const { return ptr; }
+  explicit operator bool() const { return ptr != nullptr; }
+  long use_count() const { return ptr ? ptr->useCount() : 0; }
+
+  bool operator==(const RcPtr &other) const { return ptr == other.ptr; }
+  bool operator!=(const RcPtr &other) const { return ptr != other.ptr; }
+};
+
+template <typename T, typename... Args> RcPtr<T> make_rc(Args &&...args) {
+  return RcPtr<T>(new T(std::forward<Args>(args)...));
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "types.hpp"
+
+// Total order used by the vector sort/search methods: numbers (int, float
+// and bool) compare by value, with NaN after all others, and sort before
+// strings, which compare lexicographically. Other types cannot be ordered.
+bool is_orderable_val(const Value &val);
+// <0, 0 or >0 like strcmp; both values must be orderable
+int compare_values(const Value &a, const Value &b);
+
+// Sorts orderable values in place. Vectors of only ints are radix sorted;
+// anything else uses std::sort. Inputs of at least PARALLEL_SORT_THRESHOLD
+// elements are split into chunks that are sorted on separate threads and
+// merged back together.
+void sort_values(std::vector<Value> &elems, bool descending = false);
+
+// first index whose element is not less than 'key' (elems must be sorted)
+size_t lower_bound_value(const ValueVec &elems, const Value &key);
+
+constexpr size_t PARALLEL_SORT_THRESHOLD = size_t(1) << 17;
@@ -1,13 +1,18 @@
 #pragma once
 
+#include "bits.hpp"
+#include "gc.hpp"
 #include "misc.hpp"
 #include "opcodes.hpp"
+#include "rc.hpp"
 #include <cstdint>
 #include <map>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -16,6 +21,12 @@ typedef double tn_dec_t;
 typedef bool tn_bool_t;
 
 class FunctionStmt;
+class ValueVec;
+class ValueDic;
+class ValueDeque;
+class ValueHeap;
+class ValueSet;
+class ValueIter;
 struct Value;
 
 struct Value {
@@ -37,10 +48,16 @@ struct Value {
         : name(std::move(moduleName)), key(std::move(moduleKey)) {}
   };
 
-  using VecT = std::shared_ptr<std::vector<Value>>;
-  using DicT = std::shared_ptr<std::map<std::string, Value>>;
+  using VecT = RcPtr<ValueVec>;
+  using DicT = RcPtr<ValueDic>;
+  using BitsT = std::shared_ptr<Bits>;
+  using DequeT = std::shared_ptr<ValueDeque>;
+  using HeapT = std::shared_ptr<ValueHeap>;
+  using SetT = std::shared_ptr<ValueSet>;
+  using IterT = std::shared_ptr<ValueIter>;
   std::variant<tn_int_t, tn_dec_t, tn_bool_t, std::string, VecT, DicT,
-               ClassInstance, ModuleRef, NullLiteral>
+               ClassInstance, ModuleRef, NullLiteral, BitsT, DequeT, HeapT,
+               SetT, IterT>
       v;
   Span span;
   bool typeInt = false;
@@ -49,7 +66,10 @@ struct Value {
   bool typeBool = false;
   bool typeVec = false;
   bool typeDic = false;
-  bool isReturn = false;
+  bool typeBits = false;
+  bool typeDeque = false;
+  bool typeHeap = false;
+  bool typeSet = false;
   bool isExit = false;
 
   Value() : v(NullLiteral()) {}
@@ -57,15 +77,50 @@ struct Value {
   Value(tn_dec_t d) : v(d) {}
   Value(tn_bool_t b) : v(b) {}
   Value(std::string s) : v(s) {}
-  Value(VecT vec) : v(vec) {}
-  Value(DicT dic) : v(dic) {}
+  Value(VecT vec) : v(std::move(vec)) {}
+  Value(DicT dic) : v(std::move(dic)) {}
+  Value(BitsT bits) : v(std::move(bits)) {}
+  Value(DequeT deque) : v(std::move(deque)) {}
+  Value(HeapT heap) : v(std::move(heap)) {}
+  Value(SetT set) : v(std::move(set)) {}
+  Value(IterT iter) : v(std::move(iter)) {}
   Value(ClassInstance ci) : v(ci) {}
   Value(ModuleRef module) : v(std::move(module)) {}
 
-  Value &setSpan(Span newSpan) {
+  // Copying a Value whose contents are held by value (a string, a class
+  // instance) duplicates all of them, unlike the handles of containers; each
+  // such copy is counted in deep_value_copies for --stats. Moves are free.
+  Value(const Value &other)
+      : v(other.v), span(other.span), typeInt(other.typeInt),
+        typeFloat(other.typeFloat), typeStr(other.typeStr),
+        typeBool(other.typeBool), typeVec(other.typeVec),
+        typeDic(other.typeDic), typeBits(other.typeBits),
+        typeDeque(other.typeDeque), typeHeap(other.typeHeap),
+        typeSet(other.typeSet), isExit(other.isExit) {
+    countCopy();
+  }
+  Value(Value &&) noexcept = default;
+  Value &operator=(const Value &other) {
+    if (this != &other) {
+      Value copy(other);
+      *this = std::move(copy);
+    }
+    return *this;
+  }
+  Value &operator=(Value &&) noexcept = default;
+  ~Value() = default;
+
+  // on a temporary, hands the temporary itself on, so that
+  // `return Value(x).setSpan(s)` and `args.push_back(evalExpr(e).setSpan(s))`
+  // move it instead of copying it
+  Value &setSpan(Span newSpan) & {
     span = newSpan;
     return *this;
   }
+  Value &&setSpan(Span newSpan) && {
+    span = newSpan;
+    return std::move(*this);
+  }
 
   std::string getTypeName() const {
     if (std::holds_alternative<tn_int_t>(v)) {
@@ -80,6 +135,16 @@ struct Value {
       return "vector";
     } else if (std::holds_alternative<DicT>(v)) {
       return "dictionary";
+    } else if (std::holds_alternative<BitsT>(v)) {
+      return "bits";
+    } else if (std::holds_alternative<DequeT>(v)) {
+      return "deque";
+    } else if (std::holds_alternative<HeapT>(v)) {
+      return "heap";
+    } else if (std::holds_alternative<SetT>(v)) {
+      return "set";
+    } else if (std::holds_alternative<IterT>(v)) {
+      return "iterator";
     } else if (std::holds_alternative<ClassInstance>(v)) {
       return std::get<ClassInstance>(v).name;
     } else if (std::holds_alternative<ModuleRef>(v)) {
@@ -89,10 +154,154 @@ struct Value {
     }
     return "unknown";
   }
+
+private:
+  void countCopy() const;
+};
+
+// inline, so that a native library copying Values needs nothing from the
+// interpreter to be loaded (it counts into its own)
+inline uint64_t deep_value_copies = 0;
+
+inline void Value::countCopy() const {
+  if (std::holds_alternative<std::string>(v) ||
+      std::holds_alternative<ClassInstance>(v))
+    deep_value_copies++;
+}
+
+// Element storage behind the `vec` type. The elements live in a buffer that
+// can be shared between several vectors: a slice is a window of
+// [offset, offset + length) over its parent's buffer, so slicing is O(1).
+// Buffers are copy-on-write; whichever side mutates a shared buffer first
+// takes a private copy of its own range, so slices and parents never observe
+// each other's changes.
+class ValueVec : public Collectable {
+  std::shared_ptr<std::vector<Value>> buf;
+  size_t off = 0;
+  size_t len = 0;
+
+  // make 'buf' private to this vector and exactly [0, len) of it
+  void detach() {
+    if (buf.use_count() == 1 && off == 0 && buf->size() == len)
+      return;
+
+    buf = std::make_shared<std::vector<Value>>(buf->begin() + off,
+                                               buf->begin() + off + len);
+    off = 0;
+  }
+
+  ValueVec(std::shared_ptr<std::vector<Value>> buffer, size_t offset,
+           size_t length)
+      : Collectable(Kind::Vec), buf(std::move(buffer)), off(offset),
+        len(length) {}
+
+public:
+  ValueVec()
+      : Collectable(Kind::Vec), buf(std::make_shared<std::vector<Value>>()) {}
+  explicit ValueVec(size_t n, const Value &fill = Value())
+      : Collectable(Kind::Vec),
+        buf(std::make_shared<std::vector<Value>>(n, fill)), len(n) {}
+  ValueVec(std::vector<Value> elems)
+      : Collectable(Kind::Vec),
+        buf(std::make_shared<std::vector<Value>>(std::move(elems))),
+        len(buf->size()) {}
+
+  size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+  bool isSlice() const { return off != 0 || buf->size() != len; }
+
+  const Value &operator[](size_t i) const { return (*buf)[off + i]; }
+  const Value &back() const { return (*buf)[off + len - 1]; }
+  const Value *begin() const { return buf->data() + off; }
+  const Value *end() const { return buf->data() + off + len; }
+
+  // O(1) view of [start, stop); the caller checks the bounds
+  ValueVec slice(size_t start, size_t stop) const {
+    return ValueVec(buf, off + start, stop - start);
+  }
+
+  void set(size_t i, Value value) {
+    detach();
+    (*buf)[i] = std::move(value);
+  }
+
+  void push_back(Value value) {
+    detach();
+    buf->push_back(std::move(value));
+    len++;
+  }
+
+  void pop_back() {
+    detach();
+    buf->pop_back();
+    len--;
+  }
+
+  void reserve(size_t n) {
+    detach();
+    buf->reserve(n);
+  }
+
+  // Every element of the buffer, including those outside a slice's window:
+  // the slice keeps all of them alive (see gc.hpp).
+  const std::vector<Value> &buffer() const { return *buf; }
+
+  // lets go of the elements, without touching a buffer that is shared
+  void clear() {
+    buf = std::make_shared<std::vector<Value>>();
+    off = 0;
+    len = 0;
+  }
+
+  // a slice has no spare room of its own: it is copied on the first write
+  size_t capacity() const { return isSlice() ? len : buf->capacity(); }
+
+  void shrink() {
+    detach();
+    buf->shrink_to_fit();
+  }
+
+  // direct access to the elements for bulk in-place edits; 'edit' may change
+  // the size of the vector it is given
+  template <typename F> void edit(F &&edit) {
+    detach();
+    edit(*buf);
+    len = buf->size();
+  }
 };
 
-inline Value make_vec(const std::vector<Value> &elems) {
-  return Value(std::make_shared<std::vector<Value>>(elems));
+// Entries behind the `dic` type, in key order.
+class ValueDic : public Collectable, public std::map<std::string, Value> {
+public:
+  ValueDic() : Collectable(Kind::Dic) {}
+  ValueDic(std::map<std::string, Value> entries)
+      : Collectable(Kind::Dic),
+        std::map<std::string, Value>(std::move(entries)) {}
+};
+
+// A lazily produced sequence that a for loop walks one element at a time:
+// ranges, generators, and whatever native libraries hand out (such as the
+// lines of a file). Elements are only computed as the loop asks for them.
+class ValueIter : public std::enable_shared_from_this<ValueIter> {
+public:
+  virtual ~ValueIter() = default;
+
+  // The iterator a for loop should walk. Sequences that can be iterated
+  // more than once (ranges) return a fresh one from the start; single-pass
+  // ones (generators, files) return themselves.
+  virtual std::shared_ptr<ValueIter> begin() { return shared_from_this(); }
+  // stores the next element in 'out'; false once the sequence is exhausted
+  virtual bool next(Value &out) = 0;
+  virtual std::string describe() const = 0;
+};
+
+// std::vector only moves elements on reallocation when the move constructor
+// cannot throw; otherwise every growth step copies each Value
+static_assert(std::is_nothrow_move_constructible_v<Value>,
+              "Value must be nothrow move constructible");
+
+inline Value make_vec(std::vector<Value> elems) {
+  return Value(make_rc<ValueVec>(std::move(elems)));
 }
 
 inline constexpr bool is_primitive_val(const Value &val) {
@@ -6,6 +6,7 @@
 #include <map>
 #include <variant>
 #include "types.hpp"
+#include "containers.hpp"
 
 #define VALUE_STRING_MAX_DEC_LEN 50
 
@@ -37,6 +38,44 @@ inline std::string dic_to_string(const Value::DicT& dicPtr) {
 	return oss.str();
 }
 
+inline std::string bits_to_string(const Value::BitsT& bitsPtr) {
+	std::string out = "bits(";
+	if (bitsPtr) {
+		out.reserve(out.size() + bitsPtr->size() + 1);
+		for (size_t i = 0; i < bitsPtr->size(); i++)
+			out.push_back(bitsPtr->get(i) ? '1' : '0');
+	}
+	out.push_back(')');
+	return out;
+}
+
+inline std::string deque_to_string(const Value::DequeT& dequePtr) {
+	std::ostringstream oss;
+	oss << "deque[";
+	if (dequePtr) {
+		for (size_t i = 0; i < dequePtr->size(); i++) {
+			oss << value_to_string((*dequePtr)[i], true);
+			if (i + 1 < dequePtr->size()) oss << ", ";
+		}
+	}
+	oss << "]";
+	return oss.str();
+}
+
+inline std::string set_to_string(const Value::SetT& setPtr) {
+	std::ostringstream oss;
+	oss << "set{";
+	if (setPtr) {
+		std::vector<Value> elems = setPtr->values();
+		for (size_t i = 0; i < elems.size(); i++) {
+			oss << value_to_string(elems[i], true);
+			if (i + 1 < elems.size()) oss << ", ";
+		}
+	}
+	oss << "}";
+	return oss.str();
+}
+
 inline std::string value_to_string(const Value& val, bool quote_string) {
 	if (std::holds_alternative<tn_int_t>(val.v))
 		return std::to_string(std::get<tn_int_t>(val.v));
@@ -54,6 +93,18 @@ inline std::string value_to_string(const Value& val, bool quote_string) {
 		return vec_to_string(std::get<Value::VecT>(val.v));
 	else if (std::holds_alternative<Value::DicT>(val.v))
 		return dic_to_string(std::get<Value::DicT>(val.v));
+	else if (std::holds_alternative<Value::BitsT>(val.v))
+		return bits_to_string(std::get<Value::BitsT>(val.v));
+	else if (std::holds_alternative<Value::DequeT>(val.v))
+		return deque_to_string(std::get<Value::DequeT>(val.v));
+	else if (std::holds_alternative<Value::HeapT>(val.v)) {
+		const Value::HeapT& heapPtr = std::get<Value::HeapT>(val.v);
+		return std::string(heapPtr->maxHeap() ? "<max heap, " : "<min heap, ") +
+			std::to_string(heapPtr->size()) + " items>";
+	} else if (std::holds_alternative<Value::SetT>(val.v))
+		return set_to_string(std::get<Value::SetT>(val.v));
+	else if (std::holds_alternative<Value::IterT>(val.v))
+		return std::get<Value::IterT>(val.v)->describe();
 	else if (std::holds_alternative<Value::ClassInstance>(val.v))
 		return "<" + std::get<Value::ClassInstance>(val.v).name + ">";
 	else if (std::holds_alternative<Value::ModuleRef>(val.v))
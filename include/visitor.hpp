@@ -14,6 +14,10 @@ class TypeStr;
 class TypeBool;
 class TypeVec;
 class TypeDic;
+class TypeBits;
+class TypeDeque;
+class TypeHeap;
+class TypeSet;
 class Variable;
 class UnaryOp;
 class BinaryOp;
@@ -23,6 +27,7 @@ class WhileStmt;
 class ForStmt;
 class FunctionCall;
 class ReturnStmt;
+class YieldStmt;
 class FunctionStmt;
 class ClassStmt;
 class LoadStmt;
@@ -43,6 +48,10 @@ public:
   virtual Value visit(TypeBool &) = 0;
   virtual Value visit(TypeVec &) = 0;
   virtual Value visit(TypeDic &) = 0;
+  virtual Value visit(TypeBits &) = 0;
+  virtual Value visit(TypeDeque &) = 0;
+  virtual Value visit(TypeHeap &) = 0;
+  virtual Value visit(TypeSet &) = 0;
   virtual Value visit(Variable &) = 0;
   virtual Value visit(UnaryOp &) = 0;
   virtual Value visit(BinaryOp &) = 0;
@@ -52,6 +61,7 @@ public:
   virtual Value visit(ForStmt &) = 0;
   virtual Value visit(FunctionCall &) = 0;
   virtual Value visit(ReturnStmt &) = 0;
+  virtual Value visit(YieldStmt &) = 0;
   virtual Value visit(FunctionStmt &) = 0;
   virtual Value visit(ClassStmt &) = 0;
   virtual Value visit(LoadStmt &) = 0;
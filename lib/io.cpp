@@ -97,6 +97,44 @@ Value io__file__read_file(const std::vector<Value>& args) {
 	return Value(output);
 }
 
+// The lines of a file, read one at a time as a for loop asks for them, so
+// a file of any size is walked in constant memory.
+class FileLines : public ValueIter {
+	std::ifstream file;
+	std::string path;
+
+public:
+	FileLines(const std::string& filename) : file(filename), path(filename) {}
+
+	bool isOpen() const { return file.is_open(); }
+
+	bool next(Value& out) override {
+		std::string line;
+		if (!std::getline(file, line))
+			return false;
+
+		out = Value(line);
+		return true;
+	}
+
+	std::string describe() const override {
+		return "<lines of " + path + ">";
+	}
+};
+
+Value io__file__lines(const std::vector<Value>& args) {
+	if (args.size() != 1 || !std::holds_alternative<std::string>(args[0].v)) {
+		std::cerr << "`File::lines` takes a file name (string)" << std::endl;
+		return Value((tn_int_t)-1);
+	}
+
+	auto lines = std::make_shared<FileLines>(std::get<std::string>(args[0].v));
+	if (!lines->isOpen())
+		return Value((tn_int_t)-1);
+
+	return Value(Value::IterT(lines));
+}
+
 Value io__file__close_file(const std::vector<Value>& args) {
 	if (args.size() != 1 || !std::holds_alternative<tn_int_t>(args[0].v)) {
 		std::cerr << "`File::closeFile` takes a file index (int)" << std::endl;
@@ -126,4 +164,5 @@ extern "C" void registerFunctions(std::unordered_map<std::string, NativeFn>& tab
 	table["file__readLine"] = io__file__read_line;
 	table["file__readFile"] = io__file__read_file;
 	table["file__closeFile"] = io__file__close_file;
+	table["file__lines"] = io__file__lines;
 }
@@ -11,13 +11,13 @@
 
 #define strlit(s) s, (sizeof(s)-1)
 
-extern std::string SRC_FILENAME, PROG_NAME;
+extern std::string SRC_FILENAME, PROG_NAME, BUILD_OUTPUT;
 extern std::vector<std::string> prog_args, search_dirs;
 extern uint64_t runtime_flags;
+extern uint64_t max_call_depth;
+extern uint64_t gc_threshold;
 
-void parseArgs(int32_t argc, char **argv) {
-	PROG_NAME = std::string(argv[0]);
-
+static void addDefaultSearchDirs(void) {
 	// add some sensible defaults (the '..' ones are for 35rod)
 	search_dirs.push_back(".");
 	search_dirs.push_back("lib");
@@ -31,6 +31,19 @@ void parseArgs(int32_t argc, char **argv) {
 	const char *home = std::getenv("HOME");
 	if (home != nullptr)
 		search_dirs.push_back(std::string(home) + "/.local/lib/tent");
+}
+
+void parseEmbeddedArgs(int32_t argc, char **argv) {
+	PROG_NAME = std::string(argv[0]);
+	addDefaultSearchDirs();
+
+	for (int32_t arg_i = 1; arg_i < argc; arg_i++)
+		prog_args.push_back(argv[arg_i]);
+}
+
+void parseArgs(int32_t argc, char **argv) {
+	PROG_NAME = std::string(argv[0]);
+	addDefaultSearchDirs();
 
 	bool doing_prog_args = false;
 	std::string command;
@@ -39,7 +52,7 @@ void parseArgs(int32_t argc, char **argv) {
 	if (argc > 1 && argv[1][0] != '-') {
 		std::string first = argv[1];
 
-		if (first == "repl" || first == "help") {
+		if (first == "repl" || first == "help" || first == "build") {
 			command = first;
 			arg_i = 2;
 		}
@@ -47,6 +60,8 @@ void parseArgs(int32_t argc, char **argv) {
 
 	if (command == "repl")
 		SET_FLAG(REPL);
+	else if (command == "build")
+		SET_FLAG(BUILD);
 	else if (command == "help")
 		printUsage();
 
@@ -82,6 +97,47 @@ void parseArgs(int32_t argc, char **argv) {
 			}
 			if (IS_FLAG_SET(DEBUG)) std::cerr << "added directory '" << found_arg << "' to search_dirs\n";
 			search_dirs.insert(search_dirs.begin(), found_arg);
+		} else if (arg == "--no-opt") {
+			SET_FLAG(NO_OPT);
+		} else if (arg == "--explain-opt") {
+			SET_FLAG(EXPLAIN_OPT);
+		} else if (arg == "--closures") {
+			SET_FLAG(CLOSURES);
+		} else if (arg == "--no-infer") {
+			SET_FLAG(NO_INFER);
+		} else if (arg == "--jit") {
+			CLEAR_FLAG(NO_JIT);
+		} else if (arg == "--no-jit") {
+			SET_FLAG(NO_JIT);
+		} else if (arg == "--stats") {
+			SET_FLAG(STATS);
+		} else if (arg == "-o" && IS_FLAG_SET(BUILD)) {
+			if (arg_i + 1 >= argc) {
+				std::cerr << "Missing path after '-o'\n";
+				printUsage();
+			}
+			BUILD_OUTPUT = argv[++arg_i];
+		} else if (arg == "--max-depth") {
+			char *end = nullptr;
+			unsigned long long depth = 0;
+			if (arg_i + 1 < argc)
+				depth = std::strtoull(argv[++arg_i], &end, 10);
+			if (end == nullptr || *end != '\0' || depth == 0) {
+				std::cerr << "'--max-depth' takes a positive integer\n";
+				printUsage();
+			}
+			max_call_depth = depth;
+		} else if (arg == "--gc-threshold") {
+			char *end = nullptr;
+			unsigned long long threshold = 0;
+			if (arg_i + 1 < argc)
+				threshold = std::strtoull(argv[++arg_i], &end, 10);
+			if (end == nullptr || *end != '\0') {
+				std::cerr << "'--gc-threshold' takes a non-negative integer\n";
+				printUsage();
+			}
+			// 0 leaves collecting to gc.collect()
+			gc_threshold = threshold == 0 ? UINT64_MAX : threshold;
 		} else if (arg[0] == '-') {
 			std::cerr << "Unknown option: " << arg << "\n";
 			printUsage();
@@ -112,11 +168,31 @@ void printUsage(void) {
         << "Usage:\n"
         << "  " << PROG_NAME << " <file> [options]  Run a Tent source file\n"
         << "  " << PROG_NAME << " repl              Start interactive REPL\n"
+        << "  " << PROG_NAME << " build <file> [-o <out>]\n"
+        << "                    Compile a Tent source file to an executable\n"
         << "  " << PROG_NAME << " help              Show this help message\n\n"
         << "Options:\n"
         << "  -d, --debug     Enable debug output\n"
         << "  --dry           Dry run (implies debug)\n"
         << "  -S <path>       Add library search path\n"
+        << "  --max-depth <n> Maximum call depth (default "
+        << DEFAULT_MAX_CALL_DEPTH << ")\n"
+        << "  --gc-threshold <n>\n"
+        << "                  Collect reference cycles after every <n> new\n"
+        << "                  vectors and dictionaries (default "
+        << DEFAULT_GC_THRESHOLD << ", 0 = never)\n"
+        << "  --no-opt        Run the program as written: no inlining,\n"
+        << "                  superinstructions, type inference, loop\n"
+        << "                  hoisting or reuse of repeated operations\n"
+        << "  --explain-opt   Report the operations hoisted out of loops or\n"
+        << "                  reused\n"
+        << "  --no-infer      Skip type inference (unboxed arithmetic)\n"
+        << "  --closures      Evaluate expressions through a pre-linked closure\n"
+        << "                  tree instead of visiting the AST\n"
+        << "  --jit           Compile hot loops and forms to machine code\n"
+        << "                  (the default on x86-64 Linux)\n"
+        << "  --no-jit        Interpret everything\n"
+        << "  --stats         Print runtime statistics to stderr on exit\n"
         << "  --help          Show this help message"
         << std::endl;
 
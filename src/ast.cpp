@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "misc.hpp"
+#include "names.hpp"
 #include "visitor.hpp"
 
 Value NoOp::accept(ASTVisitor &v) { return v.visit(*this); }
@@ -109,9 +110,42 @@ void TypeDic::print(int indent) {
   std::cout << "TypeDic()" << std::endl;
 }
 
+Value TypeBits::accept(ASTVisitor &v) { return v.visit(*this); }
+TypeBits::TypeBits(Span s) : ASTNode(s) {}
+
+void TypeBits::print(int indent) {
+  printIndent(indent);
+  std::cout << "TypeBits()" << std::endl;
+}
+
+Value TypeDeque::accept(ASTVisitor &v) { return v.visit(*this); }
+TypeDeque::TypeDeque(Span s) : ASTNode(s) {}
+
+void TypeDeque::print(int indent) {
+  printIndent(indent);
+  std::cout << "TypeDeque()" << std::endl;
+}
+
+Value TypeHeap::accept(ASTVisitor &v) { return v.visit(*this); }
+TypeHeap::TypeHeap(Span s) : ASTNode(s) {}
+
+void TypeHeap::print(int indent) {
+  printIndent(indent);
+  std::cout << "TypeHeap()" << std::endl;
+}
+
+Value TypeSet::accept(ASTVisitor &v) { return v.visit(*this); }
+TypeSet::TypeSet(Span s) : ASTNode(s) {}
+
+void TypeSet::print(int indent) {
+  printIndent(indent);
+  std::cout << "TypeSet()" << std::endl;
+}
+
 Value Variable::accept(ASTVisitor &v) { return v.visit(*this); }
 Variable::Variable(std::string varName, Span s, ASTPtr varValue)
-    : ASTNode(s), name(varName), value(std::move(varValue)) {}
+    : ASTNode(s), name(varName), value(std::move(varValue)),
+      nameId(intern_name(name)) {}
 
 void Variable::print(int indent) {
   printIndent(indent);
@@ -143,8 +177,19 @@ void UnaryOp::print(int indent) {
 }
 
 Value BinaryOp::accept(ASTVisitor &v) { return v.visit(*this); }
+bool reads_only(const ASTNode *node) {
+  return dynamic_cast<const Variable *>(node) ||
+         dynamic_cast<const IntLiteral *>(node) ||
+         dynamic_cast<const FloatLiteral *>(node) ||
+         dynamic_cast<const StrLiteral *>(node) ||
+         dynamic_cast<const BoolLiteral *>(node);
+}
+
 BinaryOp::BinaryOp(TokenType opOp, ASTPtr opLeft, ASTPtr opRight, Span s)
     : ASTNode(s), op(opOp), left(std::move(opLeft)), right(std::move(opRight)) {
+  readsOnly = reads_only(left.get()) && reads_only(right.get());
+  leftVar = dynamic_cast<Variable *>(left.get());
+  rightVar = dynamic_cast<Variable *>(right.get());
 }
 
 void BinaryOp::print(int indent) {
@@ -175,7 +220,28 @@ Value ExpressionStmt::accept(ASTVisitor &v) { return v.visit(*this); }
 ExpressionStmt::ExpressionStmt(ASTPtr stmtExpr, Span s, bool stmtNoOp,
                                bool exprIsBreak, bool exprIsContinue)
     : ASTNode(s), expr(std::move(stmtExpr)), noOp(stmtNoOp),
-      isBreak(exprIsBreak), isContinue(exprIsContinue) {}
+      isBreak(exprIsBreak), isContinue(exprIsContinue) {
+  ASTNode *node = expr.get();
+
+  if (isContinue)
+    kind = StmtKind::Continue;
+  else if (isBreak)
+    kind = StmtKind::Break;
+  else if (noOp)
+    kind = StmtKind::NoOp;
+  else if (dynamic_cast<IfStmt *>(node))
+    kind = StmtKind::If;
+  else if (dynamic_cast<WhileStmt *>(node))
+    kind = StmtKind::While;
+  else if (dynamic_cast<ForStmt *>(node))
+    kind = StmtKind::For;
+  else if (dynamic_cast<ReturnStmt *>(node))
+    kind = StmtKind::Return;
+  else if (dynamic_cast<YieldStmt *>(node))
+    kind = StmtKind::Yield;
+  else
+    kind = StmtKind::Expr;
+}
 
 void ExpressionStmt::print(int indent) {
   printIndent(indent);
@@ -190,10 +256,48 @@ void ExpressionStmt::print(int indent) {
   }
 }
 
+std::unique_ptr<Condition> Condition::compile(ASTNode *node, bool isOperand) {
+  auto cond = std::make_unique<Condition>();
+  cond->expr = node;
+  cond->operand = isOperand;
+
+  if (auto *bin = dynamic_cast<BinaryOp *>(node)) {
+    switch (bin->op) {
+    case TokenType::EQEQ:
+    case TokenType::NOTEQ:
+    case TokenType::LESS:
+    case TokenType::LESSEQ:
+    case TokenType::GREATER:
+    case TokenType::GREATEREQ:
+      cond->kind = Compare;
+      cond->op = bin->op;
+      cond->expr = bin->left.get();
+      cond->rhs = bin->right.get();
+      break;
+    case TokenType::AND:
+    case TokenType::OR:
+      cond->kind = bin->op == TokenType::AND ? And : Or;
+      cond->left = compile(bin->left.get(), true);
+      cond->right = compile(bin->right.get(), true);
+      break;
+    default:
+      break;
+    }
+  } else if (auto *un = dynamic_cast<UnaryOp *>(node)) {
+    if (un->op == TokenType::NOT) {
+      cond->kind = Not;
+      cond->left = compile(un->operand.get());
+    }
+  }
+
+  return cond;
+}
+
 Value IfStmt::accept(ASTVisitor &v) { return v.visit(*this); }
 IfStmt::IfStmt(ASTPtr stmtCondition, std::vector<ExpressionStmt> thenStmts,
                Span s, std::vector<ExpressionStmt> elseStmts)
     : ASTNode(s), condition(std::move(stmtCondition)),
+      test(Condition::compile(condition.get())),
       thenClauseStmts(std::move(thenStmts)),
       elseClauseStmts(std::move(elseStmts)) {}
 
@@ -222,7 +326,7 @@ Value WhileStmt::accept(ASTVisitor &v) { return v.visit(*this); }
 WhileStmt::WhileStmt(ASTPtr stmtCondition,
                      std::vector<ExpressionStmt> stmtStmts, Span s)
     : ASTNode(s), condition(std::move(stmtCondition)),
-      stmts(std::move(stmtStmts)) {}
+      test(Condition::compile(condition.get())), stmts(std::move(stmtStmts)) {}
 
 void WhileStmt::print(int indent) {
   printIndent(indent);
@@ -241,8 +345,8 @@ void WhileStmt::print(int indent) {
 Value ForStmt::accept(ASTVisitor &v) { return v.visit(*this); }
 ForStmt::ForStmt(std::string stmtVar, ASTPtr stmtIter,
                  std::vector<ExpressionStmt> stmtStmts, Span s)
-    : ASTNode(s), var(std::move(stmtVar)), iter(std::move(stmtIter)),
-      stmts(std::move(stmtStmts)) {}
+    : ASTNode(s), var(std::move(stmtVar)), varId(intern_name(var)),
+      iter(std::move(stmtIter)), stmts(std::move(stmtStmts)) {}
 
 void ForStmt::print(int indent) {
   printIndent(indent);
@@ -295,12 +399,59 @@ void ReturnStmt::print(int indent) {
   }
 }
 
+Value YieldStmt::accept(ASTVisitor &v) { return v.visit(*this); }
+YieldStmt::YieldStmt(ASTPtr stmtValue, Span s)
+    : ASTNode(s), value(std::move(stmtValue)) {}
+
+void YieldStmt::print(int indent) {
+  printIndent(indent);
+  std::cout << "YieldStmt()\n";
+
+  if (value) {
+    value->print(indent + 2);
+  } else {
+    printIndent(indent + 2);
+    std::cout << "nullptr\n";
+  }
+}
+
+// whether a yield runs as part of these statements (and not of a nested
+// form)
+static bool contains_yield(const std::vector<ExpressionStmt> &stmts) {
+  for (const ExpressionStmt &stmt : stmts) {
+    switch (stmt.kind) {
+    case StmtKind::Yield:
+      return true;
+    case StmtKind::If: {
+      auto *ifStmt = static_cast<IfStmt *>(stmt.expr.get());
+      if (contains_yield(ifStmt->thenClauseStmts) ||
+          contains_yield(ifStmt->elseClauseStmts))
+        return true;
+      break;
+    }
+    case StmtKind::While:
+      if (contains_yield(static_cast<WhileStmt *>(stmt.expr.get())->stmts))
+        return true;
+      break;
+    case StmtKind::For:
+      if (contains_yield(static_cast<ForStmt *>(stmt.expr.get())->stmts))
+        return true;
+      break;
+    default:
+      break;
+    }
+  }
+
+  return false;
+}
+
 Value FunctionStmt::accept(ASTVisitor &v) { return v.visit(*this); }
 FunctionStmt::FunctionStmt(std::string stmtName, std::vector<ASTPtr> stmtParams,
                            std::vector<ExpressionStmt> stmtStmts, Span s,
                            ASTPtr stmtReturnValue)
     : ASTNode(s), name(stmtName), params(std::move(stmtParams)),
-      stmts(std::move(stmtStmts)), returnValue(std::move(stmtReturnValue)) {}
+      stmts(std::move(stmtStmts)), returnValue(std::move(stmtReturnValue)),
+      isGenerator(contains_yield(stmts)) {}
 
 void FunctionStmt::print(int indent) {
   printIndent(indent);
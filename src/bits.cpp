@@ -0,0 +1,111 @@
+#include "bits.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+inline unsigned popcount64(uint64_t word) {
+#if defined(_MSC_VER)
+  return static_cast<unsigned>(__popcnt64(word));
+#else
+  return static_cast<unsigned>(__builtin_popcountll(word));
+#endif
+}
+
+inline unsigned ctz64(uint64_t word) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, word);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+}
+
+// mask with bits [lo, hi) of a single word set, for 0 <= lo < hi <= 64
+inline uint64_t wordMask(size_t lo, size_t hi) {
+  uint64_t upper = hi == 64 ? ~uint64_t(0) : (uint64_t(1) << hi) - 1;
+  return upper & ~((uint64_t(1) << lo) - 1);
+}
+
+template <bool SetBits>
+void applyRange(std::vector<uint64_t> &words, size_t start, size_t stop,
+                size_t step) {
+  if (start >= stop)
+    return;
+
+  if (step != 1) {
+    for (size_t i = start; i < stop; i += step) {
+      if (SetBits)
+        words[i >> 6] |= uint64_t(1) << (i & 63);
+      else
+        words[i >> 6] &= ~(uint64_t(1) << (i & 63));
+
+      if (stop - i <= step)
+        break;
+    }
+
+    return;
+  }
+
+  size_t first = start >> 6;
+  size_t last = (stop - 1) >> 6;
+
+  for (size_t w = first; w <= last; w++) {
+    size_t lo = w == first ? (start & 63) : 0;
+    size_t hi = w == last ? ((stop - 1) & 63) + 1 : 64;
+    uint64_t mask = wordMask(lo, hi);
+
+    if (SetBits)
+      words[w] |= mask;
+    else
+      words[w] &= ~mask;
+  }
+}
+} // namespace
+
+Bits::Bits(size_t size, bool value)
+    : words((size + 63) / 64, value ? ~uint64_t(0) : 0), nbits(size) {
+  clearTail();
+}
+
+// bits past nbits in the last word are kept clear so that word-level
+// operations like popcount() never have to special-case the tail
+void Bits::clearTail() {
+  if (nbits & 63)
+    words.back() &= (uint64_t(1) << (nbits & 63)) - 1;
+}
+
+void Bits::setRange(size_t start, size_t stop, size_t step) {
+  applyRange<true>(words, start, stop < nbits ? stop : nbits, step);
+}
+
+void Bits::clearRange(size_t start, size_t stop, size_t step) {
+  applyRange<false>(words, start, stop < nbits ? stop : nbits, step);
+}
+
+size_t Bits::popcount() const {
+  size_t count = 0;
+  for (uint64_t word : words)
+    count += popcount64(word);
+  return count;
+}
+
+size_t Bits::findNextSet(size_t from) const {
+  if (from >= nbits)
+    return npos;
+
+  size_t w = from >> 6;
+  uint64_t word = words[w] & ~((uint64_t(1) << (from & 63)) - 1);
+
+  while (true) {
+    if (word != 0)
+      return (w << 6) + ctz64(word);
+
+    if (++w >= words.size())
+      return npos;
+
+    word = words[w];
+  }
+}
@@ -0,0 +1,707 @@
+#include "build.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "args.hpp"
+#include "ast.hpp"
+#include "diagnostics.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+namespace {
+
+struct SourceFile {
+  std::string name;
+  std::string text;
+  ASTPtr program;
+};
+
+// the file as the interpreter reads it, every line ending in '\n'
+bool read_source(const std::string &path, std::string &out) {
+  std::ifstream fileHandle(path);
+  if (!fileHandle.is_open())
+    return false;
+
+  std::string line;
+  while (std::getline(fileHandle, line)) {
+    out += line;
+    out.push_back('\n');
+  }
+  return true;
+}
+
+ASTPtr parse_source(const std::string &text, const std::string &name) {
+  Diagnostics diags;
+
+  Lexer lexer(text, diags, name);
+  lexer.nextChar();
+  lexer.getTokens();
+
+  if (diags.has_errors()) {
+    diags.print_errors();
+    return nullptr;
+  }
+
+  Parser parser(lexer.tokens, diags, name);
+  ASTPtr program = parser.parse_program();
+
+  if (diags.has_errors()) {
+    diags.print_errors();
+    return nullptr;
+  }
+
+  return program;
+}
+
+// what is loaded anywhere in 'stmts': .tent modules and native libraries
+void collect_loads(std::vector<ExpressionStmt> &stmts,
+                   std::vector<std::string> &modules,
+                   std::vector<std::string> &libraries) {
+  for (ExpressionStmt &stmt : stmts) {
+    ASTNode *node = stmt.expr.get();
+
+    if (auto load = dynamic_cast<LoadStmt *>(node)) {
+      if (std::filesystem::path(load->fname).extension() == ".tent")
+        modules.push_back(load->fname);
+      else
+        libraries.push_back(load->fname);
+    } else if (auto ifStmt = dynamic_cast<IfStmt *>(node)) {
+      collect_loads(ifStmt->thenClauseStmts, modules, libraries);
+      collect_loads(ifStmt->elseClauseStmts, modules, libraries);
+    } else if (auto whileStmt = dynamic_cast<WhileStmt *>(node)) {
+      collect_loads(whileStmt->stmts, modules, libraries);
+    } else if (auto forStmt = dynamic_cast<ForStmt *>(node)) {
+      collect_loads(forStmt->stmts, modules, libraries);
+    } else if (auto func = dynamic_cast<FunctionStmt *>(node)) {
+      collect_loads(func->stmts, modules, libraries);
+    } else if (auto cls = dynamic_cast<ClassStmt *>(node)) {
+      collect_loads(cls->stmts, modules, libraries);
+    }
+  }
+}
+
+// the directory a native library is found in, made absolute, or empty
+std::string library_dir(const std::string &name,
+                        const std::vector<std::string> &searchDirs) {
+  for (const std::string &file :
+       {"lib" + name, "lib" + name + ".so", "lib" + name + ".dylib",
+        "lib" + name + ".dll"}) {
+    const auto found = checkSearchPathsFor(file, searchDirs);
+    if (found.has_value())
+      return std::filesystem::absolute(found->first).lexically_normal().string();
+  }
+  return "";
+}
+
+// 'text' as a C++ string literal, a line of the source per line of output
+std::string cpp_string(const std::string &text) {
+  std::string out = "\"";
+
+  for (unsigned char c : text) {
+    if (c == '\n') {
+      out += "\\n\"\n    \"";
+    } else if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back((char)c);
+    } else if (c >= 0x20 && c < 0x7F) {
+      out.push_back((char)c);
+    } else {
+      char escape[5];
+      std::snprintf(escape, sizeof(escape), "\\%03o", c);
+      out += escape;
+    }
+  }
+
+  out.push_back('"');
+  return out;
+}
+
+std::string shell_quote(const std::string &arg) {
+  std::string out = "'";
+  for (char c : arg) {
+    if (c == '\'')
+      out += "'\\''";
+    else
+      out.push_back(c);
+  }
+  out.push_back('\'');
+  return out;
+}
+
+} // namespace
+
+// Translates one form to a C++ function over int64_t, given the same subset
+// and the same rules the JIT compiles a form by (see jit.hpp), for ints only:
+// arithmetic on the form's parameters and locals, if, while, break,
+// continue, return and calls to the form itself. A local may only be read
+// where it has been assigned on every path. Every method returns false,
+// giving up on the form, at the first thing outside that subset.
+//
+// The C++ throws Bail wherever the JIT's code gives up a call (dividing by
+// zero, too deep, or reaching the end of the body), and the interpreter
+// runs the call over again.
+class AotTranslator {
+  FunctionStmt &form;
+  const std::string fnName;
+  std::ostringstream out;
+  int indent = 0;
+  int loopDepth = 0;
+
+  std::unordered_map<uint32_t, std::string> locals;
+  std::vector<std::string> localOrder;
+  std::unordered_set<uint32_t> defined;
+  bool sawReturn = false;
+
+  std::ostream &emit() {
+    for (int i = 0; i < indent; i++)
+      out << "  ";
+    return out;
+  }
+
+  static bool identifier(const std::string &name) {
+    if (name.empty())
+      return false;
+    for (char c : name) {
+      if (!std::isalnum((unsigned char)c) && c != '_')
+        return false;
+    }
+    return true;
+  }
+
+  bool declare(Variable &var) {
+    if (var.value || !identifier(var.name))
+      return false;
+
+    if (!locals.count(var.nameId)) {
+      locals[var.nameId] = "v_" + var.name;
+      localOrder.push_back("v_" + var.name);
+    }
+    return true;
+  }
+
+  bool readable(Variable &var, std::string &name) {
+    auto found = locals.find(var.nameId);
+    if (found == locals.end() || var.value || !defined.count(var.nameId))
+      return false;
+
+    name = found->second;
+    return true;
+  }
+
+  static const char *intOp(TokenType op) {
+    switch (op) {
+    case TokenType::ADD:
+      return "+";
+    case TokenType::SUB:
+      return "-";
+    case TokenType::MUL:
+      return "*";
+    case TokenType::BIT_AND:
+      return "&";
+    case TokenType::BIT_OR:
+      return "|";
+    case TokenType::BIT_XOR:
+      return "^";
+    default:
+      return nullptr;
+    }
+  }
+
+  bool binary(TokenType op, ASTNode *left, ASTNode *right, std::string &code) {
+    std::string l, r;
+    if (!expr(left, l) || !expr(right, r))
+      return false;
+
+    if (op == TokenType::DIV || op == TokenType::FLOOR_DIV) {
+      code = "divide(" + l + ", " + r + ")";
+      return true;
+    }
+
+    if (op == TokenType::MOD) {
+      code = "modulo(" + l + ", " + r + ")";
+      return true;
+    }
+
+    const char *sym = intOp(op);
+    if (sym == nullptr)
+      return false;
+
+    code = "(" + l + " " + sym + " " + r + ")";
+    return true;
+  }
+
+  bool call(FunctionCall &call, std::string &code) {
+    if (call.name != form.name || call.params.size() != form.params.size())
+      return false;
+
+    code = fnName + "(";
+    for (size_t i = 0; i < call.params.size(); i++) {
+      std::string arg;
+      if (!expr(call.params[i].get(), arg))
+        return false;
+      code += (i ? ", " : "") + arg;
+    }
+    code += ")";
+
+    recursive = true;
+    return true;
+  }
+
+  bool expr(ASTNode *node, std::string &code) {
+    if (auto lit = dynamic_cast<IntLiteral *>(node)) {
+      code = "int64_t(" + std::to_string(lit->value) + ")";
+      return true;
+    }
+
+    if (auto var = dynamic_cast<Variable *>(node))
+      return readable(*var, code);
+
+    if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      std::string operand;
+      if (!expr(un->operand.get(), operand))
+        return false;
+
+      if (un->op == TokenType::NEGATE)
+        code = "(-" + operand + ")";
+      else if (un->op == TokenType::BIT_NOT)
+        code = "(~" + operand + ")";
+      else
+        return false;
+      return true;
+    }
+
+    if (auto bin = dynamic_cast<BinaryOp *>(node))
+      return binary(bin->op, bin->left.get(), bin->right.get(), code);
+
+    if (auto fc = dynamic_cast<FunctionCall *>(node))
+      return call(*fc, code);
+
+    return false;
+  }
+
+  static const char *compareOp(TokenType op) {
+    switch (op) {
+    case TokenType::EQEQ:
+      return "==";
+    case TokenType::NOTEQ:
+      return "!=";
+    case TokenType::LESS:
+      return "<";
+    case TokenType::LESSEQ:
+      return "<=";
+    case TokenType::GREATER:
+      return ">";
+    case TokenType::GREATEREQ:
+      return ">=";
+    default:
+      return nullptr;
+    }
+  }
+
+  bool condition(const Condition &cond, std::string &code) {
+    std::string l, r;
+
+    switch (cond.kind) {
+    case Condition::Compare: {
+      const char *sym = compareOp(cond.op);
+      if (sym == nullptr || !expr(cond.expr, l) || !expr(cond.rhs, r))
+        return false;
+      code = "(" + l + " " + sym + " " + r + ")";
+      return true;
+    }
+    case Condition::Not:
+      if (!condition(*cond.left, l))
+        return false;
+      code = "(!" + l + ")";
+      return true;
+    case Condition::And:
+    case Condition::Or:
+      if (!condition(*cond.left, l) || !condition(*cond.right, r))
+        return false;
+      code = "(" + l + (cond.kind == Condition::And ? " && " : " || ") + r +
+             ")";
+      return true;
+    case Condition::Expr:
+      break;
+    }
+
+    return false;
+  }
+
+  bool assign(Variable &var, const std::string &value) {
+    if (!declare(var))
+      return false;
+
+    emit() << locals[var.nameId] << " = " << value << ";\n";
+    defined.insert(var.nameId);
+    return true;
+  }
+
+  bool exprStmt(ASTNode *node) {
+    if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      auto var = dynamic_cast<Variable *>(un->operand.get());
+      std::string name;
+      if (var == nullptr || !readable(*var, name))
+        return false;
+
+      if (un->op == TokenType::INCREMENT)
+        emit() << name << "++;\n";
+      else if (un->op == TokenType::DECREMENT)
+        emit() << name << "--;\n";
+      else
+        return false;
+      return true;
+    }
+
+    auto bin = dynamic_cast<BinaryOp *>(node);
+    auto var = bin ? dynamic_cast<Variable *>(bin->left.get()) : nullptr;
+    if (var == nullptr)
+      return false;
+
+    std::string value;
+    if (bin->op == TokenType::ASSIGN)
+      return expr(bin->right.get(), value) && assign(*var, value);
+
+    TokenType op;
+    return getCompoundAssignOp(bin->op, op) &&
+           binary(op, var, bin->right.get(), value) && assign(*var, value);
+  }
+
+  bool ifStmt(IfStmt &node) {
+    std::string test;
+    if (!condition(*node.test, test))
+      return false;
+
+    std::unordered_set<uint32_t> before = defined;
+    emit() << "if " << test << " {\n";
+    if (!block(node.thenClauseStmts))
+      return false;
+    defined = before;
+
+    if (!node.elseClauseStmts.empty()) {
+      emit() << "} else {\n";
+      if (!block(node.elseClauseStmts))
+        return false;
+      defined = before;
+    }
+
+    emit() << "}\n";
+    return true;
+  }
+
+  bool whileStmt(WhileStmt &node) {
+    std::string test;
+    if (!condition(*node.test, test))
+      return false;
+
+    std::unordered_set<uint32_t> before = defined;
+    emit() << "while " << test << " {\n";
+    loopDepth++;
+    if (!block(node.stmts))
+      return false;
+    loopDepth--;
+    defined = before;
+
+    emit() << "}\n";
+    return true;
+  }
+
+  bool stmt(ExpressionStmt &stmt) {
+    switch (stmt.kind) {
+    case StmtKind::NoOp:
+      return true;
+    case StmtKind::Break:
+    case StmtKind::Continue:
+      if (loopDepth == 0)
+        return false;
+      emit() << (stmt.kind == StmtKind::Break ? "break;\n" : "continue;\n");
+      return true;
+    case StmtKind::If:
+      return ifStmt(static_cast<IfStmt &>(*stmt.expr));
+    case StmtKind::While:
+      return whileStmt(static_cast<WhileStmt &>(*stmt.expr));
+    case StmtKind::Return: {
+      auto &ret = static_cast<ReturnStmt &>(*stmt.expr);
+      std::string value;
+      if (!ret.value || !expr(ret.value.get(), value))
+        return false;
+      emit() << "return " << value << ";\n";
+      sawReturn = true;
+      return true;
+    }
+    case StmtKind::Expr:
+    case StmtKind::Fused:
+      return exprStmt(stmt.expr.get());
+    default:
+      return false;
+    }
+  }
+
+  bool block(std::vector<ExpressionStmt> &stmts) {
+    indent++;
+    for (ExpressionStmt &s : stmts) {
+      if (!stmt(s))
+        return false;
+    }
+    indent--;
+    return true;
+  }
+
+public:
+  bool recursive = false;
+
+  AotTranslator(FunctionStmt &func, std::string name)
+      : form(func), fnName(std::move(name)) {}
+
+  // where the form's definition starts
+  size_t lineNum() const { return form.span.getLineNum(); }
+  size_t column() const { return form.span.getStartCol(); }
+
+  // the C++ definition of the form, or false if it cannot be translated
+  bool translate(std::string &code) {
+    if (form.isGenerator || form.memo)
+      return false;
+
+    std::vector<std::string> params;
+    for (ASTPtr &param : form.params) {
+      auto var = dynamic_cast<Variable *>(param.get());
+      if (var == nullptr || !declare(*var))
+        return false;
+      defined.insert(var->nameId);
+      params.push_back(locals[var->nameId]);
+    }
+
+    if (!block(form.stmts) || !sawReturn)
+      return false;
+
+    std::ostringstream def;
+    def << "int64_t " << fnName << "(";
+    for (size_t i = 0; i < params.size(); i++)
+      def << (i ? ", " : "") << "int64_t " << params[i];
+    def << ") {\n  Frame frame;\n";
+    for (size_t i = params.size(); i < localOrder.size(); i++)
+      def << "  int64_t " << localOrder[i] << " = 0;\n";
+    def << out.str() << "  throw Bail();\n}\n";
+
+    code = def.str();
+    return true;
+  }
+};
+
+int build_program(const std::string &sourceFile, const std::string &output,
+                  const std::vector<std::string> &searchDirs) {
+  std::vector<SourceFile> files(1);
+  files[0].name = sourceFile;
+
+  if (!read_source(sourceFile, files[0].text)) {
+    std::cerr << "File error: could not open file '" << sourceFile << "'."
+              << std::endl;
+    return 1;
+  }
+
+  // the main file, then every module it loads, directly or not; modules
+  // are embedded under the name they are loaded by, which is how the
+  // interpreter finds them again
+  std::unordered_set<std::string> seen;
+  // where the native libraries it loads were found, searched first when the
+  // executable runs
+  std::vector<std::string> libraryDirs;
+  for (size_t i = 0; i < files.size(); i++) {
+    files[i].program = parse_source(files[i].text, files[i].name);
+    if (!files[i].program)
+      return 1;
+
+    std::vector<std::string> loads, libraries;
+    collect_loads(static_cast<Program &>(*files[i].program).statements, loads,
+                  libraries);
+
+    for (const std::string &name : libraries) {
+      const std::string dir = library_dir(name, searchDirs);
+      if (!dir.empty() && std::find(libraryDirs.begin(), libraryDirs.end(),
+                                    dir) == libraryDirs.end())
+        libraryDirs.push_back(dir);
+    }
+
+    for (const std::string &name : loads) {
+      if (!seen.insert(name).second)
+        continue;
+
+      const auto found = checkSearchPathsFor(name, searchDirs);
+      SourceFile module;
+      module.name = name;
+      if (!found.has_value() ||
+          !read_source(found->first + "/" + found->second, module.text)) {
+        std::cerr << "File error: could not find file '" << name << "'"
+                  << std::endl;
+        return 1;
+      }
+      files.push_back(std::move(module));
+    }
+  }
+
+  std::ostringstream cpp;
+  cpp << "// Generated by `tent build` from " << sourceFile
+      << "; do not edit.\n"
+      << "#include \"driver.hpp\"\n\n"
+      << "#include <cstdint>\n\n"
+      << "namespace {\n\n"
+      << "struct Bail {};\n\n"
+      << "int64_t depth = 0;\n"
+      << "int64_t depthLimit = 0;\n\n"
+      << "struct Frame {\n"
+      << "  Frame() {\n"
+      << "    if (++depth > depthLimit)\n"
+      << "      throw Bail();\n"
+      << "  }\n"
+      << "  ~Frame() { depth--; }\n"
+      << "};\n\n"
+      << "int64_t divide(int64_t a, int64_t b) {\n"
+      << "  if (b == 0 || (b == -1 && a == INT64_MIN))\n"
+      << "    throw Bail();\n"
+      << "  return a / b;\n"
+      << "}\n\n"
+      << "int64_t modulo(int64_t a, int64_t b) {\n"
+      << "  if (b == 0 || (b == -1 && a == INT64_MIN))\n"
+      << "    throw Bail();\n"
+      << "  return a % b;\n"
+      << "}\n";
+
+  std::ostringstream table;
+  size_t translated = 0, formCount = 0;
+
+  for (size_t f = 0; f < files.size(); f++) {
+    for (ExpressionStmt &stmt :
+         static_cast<Program &>(*files[f].program).statements) {
+      auto func = dynamic_cast<FunctionStmt *>(stmt.expr.get());
+      if (func == nullptr)
+        continue;
+      formCount++;
+
+      const std::string id = std::to_string(translated);
+      AotTranslator translator(*func, "form" + id);
+      std::string code;
+      if (!translator.translate(code))
+        continue;
+
+      cpp << "\n// form " << func->name << ", " << files[f].name << ":"
+          << translator.lineNum() << "\n"
+          << code << "\n"
+          << "bool run" << id
+          << "(const int64_t *args, int64_t limit, int64_t &result) {\n"
+          << "  depth = 0;\n"
+          << "  depthLimit = limit;\n"
+          << "  try {\n"
+          << "    result = form" << id << "(";
+      for (size_t i = 0; i < func->params.size(); i++)
+        cpp << (i ? ", " : "") << "args[" << i << "]";
+      cpp << ");\n"
+          << "    return true;\n"
+          << "  } catch (const Bail &) {\n"
+          << "    return false;\n"
+          << "  }\n"
+          << "}\n";
+
+      table << "    {" << cpp_string(files[f].name) << ", "
+            << translator.lineNum() << ", " << translator.column() << ", "
+            << func->params.size() << ", "
+            << (translator.recursive ? "true" : "false") << ", run" << id
+            << "},\n";
+      translated++;
+    }
+  }
+
+  for (size_t f = 0; f < files.size(); f++)
+    cpp << "\nconst char source" << f << "[] =\n    "
+        << cpp_string(files[f].text) << ";\n";
+
+  if (files.size() > 1) {
+    cpp << "\nconst EmbeddedSource modules[] = {\n";
+    for (size_t f = 1; f < files.size(); f++)
+      cpp << "    {" << cpp_string(files[f].name) << ", source" << f
+          << "},\n";
+    cpp << "};\n";
+  }
+
+  if (translated > 0)
+    cpp << "\nconst PrecompiledForm forms[] = {\n" << table.str() << "};\n";
+
+  if (!libraryDirs.empty()) {
+    cpp << "\nconst char *const libraryDirs[] = {\n";
+    for (const std::string &dir : libraryDirs)
+      cpp << "    " << cpp_string(dir) << ",\n";
+    cpp << "};\n";
+  }
+
+  cpp << "\n} // namespace\n\n"
+      << "int main(int argc, char **argv) {\n"
+      << "  const EmbeddedProgram program{\n"
+      << "      {" << cpp_string(sourceFile) << ", source0},\n"
+      << "      " << (files.size() > 1 ? "modules" : "nullptr") << ",\n"
+      << "      " << files.size() - 1 << ",\n"
+      << "      " << (translated > 0 ? "forms" : "nullptr") << ",\n"
+      << "      " << translated << ",\n"
+      << "      " << (libraryDirs.empty() ? "nullptr" : "libraryDirs") << ",\n"
+      << "      " << libraryDirs.size() << "};\n"
+      << "  return tent_main_embedded(argc, argv, program);\n"
+      << "}\n";
+
+  // the runtime of this build of tent, else an installed one
+  std::string runtimeLib = TENT_RUNTIME_LIB, includeDir = TENT_INCLUDE_DIR;
+  if (!std::filesystem::exists(runtimeLib)) {
+    runtimeLib = std::string(TENT_INSTALL_PREFIX) + "/lib/tent/" +
+                 std::filesystem::path(runtimeLib).filename().string();
+    includeDir = std::string(TENT_INSTALL_PREFIX) + "/include/tent";
+  }
+
+  if (!std::filesystem::exists(runtimeLib)) {
+    std::cerr << "Build error: could not find the tent runtime library '"
+              << runtimeLib << "'" << std::endl;
+    return 1;
+  }
+
+  const std::string cppFile = output + ".cpp";
+  {
+    std::ofstream cppHandle(cppFile);
+    cppHandle << cpp.str();
+    if (!cppHandle) {
+      std::cerr << "File error: could not write file '" << cppFile << "'."
+                << std::endl;
+      return 1;
+    }
+  }
+
+  const char *cxx = std::getenv("CXX");
+  const std::string command =
+      shell_quote(cxx != nullptr && *cxx != '\0' ? cxx : TENT_CXX) +
+      " -std=c++17 -O2 -fwrapv -I" + shell_quote(includeDir) + " " +
+      shell_quote(cppFile) + " " + shell_quote(runtimeLib) +
+      " -pthread -ldl -rdynamic -o " + shell_quote(output);
+
+  if (IS_FLAG_SET(DEBUG))
+    std::cerr << "translated " << translated << " of " << formCount
+              << " forms to C++\n"
+              << command << "\n";
+
+  const int status = std::system(command.c_str());
+
+  // -d keeps the generated C++ around to look at
+  if (!IS_FLAG_SET(DEBUG))
+    std::filesystem::remove(cppFile);
+
+  if (status != 0) {
+    std::cerr << "Build error: the C++ compiler failed on '" << sourceFile
+              << "'" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,184 @@
+#include "closure.hpp"
+
+#include <vector>
+
+#include "ast.hpp"
+#include "evaluator.hpp"
+
+class ClosureCompiler {
+  std::deque<Closure> &closures;
+
+  static Value literal(Evaluator &, const Closure &c) { return c.imm; }
+
+  static Value variable(Evaluator &ev, const Closure &c) {
+    if (Value *found = ev.lookupVariable(*c.var))
+      return *found;
+    return ev.visit(*c.var); // reports it undefined
+  }
+
+  static Value unary(Evaluator &ev, const Closure &c) {
+    return ev.evalUnaryOp(c.lhs->run(ev, *c.lhs).setSpan(c.operandSpan), c.op)
+        .setSpan(c.span);
+  }
+
+  static Value binary(Evaluator &ev, const Closure &c) {
+    Value left = c.lhs->run(ev, *c.lhs);
+    Value right = c.rhs->run(ev, *c.rhs);
+    return ev.evalBinaryOp(left, right, c.op);
+  }
+
+  // `v@i` reads the element straight out of v's storage, as visit() does
+  static Value indexVariable(Evaluator &ev, const Closure &c) {
+    Value index = c.rhs->run(ev, *c.rhs);
+    if (Value *holder = ev.lookupVariable(*c.var))
+      return ev.evalBinaryOp(*holder, index, TokenType::INDEX);
+    return ev.evalBinaryOp(ev.visit(*c.var), index, TokenType::INDEX);
+  }
+
+  static Value generic(Evaluator &ev, const Closure &c) {
+    return c.node->accept(ev);
+  }
+
+  Closure &make(Closure::Fn run, ASTNode *node) {
+    Closure &closure = closures.emplace_back();
+    closure.run = run;
+    closure.node = node;
+    closure.span = node->span;
+    node->compiled = &closure;
+    return closure;
+  }
+
+  // what a compiled node calls for an operand without a closure of its own
+  const Closure *operand(ASTNode *node, const Closure *compiled) {
+    if (compiled != nullptr)
+      return compiled;
+
+    Closure &closure = closures.emplace_back();
+    closure.run = generic;
+    closure.node = node;
+    return &closure;
+  }
+
+  // the operators visit(BinaryOp) evaluates as just left, right, operator
+  static bool plain(const BinaryOp &bin) {
+    return bin.staticType == StaticType::Unknown && bin.cache == nullptr &&
+           bin.op != TokenType::AND && bin.op != TokenType::OR &&
+           bin.op != TokenType::DOT && !isRightAssoc(bin.op);
+  }
+
+  void compileAll(std::vector<ASTPtr> &nodes) {
+    for (ASTPtr &node : nodes)
+      compile(node.get());
+  }
+
+  void compileAll(std::vector<ExpressionStmt> &stmts) {
+    for (ExpressionStmt &stmt : stmts)
+      compile(stmt.expr.get());
+  }
+
+public:
+  explicit ClosureCompiler(std::deque<Closure> &arena) : closures(arena) {}
+
+  // The closure of 'node', or null when it has none of its own; compiles
+  // everything under it either way.
+  const Closure *compile(ASTNode *node) {
+    if (node == nullptr)
+      return nullptr;
+
+    if (auto lit = dynamic_cast<IntLiteral *>(node)) {
+      Closure &closure = make(literal, node);
+      closure.imm = Value(lit->value).setSpan(lit->span);
+      return &closure;
+    }
+    if (auto lit = dynamic_cast<FloatLiteral *>(node)) {
+      Closure &closure = make(literal, node);
+      closure.imm = Value(lit->value).setSpan(lit->span);
+      return &closure;
+    }
+    if (auto lit = dynamic_cast<StrLiteral *>(node)) {
+      Closure &closure = make(literal, node);
+      closure.imm = Value(lit->value).setSpan(lit->span);
+      return &closure;
+    }
+    if (auto lit = dynamic_cast<BoolLiteral *>(node)) {
+      Closure &closure = make(literal, node);
+      closure.imm = Value(lit->value).setSpan(lit->span);
+      return &closure;
+    }
+
+    if (auto var = dynamic_cast<Variable *>(node)) {
+      make(variable, node).var = var;
+      return node->compiled;
+    }
+
+    if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      const Closure *inner = compile(un->operand.get());
+      if (un->staticType != StaticType::Unknown ||
+          un->op == TokenType::INCREMENT || un->op == TokenType::DECREMENT)
+        return nullptr;
+
+      Closure &closure = make(unary, node);
+      closure.lhs = operand(un->operand.get(), inner);
+      closure.op = un->op;
+      closure.operandSpan = un->operand->span;
+      return &closure;
+    }
+
+    if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+      const Closure *left = compile(bin->left.get());
+      const Closure *right = compile(bin->right.get());
+      if (!plain(*bin))
+        return nullptr;
+
+      auto var = dynamic_cast<Variable *>(bin->left.get());
+      Closure &closure =
+          make(bin->op == TokenType::INDEX && var ? indexVariable : binary,
+               node);
+      closure.lhs = operand(bin->left.get(), left);
+      closure.rhs = operand(bin->right.get(), right);
+      closure.var = var;
+      closure.op = bin->op;
+      return &closure;
+    }
+
+    // no closure of its own, but maybe expressions that have one
+    if (auto call = dynamic_cast<FunctionCall *>(node)) {
+      compileAll(call->params);
+    } else if (auto vec = dynamic_cast<VecLiteral *>(node)) {
+      compileAll(vec->elems);
+    } else if (auto dic = dynamic_cast<DicLiteral *>(node)) {
+      for (auto &[key, value] : dic->dic) {
+        compile(key.get());
+        compile(value.get());
+      }
+    } else if (auto ifStmt = dynamic_cast<IfStmt *>(node)) {
+      compile(ifStmt->condition.get());
+      compileAll(ifStmt->thenClauseStmts);
+      compileAll(ifStmt->elseClauseStmts);
+    } else if (auto whileStmt = dynamic_cast<WhileStmt *>(node)) {
+      compile(whileStmt->condition.get());
+      compileAll(whileStmt->stmts);
+    } else if (auto forStmt = dynamic_cast<ForStmt *>(node)) {
+      compile(forStmt->iter.get());
+      compileAll(forStmt->stmts);
+    } else if (auto ret = dynamic_cast<ReturnStmt *>(node)) {
+      compile(ret->value.get());
+    } else if (auto yield = dynamic_cast<YieldStmt *>(node)) {
+      compile(yield->value.get());
+    } else if (auto func = dynamic_cast<FunctionStmt *>(node)) {
+      compileAll(func->stmts);
+    } else if (auto cls = dynamic_cast<ClassStmt *>(node)) {
+      compileAll(cls->stmts);
+    } else if (auto stmt = dynamic_cast<ExpressionStmt *>(node)) {
+      compile(stmt->expr.get());
+    }
+
+    return nullptr;
+  }
+
+  void compile(Program &program) { compileAll(program.statements); }
+};
+
+void compile_closures(Program &program, std::deque<Closure> &closures) {
+  ClosureCompiler(closures).compile(program);
+}
@@ -0,0 +1,193 @@
+#include "containers.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <variant>
+
+#include "sort.hpp"
+
+// ValueDeque
+
+void ValueDeque::grow() {
+  std::vector<Value> bigger(ring.empty() ? 8 : ring.size() * 2);
+  for (size_t i = 0; i < count; i++)
+    bigger[i] = std::move(ring[slot(i)]);
+
+  ring.swap(bigger);
+  head = 0;
+}
+
+void ValueDeque::pushBack(Value value) {
+  if (count == ring.size())
+    grow();
+
+  ring[slot(count)] = std::move(value);
+  count++;
+}
+
+void ValueDeque::pushFront(Value value) {
+  if (count == ring.size())
+    grow();
+
+  head = (head + ring.size() - 1) & (ring.size() - 1);
+  ring[head] = std::move(value);
+  count++;
+}
+
+Value ValueDeque::popBack() {
+  Value out = std::move(ring[slot(count - 1)]);
+  ring[slot(count - 1)] = Value();
+  count--;
+  return out;
+}
+
+Value ValueDeque::popFront() {
+  Value out = std::move(ring[head]);
+  ring[head] = Value();
+  head = slot(1);
+  count--;
+  return out;
+}
+
+// ValueHeap
+
+namespace {
+// std::*_heap builds a max-heap on 'less', so a min-heap inverts it
+struct HeapOrder {
+  bool isMax;
+
+  bool operator()(const ValueHeap::Entry &a, const ValueHeap::Entry &b) const {
+    int cmp = compare_values(a.key, b.key);
+    return isMax ? cmp < 0 : cmp > 0;
+  }
+};
+} // namespace
+
+void ValueHeap::push(Value key, Value item) {
+  entries.push_back(Entry{std::move(key), std::move(item)});
+  std::push_heap(entries.begin(), entries.end(), HeapOrder{isMax});
+}
+
+ValueHeap::Entry ValueHeap::pop() {
+  std::pop_heap(entries.begin(), entries.end(), HeapOrder{isMax});
+  Entry out = std::move(entries.back());
+  entries.pop_back();
+  return out;
+}
+
+// ValueSet
+
+size_t hash_orderable_val(const Value &val) {
+  if (auto s = std::get_if<std::string>(&val.v))
+    return std::hash<std::string>()(*s);
+
+  tn_dec_t number;
+  if (auto i = std::get_if<tn_int_t>(&val.v))
+    return std::hash<tn_int_t>()(*i);
+  else if (auto b = std::get_if<tn_bool_t>(&val.v))
+    return std::hash<tn_int_t>()(*b ? 1 : 0);
+  else
+    number = std::get<tn_dec_t>(val.v);
+
+  // every NaN compares equal to every other
+  if (std::isnan(number))
+    return std::hash<uint64_t>()(0x7ff8000000000000ull);
+
+  // floats holding a whole number must land on the same hash as the int
+  if (std::trunc(number) == number && std::fabs(number) < 9.2e18)
+    return std::hash<tn_int_t>()((tn_int_t)number);
+
+  uint64_t bits;
+  std::memcpy(&bits, &number, sizeof(bits));
+  return std::hash<uint64_t>()(bits);
+}
+
+size_t ValueSet::find(const Value &val) const {
+  const size_t mask = slots.size() - 1;
+  size_t i = hash_orderable_val(val) & mask;
+
+  while (states[i] != EMPTY) {
+    if (states[i] == FULL && compare_values(slots[i], val) == 0)
+      return i;
+    i = (i + 1) & mask;
+  }
+
+  return slots.size();
+}
+
+void ValueSet::rehash(size_t capacity) {
+  std::vector<Value> oldSlots(capacity);
+  std::vector<uint8_t> oldStates(capacity, EMPTY);
+  oldSlots.swap(slots);
+  oldStates.swap(states);
+  count = used = 0;
+
+  for (size_t i = 0; i < oldSlots.size(); i++) {
+    if (oldStates[i] == FULL)
+      insert(oldSlots[i]);
+  }
+}
+
+bool ValueSet::contains(const Value &val) const {
+  return !slots.empty() && find(val) != slots.size();
+}
+
+bool ValueSet::insert(const Value &val) {
+  // keep the load (including tombstones) under 3/4
+  if ((used + 1) * 4 > slots.size() * 3)
+    rehash(slots.empty() ? 16 : (count + 1) * 4 > slots.size() * 2
+                                     ? slots.size() * 2
+                                     : slots.size());
+
+  const size_t mask = slots.size() - 1;
+  size_t i = hash_orderable_val(val) & mask;
+  size_t firstDeleted = slots.size();
+
+  while (states[i] != EMPTY) {
+    if (states[i] == FULL && compare_values(slots[i], val) == 0)
+      return false;
+    if (states[i] == DELETED && firstDeleted == slots.size())
+      firstDeleted = i;
+    i = (i + 1) & mask;
+  }
+
+  if (firstDeleted != slots.size()) {
+    i = firstDeleted;
+  } else {
+    used++;
+  }
+
+  slots[i] = val;
+  states[i] = FULL;
+  count++;
+  return true;
+}
+
+bool ValueSet::erase(const Value &val) {
+  if (slots.empty())
+    return false;
+
+  size_t i = find(val);
+  if (i == slots.size())
+    return false;
+
+  slots[i] = Value();
+  states[i] = DELETED;
+  count--;
+  return true;
+}
+
+std::vector<Value> ValueSet::values() const {
+  std::vector<Value> out;
+  out.reserve(count);
+
+  for (size_t i = 0; i < slots.size(); i++) {
+    if (states[i] == FULL)
+      out.push_back(slots[i]);
+  }
+
+  return out;
+}
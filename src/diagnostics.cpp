@@ -24,6 +24,12 @@ std::string Diagnostics::format(const Error &err) const {
   if (!err.traceback.empty()) {
     out << CYAN << "Traceback (most recent call last):" << RESET << "\n";
     for (const TracebackFrame &frame : err.traceback) {
+      // frames elided from a deep traceback leave a location-less marker
+      if (frame.filename.empty() && frame.span.getLineNum() == 0) {
+        out << GRAY << "  " << frame.label << RESET << "\n";
+        continue;
+      }
+
       out << GRAY << "  --> ";
       if (!frame.filename.empty()) {
         out << frame.filename;
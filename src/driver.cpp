@@ -0,0 +1,236 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#define TENT_MAIN_CPP_FILE
+#include "args.hpp"
+#include "build.hpp"
+#include "diagnostics.hpp"
+#include "driver.hpp"
+#include "errors.hpp"
+#include "evaluator.hpp"
+#include "lexer.hpp"
+#include "native_stack.hpp"
+#include "parser.hpp"
+
+uint64_t runtime_flags = 0;
+uint64_t max_call_depth = DEFAULT_MAX_CALL_DEPTH;
+uint64_t gc_threshold = DEFAULT_GC_THRESHOLD;
+
+// Native stack to reserve per tent call (evaluating the call, its body and
+// the expressions in between); about 2 KB in practice for a plain call site.
+// Call sites nested deeper take more, so the evaluator also checks the stack
+// it has left before every call.
+constexpr size_t STACK_BYTES_PER_CALL = 4096;
+
+// native stack for the evaluator thread: enough for max_call_depth calls
+static size_t evaluator_stack_size() {
+  const size_t maxBytes = sizeof(void *) >= 8 ? (size_t(1) << 40)
+                                              : (size_t(1) << 30);
+  const uint64_t wanted = max_call_depth * STACK_BYTES_PER_CALL;
+
+  return (size_t)std::min<uint64_t>(wanted, maxBytes) + (size_t(64) << 20);
+}
+
+std::string SRC_FILENAME, PROG_NAME, BUILD_OUTPUT;
+std::vector<std::string> prog_args, search_dirs;
+
+void start_repl(const std::vector<std::string> &search_dirs) {
+  std::cout << BOLD << CYAN << "Tent Interactive REPL\n"
+            << GRAY << "Type 'exit' or press Ctrl+C to quit.\n\n"
+            << RESET;
+
+  std::string buffer;
+  int openBraces = 0, openParens = 0;
+
+  while (true) {
+    std::string line;
+
+    if (!std::getline(std::cin, line)) {
+      std::cout << "\n" << GRAY << "Exiting REPL..." << RESET << std::endl;
+      break;
+    }
+
+    if (line == "exit") {
+      break;
+    }
+
+    buffer += line + "\n";
+
+    openBraces = openParens = 0;
+
+    for (char c : buffer) {
+      if (c == '{')
+        openBraces++;
+      if (c == '}')
+        openBraces--;
+      if (c == '(')
+        openParens++;
+      if (c == ')')
+        openParens--;
+    }
+
+    if (openBraces > 0 || openParens > 0)
+      continue;
+
+    Diagnostics diags;
+
+    try {
+      Lexer lexer(buffer, diags);
+      lexer.nextChar();
+      lexer.getTokens();
+
+      if (diags.has_errors()) {
+        diags.print_errors();
+        buffer.clear();
+        continue;
+      }
+
+      Parser parser(lexer.tokens, diags, "<stdin>");
+      ASTPtr program = parser.parse_program();
+
+      if (diags.has_errors()) {
+        diags.print_errors();
+        buffer.clear();
+        continue;
+      }
+
+      Evaluator evaluator(buffer, diags, "<stdin>", search_dirs);
+      evaluator.evalProgram(std::move(program), {});
+
+      if (diags.has_errors()) {
+        diags.print_errors();
+        buffer.clear();
+        continue;
+      }
+    } catch (const std::exception &e) {
+      if (!diags.has_errors()) {
+        diags.report<RuntimeError>(e.what(), Span(), "", "<stdin>");
+      }
+      diags.print_errors();
+    }
+
+    buffer.clear();
+  }
+}
+
+// Lexes, parses and runs 'source' as the main program 'name', with the
+// .tent modules of 'embedded' (if any) standing in for files on disk.
+static int32_t run_source(const std::string &source, const std::string &name,
+                          const EmbeddedProgram *embedded) {
+  ASTPtr program = nullptr;
+
+  Diagnostics diags;
+
+  Lexer lexer(source, diags, name);
+
+  lexer.nextChar();
+  lexer.getTokens();
+
+  if (diags.has_errors()) {
+    diags.print_errors();
+    return 1;
+  }
+
+  Parser parser(lexer.tokens, diags, name);
+  program = parser.parse_program();
+
+  if (diags.has_errors()) {
+    diags.print_errors();
+    return 1;
+  }
+
+  if (IS_FLAG_SET(DEBUG))
+    program->print(0);
+
+  if (!IS_FLAG_SET(DRY_RUN)) {
+    // tent calls recurse on the native stack, so the program runs on a
+    // thread with room for max_call_depth of them instead of the default
+    // few MB; going deeper than that is a RuntimeError, not a crash
+    int status = run_on_large_stack(evaluator_stack_size(), [&]() {
+      try {
+        Evaluator evaluator(source, diags, name, search_dirs);
+        if (embedded != nullptr) {
+          for (size_t i = 0; i < embedded->moduleCount; i++)
+            evaluator.embedModule(embedded->modules[i].name,
+                                  embedded->modules[i].text);
+        }
+
+        evaluator.evalProgram(std::move(program), prog_args);
+
+        if (IS_FLAG_SET(STATS))
+          evaluator.printStats(std::cerr);
+      } catch (const std::exception &e) {
+        if (!diags.has_errors()) {
+          diags.report<RuntimeError>(e.what(), Span(), "", name);
+        }
+        diags.print_errors();
+        return 1;
+      }
+
+      return 0;
+    });
+
+    if (status != 0)
+      return status;
+  }
+
+  if (diags.has_errors()) {
+    diags.print_errors();
+    return 1;
+  }
+
+  return 0;
+}
+
+int32_t tent_main(int32_t argc, char **argv) {
+  parseArgs(argc, argv);
+
+  if (IS_FLAG_SET(REPL)) {
+    return run_on_large_stack(evaluator_stack_size(), []() {
+      start_repl(search_dirs);
+      return 0;
+    });
+  }
+
+  if (IS_FLAG_SET(BUILD)) {
+    if (BUILD_OUTPUT.empty())
+      BUILD_OUTPUT = std::filesystem::path(SRC_FILENAME).stem().string();
+    return build_program(SRC_FILENAME, BUILD_OUTPUT, search_dirs);
+  }
+
+  std::ifstream fileHandle(SRC_FILENAME);
+
+  if (!fileHandle.is_open()) {
+    std::cerr << "File error: could not open file '" << SRC_FILENAME << "'."
+              << std::endl;
+    return 1;
+  }
+
+  std::string output;
+  std::string line;
+
+  while (std::getline(fileHandle, line)) {
+    output += line;
+    output.push_back('\n');
+  }
+
+  fileHandle.close();
+
+  return run_source(output, SRC_FILENAME, nullptr);
+}
+
+int32_t tent_main_embedded(int32_t argc, char **argv,
+                           const EmbeddedProgram &program) {
+  parseEmbeddedArgs(argc, argv);
+  search_dirs.insert(search_dirs.begin(), program.libraryDirs,
+                     program.libraryDirs + program.libraryDirCount);
+  SRC_FILENAME = program.main.name;
+  jit_add_precompiled(program.forms, program.formCount);
+
+  return run_source(program.main.text, SRC_FILENAME, &program);
+}
@@ -1,20 +1,32 @@
 #include "evaluator.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <exception>
 #include <filesystem>
 #include <fstream>
 #include <string>
+#include <utility>
 #include <variant>
 
 #include "args.hpp"
 #include "ast.hpp"
+#include "containers.hpp"
 #include "errors.hpp"
+#include "gc.hpp"
+#include "hoist.hpp"
+#include "infer.hpp"
+#include "iterators.hpp"
 #include "lexer.hpp"
+#include "names.hpp"
 #include "native.hpp"
+#include "native_stack.hpp"
 #include "opcodes.hpp"
+#include "optimizer.hpp"
 #include "parser.hpp"
 #include "types.hpp"
 
@@ -27,30 +39,62 @@
 std::vector<std::string> nativeLibs;
 
 namespace {
+// Owns the slots of one call from the moment its arguments start being
+// evaluated (in the caller's scope) until the call returns.
 class ScopedCallFrame {
-  std::vector<CallFrame> &stack;
+  FrameStack &stack;
+  size_t base;
+  bool entered = false;
 
 public:
-  ScopedCallFrame(std::vector<CallFrame> &callStack, CallFrame frame)
-      : stack(callStack) {
-    stack.push_back(std::move(frame));
+  ScopedCallFrame(FrameStack &callStack)
+      : stack(callStack), base(callStack.slotTop()) {}
+
+  size_t slotBase() const { return base; }
+
+  void enter(CallFrame frame) {
+    frame.base = base;
+    stack.pushFrame(std::move(frame));
+    entered = true;
   }
 
   ~ScopedCallFrame() {
-    if (!stack.empty()) {
-      stack.pop_back();
+    if (entered) {
+      stack.popFrame();
+    } else {
+      stack.truncate(base);
     }
   }
 };
 
+// Keeps the arguments and traceback entry of an inlined call for as long as
+// its body is being evaluated.
+class ScopedInlineFrame {
+  std::vector<Value> &args;
+  std::vector<CallFrame> &frames;
+  size_t base;
+
+public:
+  ScopedInlineFrame(std::vector<Value> &inlineArgs,
+                    std::vector<CallFrame> &inlineFrames, CallFrame frame)
+      : args(inlineArgs), frames(inlineFrames), base(frame.base) {
+    frames.push_back(std::move(frame));
+  }
+
+  ~ScopedInlineFrame() {
+    frames.pop_back();
+    args.resize(base);
+  }
+};
+
 class ScopedModuleContext {
-  std::vector<std::string> &stack;
+  std::vector<ModuleState *> &stack;
 
 public:
-  ScopedModuleContext(std::vector<std::string> &moduleStack,
-                      std::string moduleKey)
+  ScopedModuleContext(std::vector<ModuleState *> &moduleStack,
+                      ModuleState *module)
       : stack(moduleStack) {
-    stack.push_back(std::move(moduleKey));
+    stack.push_back(module);
   }
 
   ~ScopedModuleContext() {
@@ -62,15 +106,24 @@ public:
 
 class ScopedFilename {
   std::string &fileNameRef;
+  const std::string *&stableRef;
   std::string originalName;
+  const std::string *originalStable;
 
 public:
-  ScopedFilename(std::string &fname, std::string newName)
-      : fileNameRef(fname), originalName(fname) {
-    fileNameRef = std::move(newName);
+  // 'newName' must outlive the scope; call frames keep pointers to it
+  ScopedFilename(std::string &fname, const std::string *&fnameStable,
+                 const std::string &newName)
+      : fileNameRef(fname), stableRef(fnameStable), originalName(fname),
+        originalStable(fnameStable) {
+    fileNameRef = newName;
+    stableRef = &newName;
   }
 
-  ~ScopedFilename() { fileNameRef = originalName; }
+  ~ScopedFilename() {
+    fileNameRef = originalName;
+    stableRef = originalStable;
+  }
 };
 
 class ScopedSetMembership {
@@ -86,12 +139,91 @@ public:
 
   ~ScopedSetMembership() { setRef.erase(value); }
 };
+
+// truth of an operand of && or ||: any number, 0 being false; nullopt for
+// values that are not numbers
+std::optional<bool> logical_truth(const Value &value) {
+  if (auto b = std::get_if<tn_bool_t>(&value.v))
+    return *b;
+  if (auto i = std::get_if<tn_int_t>(&value.v))
+    return *i != 0;
+  if (auto d = std::get_if<tn_dec_t>(&value.v))
+    return *d != 0;
+
+  return std::nullopt;
+}
+
+// Loops run this many iterations and forms this many calls in the
+// interpreter before they are compiled; code that deoptimizes (or gives up
+// a call) this many times goes back to being interpreted for good.
+constexpr uint32_t JIT_LOOP_THRESHOLD = 1000;
+constexpr uint32_t JIT_FORM_THRESHOLD = 100;
+constexpr uint32_t JIT_MAX_DEOPTS = 8;
+
+// the type compiled code keeps 'value' as; false for any other value
+bool jit_type_of(const Value &value, JitType &type) {
+  if (std::holds_alternative<tn_int_t>(value.v)) {
+    type = JitType::Int;
+  } else if (std::holds_alternative<tn_dec_t>(value.v)) {
+    type = JitType::Dec;
+  } else if (auto vec = std::get_if<Value::VecT>(&value.v)) {
+    if (!*vec)
+      return false;
+    type = JitType::Vec;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+// 'value' as a slot of compiled code; jit_type_of must have accepted it
+int64_t jit_slot(const Value &value) {
+  if (auto i = std::get_if<tn_int_t>(&value.v))
+    return *i;
+
+  if (auto d = std::get_if<tn_dec_t>(&value.v)) {
+    int64_t bits;
+    std::memcpy(&bits, d, sizeof(bits));
+    return bits;
+  }
+
+  return (int64_t)(uintptr_t)std::get<Value::VecT>(value.v).get();
+}
+
+Value jit_value(int64_t slot, JitType type) {
+  if (type == JitType::Int)
+    return Value(tn_int_t(slot));
+
+  tn_dec_t d;
+  std::memcpy(&d, &slot, sizeof(d));
+  return Value(d);
+}
+
+template <typename T> bool compare_numbers(T a, T b, TokenType op) {
+  switch (op) {
+  case TokenType::EQEQ:
+    return a == b;
+  case TokenType::NOTEQ:
+    return a != b;
+  case TokenType::LESS:
+    return a < b;
+  case TokenType::LESSEQ:
+    return a <= b;
+  case TokenType::GREATER:
+    return a > b;
+  default:
+    return a >= b;
+  }
+}
 } // namespace
 
 Evaluator::Evaluator(std::string input, Diagnostics &diagnostics,
                      std::string fname, std::vector<std::string> search_dirs)
     : source(input), diags(diagnostics), filename(fname),
-      file_search_dirs(search_dirs) {
+      filenameRef(&mainFilename), mainFilename(fname),
+      file_search_dirs(search_dirs),
+      jitEnabled(jit_available() && !IS_FLAG_SET(NO_JIT)) {
   nativeMethods["type_int"]["parse"] = [&](const Value &,
                                            const std::vector<Value> &rhs) {
     if (!std::holds_alternative<std::string>(rhs[0].v)) {
@@ -125,8 +257,7 @@ Evaluator::Evaluator(std::string input, Diagnostics &diagnostics,
                                           const std::vector<Value> &rhs) {
     // vec.fill(n: int[, v: any]): return a vector of size 'n', optionally
     // filled with 'v'.
-    Value::VecT ret = std::make_shared<std::vector<Value>>(
-        (std::vector<Value>::size_type)std::get<tn_int_t>(rhs[0].v));
+    const size_t n = (size_t)std::get<tn_int_t>(rhs[0].v);
 
     if (rhs.size() > 1) {
       if (!is_primitive_val(rhs[1])) {
@@ -136,10 +267,10 @@ Evaluator::Evaluator(std::string input, Diagnostics &diagnostics,
             rhs[1].span, "", filename);
       }
 
-      std::fill(ret->begin(), ret->end(), rhs[1]);
+      return Value(make_rc<ValueVec>(n, rhs[1]));
     }
 
-    return Value(ret);
+    return Value(make_rc<ValueVec>(n));
   };
 
   nativeMethods["str"]["toUpperCase"] = [](const Value &lhs,
@@ -166,15 +297,27 @@ Evaluator::Evaluator(std::string input, Diagnostics &diagnostics,
     return Value((tn_int_t)str.length());
   };
 
+  nativeMethods["str"]["slice"] = [&](const Value &lhs,
+                                      const std::vector<Value> &rhs) {
+    // str.slice(start: int[, stop: int]): characters [start, stop)
+    const std::string &str = std::get<std::string>(lhs.v);
+    size_t start, stop;
+    if (!checkSliceArgs("str.slice(start: int[, stop: int])", rhs, str.size(),
+                        lhs.span, start, stop))
+      return Value();
+
+    return Value(str.substr(start, stop - start));
+  };
+
   nativeMethods["vec"]["len"] = [](const Value &lhs,
                                    const std::vector<Value> &) {
     Value::VecT vec = std::get<Value::VecT>(lhs.v);
     return Value((tn_int_t)vec->size());
   };
   nativeMethods["vec"]["push"] = [](const Value &lhs,
-                                    const std::vector<Value> &rhs) {
+                                    std::vector<Value> &rhs) {
     Value::VecT vec = std::get<Value::VecT>(lhs.v);
-    vec->push_back(rhs[0]);
+    vec->push_back(std::move(rhs[0]));
     return Value();
   };
   nativeMethods["vec"]["pop"] = [&](const Value &lhs,
@@ -185,12 +328,30 @@ Evaluator::Evaluator(std::string input, Diagnostics &diagnostics,
       diags.report<Error>(
           "attempted to pop an element back from an empty vector", lhs.span, "",
           filename);
+      return Value();
     }
 
     Value ret = vec->back();
     vec->pop_back();
     return ret;
   };
+  nativeMethods["vec"]["slice"] = [&](const Value &lhs,
+                                      const std::vector<Value> &rhs) {
+    // vec.slice(start: int[, stop: int]): elements [start, stop) as a new
+    // vector. The slice shares the parent's storage until either is modified.
+    const ValueVec &vec = *std::get<Value::VecT>(lhs.v);
+    size_t start, stop;
+    if (!checkSliceArgs("vec.slice(start: int[, stop: int])", rhs, vec.size(),
+                        lhs.span, start, stop))
+      return Value();
+
+    return Value(make_rc<ValueVec>(vec.slice(start, stop)));
+  };
+
+  registerBitsMethods();
+  registerVecSortMethods();
+  registerContainerMethods();
+  registerCapacityMethods();
 }
 
 Value Evaluator::evalProgram(ASTPtr program,
@@ -198,7 +359,7 @@ Value Evaluator::evalProgram(ASTPtr program,
   Value last;
 
   {
-    auto vecPtr = std::make_shared<std::vector<Value>>();
+    auto vecPtr = make_rc<ValueVec>();
     vecPtr->reserve(args.size());
     for (const std::string &s : args)
       vecPtr->push_back(Value(s));
@@ -209,24 +370,171 @@ Value Evaluator::evalProgram(ASTPtr program,
   variables["EOF"] = Value(tn_int_t(EOF));
 
   Program *p = static_cast<Program *>(program.get());
+  loaded_programs.push_back(std::move(program));
+  if (!IS_FLAG_SET(NO_OPT)) {
+    optimize_program(*p);
+    hoist_invariants(*p, filename);
+  }
+  if (!IS_FLAG_SET(NO_OPT) && !IS_FLAG_SET(NO_INFER))
+    infer_types(*p);
+  if (IS_FLAG_SET(CLOSURES))
+    compile_closures(*p, closures);
 
   for (ExpressionStmt &stmt : p->statements) {
-    last = evalStmt(stmt);
-    if (last.isExit)
+    if (execStmt(stmt) == Completion::Exit)
       break;
   }
 
-  return last;
+  return std::move(completionValue);
 }
 
-Value Evaluator::evalStmt(ExpressionStmt &stmt) {
+Completion Evaluator::execStmt(ExpressionStmt &stmt) {
+  // between statements nothing is half-built, so every container still in
+  // use has a handle somewhere
+  if (gc_allocated >= gc_threshold)
+    gc_collect();
+
+  switch (stmt.kind) {
+  case StmtKind::NoOp:
+    return Completion::Normal;
+  case StmtKind::Break:
+    return Completion::Break;
+  case StmtKind::Continue:
+    return Completion::Continue;
+  case StmtKind::If:
+    return execIf(static_cast<IfStmt &>(*stmt.expr));
+  case StmtKind::While:
+    return execWhile(static_cast<WhileStmt &>(*stmt.expr));
+  case StmtKind::For:
+    return execFor(static_cast<ForStmt &>(*stmt.expr));
+  case StmtKind::Return:
+    return execReturn(static_cast<ReturnStmt &>(*stmt.expr));
+  case StmtKind::Yield:
+    reportRuntimeError("yield outside of a form", stmt.span,
+                       "only the body of a form can yield");
+    exitErrors();
+    break;
+  case StmtKind::Fused:
+    if (execFused(stmt))
+      return completionValue.isExit ? Completion::Exit : Completion::Normal;
+    break;
+  case StmtKind::Expr:
+    break;
+  }
+
   ASTNode *expr = stmt.expr.get();
 
   if (!expr) {
     diags.report<Error>("Invalid expression", stmt.span, "", filename);
   }
 
-  return evalExpr(expr);
+  completionValue = evalExpr(expr);
+  return completionValue.isExit ? Completion::Exit : Completion::Normal;
+}
+
+namespace {
+tn_int_t apply_fused(TokenType op, tn_int_t a, tn_int_t b) {
+  switch (op) {
+  case TokenType::ADD:
+    return a + b;
+  case TokenType::SUB:
+    return a - b;
+  default:
+    return a * b;
+  }
+}
+} // namespace
+
+// Runs a statement the optimizer fused (see FusedStmt) when its operands
+// turn out to be ints (or a vec, for StoreIndex). Returns false, having
+// evaluated nothing, when they are not and the statement has to run the
+// general way.
+bool Evaluator::execFused(ExpressionStmt &stmt) {
+  FusedStmt &fused = stmt.fused;
+  Variable &var = *fused.target;
+
+  switch (fused.kind) {
+  case Superinstruction::IncrementSlot:
+  case Superinstruction::UpdateSlot: {
+    if (fused.compound) {
+      // `x op= e` evaluates e before it looks x up
+      Value right = fused.operand ? evalExpr(fused.operand) : Value(fused.imm);
+      Value *target = lookupVariable(var);
+      auto a = target ? std::get_if<tn_int_t>(&target->v) : nullptr;
+      auto b = std::get_if<tn_int_t>(&right.v);
+
+      if (a == nullptr || b == nullptr) {
+        completionValue =
+            compoundAssign(static_cast<BinaryOp &>(*stmt.expr), var, right);
+        return true;
+      }
+
+      *a = apply_fused(fused.op, *a, *b);
+      target->span = stmt.expr->span;
+      completionValue = *target;
+    } else {
+      Value *current = lookupVariable(var);
+      if (current == nullptr || !std::holds_alternative<tn_int_t>(current->v))
+        return false;
+
+      // `x = x op e` reads x first; e may change it
+      Value left = *current;
+      Value right = fused.operand ? evalExpr(fused.operand) : Value(fused.imm);
+      auto b = std::get_if<tn_int_t>(&right.v);
+
+      Value result = b ? Value(apply_fused(fused.op, std::get<tn_int_t>(left.v),
+                                           *b))
+                       : evalBinaryOp(left, right, fused.op);
+      completionValue = assignTarget(var) = std::move(result);
+    }
+    break;
+  }
+  case Superinstruction::StoreIndex: {
+    Value *holder = lookupVariable(var);
+    auto vecRef = holder ? std::get_if<Value::VecT>(&holder->v) : nullptr;
+    if (vecRef == nullptr || !*vecRef)
+      return false;
+
+    // held on to: evaluating the index or value may reassign the variable
+    Value::VecT vec = *vecRef;
+
+    Value idxVal = evalExpr(fused.index);
+    auto idx = std::get_if<tn_int_t>(&idxVal.v);
+    if (idx == nullptr) {
+      diags.report<TypeError>("index must be an integer", var.span, "",
+                              filename);
+      exitErrors();
+    }
+
+    if (*idx < 0 || (size_t)*idx >= vec->size()) {
+      diags.report<Error>("index " + std::to_string(*idx) +
+                              " is out of bounds for vector of size " +
+                              std::to_string(vec->size()),
+                          var.span, "", filename);
+      exitErrors();
+    }
+
+    Value rhs = evalExpr(fused.operand);
+    vec->set((size_t)*idx, rhs);
+    completionValue = std::move(rhs);
+    break;
+  }
+  default:
+    return false;
+  }
+
+  superHits[(size_t)fused.kind]++;
+  return true;
+}
+
+Completion Evaluator::execBlock(std::vector<ExpressionStmt> &stmts) {
+  for (ExpressionStmt &stmt : stmts) {
+    Completion completion = execStmt(stmt);
+    if (completion != Completion::Normal)
+      return completion;
+  }
+
+  return Completion::Normal;
 }
 
 Value Evaluator::evalExpr(ASTNode *node) {
@@ -235,40 +543,90 @@ Value Evaluator::evalExpr(ASTNode *node) {
     exitErrors();
   }
 
+  if (node->compiled)
+    return node->compiled->run(*this, *node->compiled);
+
   return node->accept(*this);
 }
 
 std::vector<TracebackFrame> Evaluator::collectTraceback() const {
+  // a runaway recursion would print every one of its frames; keep the
+  // outermost and innermost ones and elide the middle
+  constexpr size_t KEEP_FRAMES = 10;
+
+  // an inlined call has no frame of its own but is still reported, as the
+  // innermost one (its body makes no calls)
+  const auto &all = callStack.all();
+  const size_t total = all.size() + inlineFrames.size();
+  const size_t elided = total > 2 * KEEP_FRAMES ? total - 2 * KEEP_FRAMES : 0;
+
   std::vector<TracebackFrame> frames;
-  frames.reserve(callStack.size());
+  frames.reserve(total - elided + 1);
 
-  for (const CallFrame &frame : callStack) {
-    if (frame.callableName.empty())
+  for (size_t i = 0; i < total; i++) {
+    if (elided != 0 && i == KEEP_FRAMES) {
+      frames.emplace_back("... " + std::to_string(elided) + " more frames",
+                          Span(), "");
+      i += elided - 1;
       continue;
+    }
+
+    const CallFrame &frame =
+        i < all.size() ? all[i] : inlineFrames[i - all.size()];
+    std::string label;
+
+    if (frame.kind == FrameKind::Class) {
+      label = "class " + static_cast<const ClassStmt *>(frame.callee)->name;
+    } else {
+      label = frame.kind == FrameKind::Method ? "method " : "form ";
+      if (frame.qualifier != nullptr)
+        label += *frame.qualifier + ".";
+      label += static_cast<const FunctionStmt *>(frame.callee)->name;
+    }
 
-    frames.emplace_back(
-        frame.callableName, frame.callSite,
-        frame.callsiteFilename.empty() ? filename : frame.callsiteFilename);
+    frames.emplace_back(label + "()", frame.callSite->span,
+                        frame.callsiteFilename ? *frame.callsiteFilename
+                                               : filename);
   }
 
   return frames;
 }
 
+void Evaluator::checkCallDepth(const ASTNode &callSite) {
+  // how much native stack a call takes depends on how deeply its call site
+  // is nested, so the stack can run out before max_call_depth does
+  if (native_stack_exhausted()) {
+    reportRuntimeError("out of native stack at call depth " +
+                           std::to_string(callStack.depth()),
+                       callSite.span,
+                       "raise --max-depth to reserve a larger stack");
+    exitErrors();
+  }
+
+  if (callStack.depth() < max_call_depth)
+    return;
+
+  reportRuntimeError("maximum call depth of " +
+                         std::to_string(max_call_depth) + " exceeded",
+                     callSite.span, "raise the limit with --max-depth");
+  exitErrors();
+}
+
 void Evaluator::reportRuntimeError(const std::string &msg, const Span &span,
                                    const std::string &hint) {
   diags.report<RuntimeError>(msg, span, hint, filename, collectTraceback());
 }
 
-std::optional<std::string> Evaluator::activeModuleKey() const {
-  if (!callStack.empty() && !callStack.back().moduleKey.empty()) {
-    return callStack.back().moduleKey;
+ModuleState *Evaluator::activeModule() const {
+  if (!callStack.empty() && callStack.top().module != nullptr) {
+    return callStack.top().module;
   }
 
   if (!module_context_stack.empty()) {
     return module_context_stack.back();
   }
 
-  return std::nullopt;
+  return nullptr;
 }
 
 ModuleState *Evaluator::getModuleState(const std::string &moduleKey) {
@@ -311,17 +669,14 @@ Value Evaluator::bindModuleValue(const std::string &bindingName,
   moduleValue.setSpan(span);
 
   if (!callStack.empty()) {
-    callStack.back().locals[bindingName] = moduleValue;
+    callStack.define(intern_name(bindingName)) = moduleValue;
     return moduleValue;
   }
 
-  auto moduleKeyOpt = activeModuleKey();
-  if (moduleKeyOpt.has_value()) {
-    ModuleState *state = getModuleState(moduleKeyOpt.value());
-    if (state != nullptr) {
-      state->variables[bindingName] = moduleValue;
-      return moduleValue;
-    }
+  ModuleState *state = activeModule();
+  if (state != nullptr) {
+    state->variables[bindingName] = moduleValue;
+    return moduleValue;
   }
 
   variables[bindingName] = moduleValue;
@@ -347,9 +702,11 @@ Value Evaluator::callNative(const NativeFn &fn,
 
 Value Evaluator::executeFunction(FunctionStmt *func,
                                  const std::vector<ASTPtr> &params,
-                                 const Span &span,
-                                 const std::string &callableName,
-                                 const std::string &moduleKey) {
+                                 const ASTNode &callSite,
+                                 ModuleState *module,
+                                 const std::string *qualifier) {
+  const Span &span = callSite.span;
+
   if (func == nullptr) {
     diags.report<Error>("Attempted to call null function", span, "", filename);
     exitErrors();
@@ -362,47 +719,535 @@ Value Evaluator::executeFunction(FunctionStmt *func,
     exitErrors();
   }
 
+  if (func->inlineBody)
+    return callInlined(func, params, callSite, module, qualifier);
+
+  prepareFrameLayout(func);
+
+  if (func->isGenerator)
+    return makeGenerator(func, params, callSite, module, qualifier);
+
+  if (func->memo)
+    return callMemoized(func, params, callSite, module, qualifier);
+
+  // a precompiled form already has its 'jit', with or without the JIT
+  if (!func->jitFailed &&
+      (func->jit || (jitEnabled && ++func->calls >= JIT_FORM_THRESHOLD)))
+    return callCompiled(func, params, callSite, module, qualifier);
+
+  return runForm(func, params, nullptr, callSite, module, qualifier);
+}
+
+// Runs a call of 'func'. Its arguments are 'params' evaluated now, or
+// 'args' when the caller has already done that.
+Value Evaluator::runForm(FunctionStmt *func, const std::vector<ASTPtr> &params,
+                         std::vector<Value> *args, const ASTNode &callSite,
+                         ModuleState *module, const std::string *qualifier) {
+  checkCallDepth(callSite);
+
+  // the callee's slots go on top of the caller's while the arguments are
+  // evaluated, still in the caller's scope
+  ScopedCallFrame scopedFrame(callStack);
+  bindArguments(func, params, scopedFrame.slotBase(), args);
+
+  CallFrame frame;
+  frame.callee = func;
+  frame.qualifier = qualifier;
+  frame.callSite = &callSite;
+  frame.callsiteFilename = filenameRef;
+  frame.module = module;
+  scopedFrame.enter(std::move(frame));
+
+  completionValue = Value();
+
+  // A `return f(...)` of another form does not recurse: enterTailCall has
+  // already swapped this frame over to the callee, so the loop just starts
+  // running the callee's body.
+  while (execBlock(func->stmts) == Completion::TailCall) {
+    func = static_cast<FunctionStmt *>(callStack.top().callee);
+    completionValue = Value();
+  }
+
+  return std::move(completionValue);
+}
+
+// A call to a form the optimizer reduced to an InlineBody: its parameters
+// are read straight from inlineArgs, so no frame is built and no statement
+// dispatched. The body reads nothing but its parameters, so it evaluates the
+// same with the caller's frame still on top.
+Value Evaluator::callInlined(FunctionStmt *func,
+                             const std::vector<ASTPtr> &params,
+                             const ASTNode &callSite, ModuleState *module,
+                             const std::string *qualifier) {
   CallFrame frame;
-  frame.callableName = callableName;
-  frame.callSite = span;
-  frame.callsiteFilename = filename;
-  frame.moduleKey = moduleKey;
+  frame.base = inlineArgs.size();
+  frame.count = params.size();
+  frame.callee = func;
+  frame.qualifier = qualifier;
+  frame.callSite = &callSite;
+  frame.callsiteFilename = filenameRef;
+  frame.module = module;
+
+  // an argument may itself be an inlined call, which pops what it pushed
+  for (const ASTPtr &param : params) {
+    Value arg = evalExpr(param.get());
+    inlineArgs.push_back(std::move(arg));
+  }
+
+  ScopedInlineFrame scopedFrame(inlineArgs, inlineFrames, std::move(frame));
+  const InlineBody &body = *func->inlineBody;
+
+  for (const InlineBody::Guard &guard : body.guards) {
+    if (evalCondition(*guard.test))
+      return evalExpr(guard.ret->value.get()).setSpan(guard.ret->span);
+  }
+
+  return evalExpr(body.result->value.get()).setSpan(body.result->span);
+}
+
+// A `@memo` form: the arguments are evaluated up front to look the call up
+// in its cache, and handed to the call on a miss.
+Value Evaluator::callMemoized(FunctionStmt *func,
+                              const std::vector<ASTPtr> &params,
+                              const ASTNode &callSite, ModuleState *module,
+                              const std::string *qualifier) {
+  std::vector<Value> args;
+  args.reserve(params.size());
+  for (const ASTPtr &param : params)
+    args.push_back(evalExpr(param.get()));
+
+  std::string key;
+  if (!MemoCache::makeKey(args, key))
+    return runForm(func, params, &args, callSite, module, qualifier);
+
+  if (const Value *cached = func->memo->find(key))
+    return *cached;
+
+  Value result = runForm(func, params, &args, callSite, module, qualifier);
+  func->memo->insert(std::move(key), result);
+  return result;
+}
+
+// A hot form: compiled for the types of the arguments of the call that
+// finds it hot, then run natively whenever it is called with those types.
+Value Evaluator::callCompiled(FunctionStmt *func,
+                              const std::vector<ASTPtr> &params,
+                              const ASTNode &callSite, ModuleState *module,
+                              const std::string *qualifier) {
+  std::vector<Value> args;
+  std::vector<JitType> types;
+  std::vector<int64_t> slots;
+  bool numeric = true;
+
+  args.reserve(params.size());
+  for (const ASTPtr &param : params) {
+    args.push_back(evalExpr(param.get()));
+
+    JitType type;
+    numeric = numeric && jit_type_of(args.back(), type) &&
+              type != JitType::Vec;
+    if (numeric) {
+      types.push_back(type);
+      slots.push_back(jit_slot(args.back()));
+    }
+  }
+
+  if (!func->jit) {
+    if (numeric)
+      func->jit = jit_compile_form(*func, types);
+
+    if (!func->jit) {
+      func->jitFailed = true;
+      return runForm(func, params, &args, callSite, module, qualifier);
+    }
+
+    jitStats.forms++;
+  }
+
+  // the compiled body calls itself directly, so only while its name still
+  // reaches it
+  JitForm &form = *func->jit;
+  ModuleState *calleeModule =
+      module ? module
+             : (module_context_stack.empty() ? nullptr
+                                             : module_context_stack.back());
+  ModuleState *reached = nullptr;
+
+  if (numeric && form.params == types &&
+      (!form.recursive ||
+       findFormIn(calleeModule, func->name, reached) == func)) {
+    int64_t result;
+    if (form.run(slots.data(), (int64_t)(max_call_depth - callStack.depth()),
+                 result))
+      return jit_value(result, form.result);
+
+    jitStats.deopts++;
+    if (++form.aborts >= JIT_MAX_DEOPTS)
+      func->jitFailed = true;
+  }
+
+  return runForm(func, params, &args, callSite, module, qualifier);
+}
+
+void Evaluator::bindArguments(FunctionStmt *func,
+                              const std::vector<ASTPtr> &params, size_t base,
+                              std::vector<Value> *args) {
+  for (uint32_t name : func->frameLayout)
+    callStack.addSlot(name);
 
   for (size_t i = 0; i < func->params.size(); i++) {
-    Variable *formalParam = dynamic_cast<Variable *>(func->params[i].get());
-    if (!formalParam) {
+    Value arg = args ? std::move((*args)[i]) : evalExpr(params[i].get());
+    uint32_t name = static_cast<Variable *>(func->params[i].get())->nameId;
+    FrameSlot &slot = callStack.slotAt(callStack.findSlotSince(base, name));
+    slot.value = std::move(arg);
+    slot.defined = true;
+  }
+}
+
+// Generators
+
+Value Evaluator::makeGenerator(FunctionStmt *func,
+                               const std::vector<ASTPtr> &params,
+                               const ASTNode &callSite, ModuleState *module,
+                               const std::string *qualifier) {
+  auto gen = std::make_shared<GeneratorIter>(*this, func, module, qualifier,
+                                             &callSite, filenameRef);
+
+  // the arguments are evaluated now, in the caller's scope, like for any
+  // other call; the body first runs when the generator is iterated
+  ScopedCallFrame scopedFrame(callStack);
+  bindArguments(func, params, scopedFrame.slotBase());
+
+  gen->slots.reserve(callStack.slotTop() - scopedFrame.slotBase());
+  for (size_t i = scopedFrame.slotBase(); i < callStack.slotTop(); i++)
+    gen->slots.push_back(std::move(callStack.slotAt(i)));
+
+  return Value(Value::IterT(std::move(gen)));
+}
+
+bool Evaluator::resumeGenerator(GeneratorIter &gen, Value &out) {
+  if (gen.done)
+    return false;
+
+  if (gen.running) {
+    reportRuntimeError("generator " + gen.func->name +
+                           "() is iterated from inside its own body",
+                       gen.callSite->span);
+    exitErrors();
+  }
+
+  checkCallDepth(*gen.callSite);
+
+  ScopedCallFrame scopedFrame(callStack);
+  for (FrameSlot &slot : gen.slots)
+    callStack.addSlot(std::move(slot));
+  gen.slots.clear();
+
+  CallFrame frame;
+  frame.callee = gen.func;
+  frame.qualifier = gen.qualifier;
+  frame.callSite = gen.callSite;
+  frame.callsiteFilename = gen.callsiteFilename;
+  frame.module = gen.module;
+  scopedFrame.enter(std::move(frame));
+
+  gen.running = true;
+  const Completion completion = runGenerator(gen);
+  gen.running = false;
+
+  if (completion == Completion::Yield) {
+    // take the frame's locals back off the stack, including any that were
+    // spilled while a callee's arguments were being built above it
+    CallFrame &top = callStack.top();
+    for (size_t i = top.base; i < top.base + top.count; i++)
+      gen.slots.push_back(std::move(callStack.slotAt(i)));
+
+    if (top.overflow) {
+      for (auto &[name, value] : *top.overflow)
+        gen.slots.push_back(FrameSlot{name, true, std::move(value)});
+    }
+
+    out = std::move(completionValue);
+    return true;
+  }
+
+  gen.done = true;
+  gen.cursors.clear();
+  return false;
+}
+
+// Runs a generator's body from where it stopped until its next yield
+// (Completion::Yield, with the element in completionValue) or its end.
+// The body's blocks are walked with an explicit cursor stack instead of
+// execBlock's native recursion, so they can be left at a yield and picked
+// up again on the next element.
+Completion Evaluator::runGenerator(GeneratorIter &gen) {
+  std::vector<GenCursor> &cursors = gen.cursors;
+
+  if (!gen.started) {
+    gen.started = true;
+    cursors.emplace_back(&gen.func->stmts);
+  }
+
+  // leaves the innermost loop (break) or ends its current iteration
+  // (continue)
+  auto unwindToLoop = [&](bool isBreak) {
+    while (!cursors.empty() && cursors.back().loop == nullptr)
+      cursors.pop_back();
+
+    if (cursors.empty())
+      return;
+
+    if (isBreak) {
+      cursors.pop_back();
+    } else {
+      cursors.back().pc = cursors.back().stmts->size();
+    }
+  };
+
+  while (!cursors.empty()) {
+    GenCursor &cur = cursors.back();
+
+    if (cur.pc == cur.stmts->size()) {
+      if (cur.isFor) {
+        if (stepGeneratorFor(static_cast<ForStmt &>(*cur.loop), cur)) {
+          cur.pc = 0;
+          continue;
+        }
+      } else if (cur.loop != nullptr) {
+        if (evalCondition(*static_cast<WhileStmt &>(*cur.loop).test)) {
+          cur.pc = 0;
+          continue;
+        }
+      }
+
+      cursors.pop_back();
+      continue;
+    }
+
+    ExpressionStmt &stmt = (*cur.stmts)[cur.pc++];
+
+    switch (stmt.kind) {
+    case StmtKind::If: {
+      auto &node = static_cast<IfStmt &>(*stmt.expr);
+      auto &branch =
+          evalCondition(*node.test) ? node.thenClauseStmts : node.elseClauseStmts;
+      cursors.emplace_back(&branch);
+      break;
+    }
+    case StmtKind::While: {
+      auto &node = static_cast<WhileStmt &>(*stmt.expr);
+      if (evalCondition(*node.test))
+        cursors.emplace_back(&node.stmts, &node);
+      break;
+    }
+    case StmtKind::For: {
+      auto &node = static_cast<ForStmt &>(*stmt.expr);
+      GenCursor loop(&node.stmts, &node);
+      loop.isFor = true;
+      loop.iter = evalExpr(node.iter.get()).setSpan(node.iter->span);
+
+      if (auto setPtr = std::get_if<Value::SetT>(&loop.iter.v))
+        loop.iter = make_vec((*setPtr)->values());
+      else if (auto iterPtr = std::get_if<Value::IterT>(&loop.iter.v))
+        loop.iter = Value((*iterPtr)->begin());
+
+      if (stepGeneratorFor(node, loop))
+        cursors.push_back(std::move(loop));
+      break;
+    }
+    case StmtKind::Yield:
+      completionValue =
+          evalExpr(static_cast<YieldStmt &>(*stmt.expr).value.get());
+      return Completion::Yield;
+    case StmtKind::Return:
+      // a generator's return only ends it; there is no caller to take the
+      // value
+      evalExpr(static_cast<ReturnStmt &>(*stmt.expr).value.get());
+      return Completion::Return;
+    case StmtKind::Break:
+    case StmtKind::Continue:
+      unwindToLoop(stmt.kind == StmtKind::Break);
+      break;
+    default:
+      if (execStmt(stmt) == Completion::Exit)
+        return Completion::Exit;
+      break;
+    }
+  }
+
+  return Completion::Normal;
+}
+
+// Moves a for loop inside a generator to its next element, binding the loop
+// variable; false when the loop is done. Unlike execFor this keeps all of
+// its position in 'cur', so it survives the generator being suspended.
+bool Evaluator::stepGeneratorFor(ForStmt &node, GenCursor &cur) {
+  Value next;
+  const size_t index = cur.index;
+
+  if (auto count = std::get_if<tn_int_t>(&cur.iter.v)) {
+    if ((tn_int_t)index >= *count)
+      return false;
+    next = Value((tn_int_t)index);
+  } else if (auto strPtr = std::get_if<std::string>(&cur.iter.v)) {
+    if (index >= strPtr->size())
+      return false;
+    next = Value(std::string(1, (*strPtr)[index]));
+  } else if (auto vecPtr = std::get_if<Value::VecT>(&cur.iter.v)) {
+    if (index >= (*vecPtr)->size())
+      return false;
+    next = (**vecPtr)[index];
+  } else if (auto dequePtr = std::get_if<Value::DequeT>(&cur.iter.v)) {
+    if (index >= (*dequePtr)->size())
+      return false;
+    next = (**dequePtr)[index];
+  } else if (auto dicPtr = std::get_if<Value::DicT>(&cur.iter.v)) {
+    // resume after the previous key, which stays valid even if the body
+    // changed the dictionary meanwhile
+    auto it = index == 0 ? (*dicPtr)->begin()
+                         : (*dicPtr)->upper_bound(cur.lastKey);
+    if (it == (*dicPtr)->end())
+      return false;
+    cur.lastKey = it->first;
+    next = make_vec({Value(it->first), it->second});
+  } else if (auto iterPtr = std::get_if<Value::IterT>(&cur.iter.v)) {
+    if (!(*iterPtr)->next(next))
+      return false;
+  } else {
+    return false;
+  }
+
+  cur.index++;
+  callStack.define(node.varId, node.varSlotHint) = std::move(next);
+  return true;
+}
+
+void Evaluator::prepareFrameLayout(FunctionStmt *func) {
+  if (func->hasFrameLayout)
+    return;
+
+  for (const ASTPtr &param : func->params) {
+    if (!dynamic_cast<Variable *>(param.get())) {
       diags.report<Error>("Function parameter is not a variable", func->span,
                           "", filename);
       exitErrors();
     }
+  }
 
-    frame.locals[formalParam->name] = evalExpr(params[i].get());
+  func->frameLayout = frame_layout(func->params, func->stmts);
+  func->hasFrameLayout = true;
+}
+
+// the form an unqualified call to 'name' reaches, following the same lookup
+// order as visit(FunctionCall); null if it reaches a class, a native
+// function or nothing
+FunctionStmt *Evaluator::findForm(const std::string &name,
+                                  ModuleState *&module) {
+  return findFormIn(activeModule(), name, module);
+}
+
+// findForm as seen from code running in 'state' (null for the program)
+FunctionStmt *Evaluator::findFormIn(ModuleState *state,
+                                    const std::string &name,
+                                    ModuleState *&module) {
+  if (state != nullptr) {
+    if (state->classes.count(name))
+      return nullptr;
+
+    auto fnIt = state->functions.find(name);
+    if (fnIt != state->functions.end()) {
+      module = state;
+      return fnIt->second;
+    }
+
+    if (state->nativeFunctions.count(name))
+      return nullptr;
   }
 
-  ScopedCallFrame scopedFrame(callStack, std::move(frame));
+  if (classes.count(name))
+    return nullptr;
 
-  Value result;
+  auto fnIt = functions.find(name);
+  if (fnIt != functions.end()) {
+    module = nullptr;
+    return fnIt->second;
+  }
 
-  for (ExpressionStmt &stmt : func->stmts) {
-    result = evalStmt(stmt);
+  return nullptr;
+}
 
-    if (result.isReturn) {
-      result.isReturn = false;
-      return result;
+// If 'expr' (the value of a return statement inside a form) is a call to a
+// form, `f(...)` or `module.f(...)`, evaluates its arguments and turns the
+// current frame into the callee's. Returns false, doing nothing, for any
+// other expression.
+bool Evaluator::enterTailCall(ASTNode *expr) {
+  FunctionCall *call = dynamic_cast<FunctionCall *>(expr);
+  FunctionStmt *func = nullptr;
+  ModuleState *module = nullptr;
+  const std::string *qualifier = nullptr;
+
+  if (call != nullptr) {
+    func = findForm(call->name, module);
+  } else if (auto dot = dynamic_cast<BinaryOp *>(expr)) {
+    call = dynamic_cast<FunctionCall *>(dot->right.get());
+    Variable *var = dynamic_cast<Variable *>(dot->left.get());
+    if (dot->op != TokenType::DOT || call == nullptr || var == nullptr)
+      return false;
+
+    Value *holder = lookupVariable(*var);
+    auto ref = holder ? std::get_if<Value::ModuleRef>(&holder->v) : nullptr;
+    ModuleState *state = ref ? getModuleState(ref->key) : nullptr;
+    if (state == nullptr || state->classes.count(call->name))
+      return false;
+
+    auto fnIt = state->functions.find(call->name);
+    if (fnIt != state->functions.end()) {
+      func = fnIt->second;
+      module = state;
+      qualifier = &state->name;
     }
+  }
 
-    if (result.isExit) {
-      return result;
-    }
+  // mismatched arity is left to the regular call path to report; calling a
+  // generator only builds it and an inlined form has no frame to reuse, so
+  // there is nothing to gain; a @memo form has to go through its cache
+  if (func == nullptr || call->params.size() != func->params.size() ||
+      func->isGenerator || func->inlineBody || func->memo)
+    return false;
+
+  prepareFrameLayout(func);
+
+  const size_t argBase = callStack.slotTop();
+  for (uint32_t name : func->frameLayout)
+    callStack.addSlot(name);
+
+  for (size_t i = 0; i < func->params.size(); i++) {
+    Value arg = evalExpr(call->params[i].get());
+    uint32_t name = static_cast<Variable *>(func->params[i].get())->nameId;
+    FrameSlot &slot =
+        callStack.slotAt(callStack.findSlotSince(argBase, name));
+    slot.value = std::move(arg);
+    slot.defined = true;
   }
 
-  return result;
+  callStack.replaceTop(argBase);
+
+  CallFrame &frame = callStack.top();
+  frame.callee = func;
+  frame.qualifier = qualifier;
+  frame.callSite = call;
+  frame.callsiteFilename = filenameRef;
+  frame.module = module;
+  return true;
 }
 
 Value Evaluator::instantiateClass(ClassStmt *classDef,
                                   const std::vector<ASTPtr> &params,
-                                  const Span &span,
-                                  const std::string &moduleKey) {
+                                  const ASTNode &callSite,
+                                  ModuleState *module) {
+  const Span &span = callSite.span;
+
   if (classDef == nullptr) {
     diags.report<Error>("Attempted to instantiate null class", span, "",
                         filename);
@@ -416,28 +1261,45 @@ Value Evaluator::instantiateClass(ClassStmt *classDef,
     exitErrors();
   }
 
-  Value::ClassInstance instance(classDef->name, moduleKey);
-
-  CallFrame frame;
-  frame.callableName = "class " + classDef->name + "()";
-  frame.callSite = span;
-  frame.callsiteFilename = filename;
-  frame.moduleKey = moduleKey;
+  Value::ClassInstance instance(classDef->name, module ? module->key : "");
 
-  for (size_t i = 0; i < params.size(); i++) {
-    Variable *paramVar = dynamic_cast<Variable *>(classDef->params[i].get());
-    if (!paramVar) {
-      diags.report<Error>("Class parameter is not a variable", classDef->span,
-                          "", filename);
-      exitErrors();
+  if (!classDef->hasFrameLayout) {
+    for (const ASTPtr &param : classDef->params) {
+      if (!dynamic_cast<Variable *>(param.get())) {
+        diags.report<Error>("Class parameter is not a variable",
+                            classDef->span, "", filename);
+        exitErrors();
+      }
     }
 
+    classDef->frameLayout = frame_layout(classDef->params, classDef->stmts);
+    classDef->hasFrameLayout = true;
+  }
+
+  checkCallDepth(callSite);
+
+  ScopedCallFrame scopedFrame(callStack);
+  for (uint32_t name : classDef->frameLayout)
+    callStack.addSlot(name);
+
+  for (size_t i = 0; i < params.size(); i++) {
+    Variable *paramVar = static_cast<Variable *>(classDef->params[i].get());
     Value argVal = evalExpr(params[i].get());
     instance.fields[paramVar->name] = argVal;
-    frame.locals[paramVar->name] = argVal;
+
+    FrameSlot &slot = callStack.slotAt(
+        callStack.findSlotSince(scopedFrame.slotBase(), paramVar->nameId));
+    slot.value = std::move(argVal);
+    slot.defined = true;
   }
 
-  ScopedCallFrame scopedFrame(callStack, std::move(frame));
+  CallFrame frame;
+  frame.kind = FrameKind::Class;
+  frame.callee = classDef;
+  frame.callSite = &callSite;
+  frame.callsiteFilename = filenameRef;
+  frame.module = module;
+  scopedFrame.enter(std::move(frame));
 
   for (ExpressionStmt &stmt : classDef->stmts) {
     if (auto *fn = dynamic_cast<FunctionStmt *>(stmt.expr.get())) {
@@ -449,7 +1311,7 @@ Value Evaluator::instantiateClass(ClassStmt *classDef,
     } else if (auto *varStmt = dynamic_cast<Variable *>(stmt.expr.get())) {
       instance.fields[varStmt->name] = Value();
     } else {
-      evalStmt(stmt);
+      execStmt(stmt);
     }
   }
 
@@ -482,7 +1344,7 @@ Value Evaluator::visit(VecLiteral &node) {
     elems.push_back(evalExpr(elem.get()).setSpan(elem->span));
   }
 
-  return Value(std::make_shared<std::vector<Value>>(elems)).setSpan(node.span);
+  return Value(make_rc<ValueVec>(std::move(elems))).setSpan(node.span);
 }
 
 Value Evaluator::visit(DicLiteral &node) {
@@ -499,8 +1361,7 @@ Value Evaluator::visit(DicLiteral &node) {
         evalExpr(pair.second.get()).setSpan(pair.second->span);
   }
 
-  return Value(std::make_shared<std::map<std::string, Value>>(dic))
-      .setSpan(node.span);
+  return Value(make_rc<ValueDic>(std::move(dic))).setSpan(node.span);
 }
 
 // Type nodes
@@ -541,154 +1402,467 @@ Value Evaluator::visit(TypeDic &node) {
   return res.setSpan(node.span);
 }
 
+Value Evaluator::visit(TypeBits &node) {
+  Value res;
+  res.typeBits = true;
+  return res.setSpan(node.span);
+}
+
+Value Evaluator::visit(TypeDeque &node) {
+  Value res;
+  res.typeDeque = true;
+  return res.setSpan(node.span);
+}
+
+Value Evaluator::visit(TypeHeap &node) {
+  Value res;
+  res.typeHeap = true;
+  return res.setSpan(node.span);
+}
+
+Value Evaluator::visit(TypeSet &node) {
+  Value res;
+  res.typeSet = true;
+  return res.setSpan(node.span);
+}
+
 // Control flow
 
-Value Evaluator::visit(IfStmt &node) {
-  const bool condition = std::get<tn_bool_t>(evalExpr(node.condition.get()).v);
-  Value cur_res;
+bool Evaluator::conditionTruth(const Value &value, const Condition &cond,
+                               const Span &span) {
+  if (auto b = std::get_if<tn_bool_t>(&value.v))
+    return *b;
 
-  auto &branch = condition ? node.thenClauseStmts : node.elseClauseStmts;
+  if (cond.operand) {
+    if (std::optional<bool> truth = logical_truth(value))
+      return *truth;
+  }
 
-  for (ExpressionStmt &stmt : branch) {
-    if (stmt.isBreak || stmt.isContinue)
-      break;
+  diags.report<TypeError>("condition must be a bool, got " +
+                              value.getTypeName(),
+                          span, "", filename);
+  exitErrors();
+  return false;
+}
 
-    cur_res = evalStmt(stmt);
+bool Evaluator::evalCondition(const Condition &cond) {
+  switch (cond.kind) {
+  case Condition::And:
+    return evalCondition(*cond.left) && evalCondition(*cond.right);
+  case Condition::Or:
+    return evalCondition(*cond.left) || evalCondition(*cond.right);
+  case Condition::Not:
+    return !evalCondition(*cond.left);
+  case Condition::Compare: {
+    if (cond.fused) {
+      Value *lhsVar = lookupVariable(*static_cast<Variable *>(cond.expr));
+      Value *rhsVar =
+          cond.rhsImm ? nullptr
+                      : lookupVariable(*static_cast<Variable *>(cond.rhs));
+      auto a = lhsVar ? std::get_if<tn_int_t>(&lhsVar->v) : nullptr;
+      auto b = cond.rhsImm ? &cond.imm
+               : rhsVar    ? std::get_if<tn_int_t>(&rhsVar->v)
+                           : nullptr;
+
+      if (a && b) {
+        superHits[(size_t)Superinstruction::CompareBranch]++;
+        return compare_numbers(*a, *b, cond.op);
+      }
+    }
 
-    if (cur_res.isReturn || cur_res.isExit)
-      return cur_res;
+    if (cond.staticType == StaticType::Int) {
+      tn_int_t a, b;
+      if (evalRaw(cond.expr, cond.lhsShape, a) &&
+          evalRaw(cond.rhs, cond.rhsShape, b)) {
+        inferStats.typed++;
+        return compare_numbers(a, b, cond.op);
+      }
+      inferStats.fallbacks++;
+    } else if (cond.staticType == StaticType::Dec) {
+      tn_dec_t a, b;
+      if (evalRaw(cond.expr, cond.lhsShape, a) &&
+          evalRaw(cond.rhs, cond.rhsShape, b)) {
+        inferStats.typed++;
+        return compare_numbers(a, b, cond.op);
+      }
+      inferStats.fallbacks++;
+    }
+
+    Value lhs = evalExpr(cond.expr);
+    Value rhs = evalExpr(cond.rhs);
+
+    auto lhsInt = std::get_if<tn_int_t>(&lhs.v);
+    auto rhsInt = std::get_if<tn_int_t>(&rhs.v);
+    if (lhsInt && rhsInt)
+      return compare_numbers(*lhsInt, *rhsInt, cond.op);
+
+    auto lhsDec = std::get_if<tn_dec_t>(&lhs.v);
+    auto rhsDec = std::get_if<tn_dec_t>(&rhs.v);
+    if ((lhsDec || lhsInt) && (rhsDec || rhsInt))
+      return compare_numbers(lhsDec ? *lhsDec : (tn_dec_t)*lhsInt,
+                             rhsDec ? *rhsDec : (tn_dec_t)*rhsInt, cond.op);
+
+    return conditionTruth(evalBinaryOp(lhs, rhs, cond.op), cond,
+                          Span::combine(cond.expr->span, cond.rhs->span));
+  }
+  case Condition::Expr:
+    break;
   }
 
-  return cur_res;
+  return conditionTruth(evalExpr(cond.expr), cond, cond.expr->span);
 }
 
-Value Evaluator::visit(WhileStmt &node) {
-  bool break_while_loop = false;
+Value Evaluator::evalLogical(BinaryOp &node) {
+  Value left = evalExpr(node.left.get());
 
-  while (std::get<tn_bool_t>(evalExpr(node.condition.get()).v) == true &&
-         !break_while_loop) {
-    for (ExpressionStmt &stmt : node.stmts) {
-      if (stmt.isBreak) {
-        break_while_loop = true;
-        break;
-      } else if (stmt.isContinue) {
-        break;
+  // the right operand only runs when the left one does not decide
+  std::optional<bool> truth = logical_truth(left);
+  if (truth && *truth == (node.op == TokenType::OR))
+    return Value(*truth).setSpan(node.span);
+
+  Value right = evalExpr(node.right.get());
+  return evalBinaryOp(left, right, node.op);
+}
+
+Completion Evaluator::execIf(IfStmt &node) {
+  const bool condition = evalCondition(*node.test);
+
+  completionValue = Value();
+  return execBlock(condition ? node.thenClauseStmts : node.elseClauseStmts);
+}
+
+namespace {
+// A run of a loop starts with none of its invariants (see hoist.hpp) known.
+// A recursive call running the same loop sets aside the ones the outer run
+// found, and gives them back once it is done.
+class InvariantScope {
+  std::vector<BinaryOp *> &nodes;
+  std::vector<std::pair<size_t, Value>> saved;
+
+public:
+  explicit InvariantScope(std::vector<BinaryOp *> &loopNodes)
+      : nodes(loopNodes) {
+    for (size_t i = 0; i < nodes.size(); i++) {
+      ExprCache &cache = *nodes[i]->cache;
+      if (cache.valid) {
+        saved.emplace_back(i, std::move(cache.value));
+        cache.valid = false;
       }
+    }
+  }
 
-      Value res = evalStmt(stmt);
+  ~InvariantScope() {
+    for (BinaryOp *node : nodes)
+      node->cache->valid = false;
 
-      if (res.isReturn || res.isExit)
-        return res;
+    for (auto &[i, value] : saved) {
+      nodes[i]->cache->value = std::move(value);
+      nodes[i]->cache->valid = true;
     }
   }
+};
+} // namespace
 
-  return Value();
+Completion Evaluator::execWhile(WhileStmt &node) {
+  InvariantScope invariants(node.invariants);
+
+  while (true) {
+    Completion completion;
+
+    if (jitEnabled && !node.jitFailed &&
+        (node.jit || ++node.iterations >= JIT_LOOP_THRESHOLD) &&
+        runCompiledLoop(node, completion)) {
+      // the compiled loop ran to its end, or deoptimized and had the rest
+      // of that iteration run here
+    } else {
+      if (!evalCondition(*node.test))
+        break;
+      completion = execBlock(node.stmts);
+    }
+
+    if (completion == Completion::Break)
+      break;
+    if (completion != Completion::Normal && completion != Completion::Continue)
+      return completion;
+  }
+
+  completionValue = Value();
+  return Completion::Normal;
 }
 
-Value Evaluator::visit(ForStmt &node) {
-  bool break_for_loop = false;
-  int index = 0;
-  int length = 0;
-  Value::DicT::element_type::iterator dic_it;
-  bool is_dic = false;
+// Runs 'node' compiled from the top of an iteration, compiling it first
+// once it has become hot. Returns false when the interpreter should run the
+// iteration itself: the loop cannot be compiled, its variables no longer
+// hold the types it was compiled for, or it deoptimized at its condition.
+// Otherwise 'completion' is how the iteration it stopped in ended, Break
+// once the loop is done.
+bool Evaluator::runCompiledLoop(WhileStmt &node, Completion &completion) {
+  if (!node.jit) {
+    node.jit = jit_compile_loop(node, [this](Variable &var, JitType &type) {
+      Value *value = lookupVariable(var);
+      return value != nullptr && jit_type_of(*value, type);
+    });
+
+    if (!node.jit) {
+      node.jitFailed = true;
+      return false;
+    }
+
+    jitStats.loops++;
+  }
+
+  JitLoop &loop = *node.jit;
+  std::vector<Value *> storage(loop.bindings.size());
+  std::vector<int64_t> slots(loop.bindings.size());
+  uint32_t exit = 0;
+
+  for (size_t i = 0; i < loop.bindings.size(); i++) {
+    const JitBinding &binding = loop.bindings[i];
+    JitType type;
+
+    storage[i] = compiledBinding(*binding.var, binding.written);
+    if (storage[i] == nullptr || !jit_type_of(*storage[i], type) ||
+        type != binding.type) {
+      exit = UINT32_MAX;
+      break;
+    }
+
+    slots[i] = jit_slot(*storage[i]);
+  }
+
+  if (exit == 0) {
+    exit = loop.run(slots.data());
 
+    for (size_t i = 0; i < loop.bindings.size(); i++) {
+      if (loop.bindings[i].written)
+        storage[i]->v = jit_value(slots[i], loop.bindings[i].type).v;
+    }
+
+    if (exit == 0) {
+      completion = Completion::Break;
+      return true;
+    }
+  }
+
+  jitStats.deopts++;
+  if (++loop.deopts >= JIT_MAX_DEOPTS)
+    node.jitFailed = true;
+
+  if (exit == UINT32_MAX || loop.resumePoints[exit - 1].empty())
+    return false;
+
+  // the compiled code evaluated the operations before the resume point
+  // without keeping their values for the ones after it to reuse
+  cseEpoch++;
+  completion = resumeAfterDeopt(loop.resumePoints[exit - 1], 0);
+  return true;
+}
+
+// Finishes the iteration a compiled loop deoptimized in: runs the statement
+// the path leads to and everything after it, through the ifs and whiles it
+// is nested in, up to the end of the loop's body.
+Completion Evaluator::resumeAfterDeopt(const std::vector<JitResumeStep> &path,
+                                       size_t depth) {
+  std::vector<ExpressionStmt> &stmts = *path[depth].block;
+  size_t next = path[depth].index;
+
+  if (depth + 1 < path.size()) {
+    ExpressionStmt &stmt = stmts[next++];
+    Completion completion = resumeAfterDeopt(path, depth + 1);
+
+    // the path went into the body of a while, which goes on looping
+    if (stmt.kind == StmtKind::While) {
+      if (completion == Completion::Break)
+        completion = Completion::Normal;
+      else if (completion == Completion::Normal ||
+               completion == Completion::Continue)
+        completion = execWhile(static_cast<WhileStmt &>(*stmt.expr));
+    }
+
+    if (completion != Completion::Normal)
+      return completion;
+  }
+
+  for (; next < stmts.size(); next++) {
+    Completion completion = execStmt(stmts[next]);
+    if (completion != Completion::Normal)
+      return completion;
+  }
+
+  return Completion::Normal;
+}
+
+// Where a compiled loop keeps 'var' between entering and leaving. One it
+// assigns must live where an assignment in the interpreter would store it,
+// not be a global a form's loop reads (and would shadow with a local).
+Value *Evaluator::compiledBinding(Variable &var, bool written) {
+  if (!written)
+    return lookupVariable(var);
+
+  if (!callStack.empty())
+    return callStack.lookup(var.nameId, var.slotHint);
+
+  ModuleState *state = activeModule();
+  auto &vars = state != nullptr ? state->variables : variables;
+  auto found = vars.find(var.name);
+  return found != vars.end() ? &found->second : nullptr;
+}
+
+Completion Evaluator::execFor(ForStmt &node) {
   Value iter = evalExpr(node.iter.get()).setSpan(node.iter->span);
 
-  if (std::holds_alternative<tn_int_t>(iter.v)) {
-    length = std::get<tn_int_t>(iter.v);
-  } else if (std::holds_alternative<std::string>(iter.v)) {
-    length = std::get<std::string>(iter.v).size();
-  } else if (std::holds_alternative<Value::VecT>(iter.v)) {
-    length = std::get<Value::VecT>(iter.v)->size();
-  } else if (std::holds_alternative<Value::DicT>(iter.v)) {
-    dic_it = std::get<Value::DicT>(iter.v)->begin();
-    is_dic = true;
-  }
-
-  while (((is_dic && dic_it != std::get<Value::DicT>(iter.v)->end()) ||
-          (index < length)) &&
-         !break_for_loop) {
-    auto assignLoopVar = [&](Value value) {
-      if (!callStack.empty()) {
-        callStack.back().locals[node.var] = value;
-        return;
-      }
+  // sets have no stable order under mutation, so iterate over a snapshot
+  if (auto setPtr = std::get_if<Value::SetT>(&iter.v))
+    iter = make_vec((*setPtr)->values());
 
-      auto moduleKey = activeModuleKey();
-      if (moduleKey.has_value()) {
-        ModuleState *state = getModuleState(moduleKey.value());
-        if (state != nullptr) {
-          state->variables[node.var] = value;
-          return;
-        }
+  // The loop variable is resolved once: an index into the current frame's
+  // slots (which stays valid while calls in the body push and pop above
+  // it), or a stable pointer into the module's or program's variables.
+  Value *varRef = nullptr;
+  size_t varSlot = 0;
+
+  if (!callStack.empty()) {
+    Value &storage = callStack.define(node.varId, node.varSlotHint);
+    if (node.varSlotHint < callStack.top().count) {
+      varSlot = callStack.top().base + node.varSlotHint;
+    } else {
+      varRef = &storage;
+    }
+  } else if (ModuleState *state = activeModule()) {
+    varRef = &state->variables[node.var];
+  } else {
+    varRef = &variables[node.var];
+  }
+
+  auto loopVar = [&]() -> Value & {
+    return varRef ? *varRef : callStack.slotAt(varSlot).value;
+  };
+
+  InvariantScope invariants(node.invariants);
+  Completion completion = Completion::Normal;
+
+  // runs the body once; false when the loop has to stop
+  auto iterate = [&]() {
+    completion = execBlock(node.stmts);
+    return completion == Completion::Normal ||
+           completion == Completion::Continue;
+  };
+
+  if (auto count = std::get_if<tn_int_t>(&iter.v)) {
+    const tn_int_t n = *count;
+
+    for (tn_int_t i = 0; i < n; i++) {
+      Value &var = loopVar();
+      if (auto current = std::get_if<tn_int_t>(&var.v)) {
+        *current = i;
+      } else {
+        var = Value(i);
       }
 
-      variables[node.var] = value;
-    };
-
-    if (std::holds_alternative<tn_int_t>(iter.v)) {
-      assignLoopVar(Value((tn_int_t)index));
-    } else if (std::holds_alternative<std::string>(iter.v)) {
-      assignLoopVar(
-          Value(std::string(1, std::get<std::string>(iter.v)[index])));
-    } else if (std::holds_alternative<Value::VecT>(iter.v)) {
-      assignLoopVar((*std::get<Value::VecT>(iter.v))[index]);
-    } else if (std::holds_alternative<Value::DicT>(iter.v)) {
-      std::vector<Value> single = {Value(dic_it->first), dic_it->second};
-      assignLoopVar(Value(std::make_shared<Value::VecT::element_type>(single)));
-      dic_it++;
-    }
-
-    for (ExpressionStmt &stmt : node.stmts) {
-      if (stmt.isBreak) {
-        break_for_loop = true;
-        break;
-      } else if (stmt.isContinue) {
+      if (!iterate())
         break;
+    }
+  } else if (auto dicPtr = std::get_if<Value::DicT>(&iter.v)) {
+    // each entry comes as a [key, value] vector; the one from the previous
+    // iteration is refilled unless the body kept a reference to it
+    Value::VecT pair;
+
+    for (auto &[key, value] : **dicPtr) {
+      Value &var = loopVar();
+      auto held = std::get_if<Value::VecT>(&var.v);
+
+      if (pair && held && *held == pair && pair.use_count() == 2) {
+        pair->set(0, Value(key));
+        pair->set(1, value);
+      } else {
+        pair = make_rc<ValueVec>(std::vector<Value>{Value(key), value});
+        var = Value(pair);
       }
 
-      Value res = evalStmt(stmt);
+      if (!iterate())
+        break;
+    }
+  } else if (auto iterPtr = std::get_if<Value::IterT>(&iter.v)) {
+    Value::IterT walk = (*iterPtr)->begin();
+    Value next;
+
+    while (walk->next(next)) {
+      loopVar() = std::move(next);
 
-      if (res.isReturn || res.isExit)
-        return res;
+      if (!iterate())
+        break;
+    }
+  } else {
+    size_t length = 0;
+
+    if (auto strPtr = std::get_if<std::string>(&iter.v)) {
+      length = strPtr->size();
+    } else if (auto vecPtr = std::get_if<Value::VecT>(&iter.v)) {
+      length = (*vecPtr)->size();
+    } else if (auto dequePtr = std::get_if<Value::DequeT>(&iter.v)) {
+      length = (*dequePtr)->size();
     }
 
-    index++;
+    for (size_t index = 0; index < length; index++) {
+      if (auto strPtr = std::get_if<std::string>(&iter.v)) {
+        loopVar() = Value(std::string(1, (*strPtr)[index]));
+      } else if (auto vecPtr = std::get_if<Value::VecT>(&iter.v)) {
+        loopVar() = (**vecPtr)[index];
+      } else {
+        loopVar() = (**std::get_if<Value::DequeT>(&iter.v))[index];
+      }
+
+      if (!iterate())
+        break;
+    }
   }
 
-  return Value();
+  if (completion != Completion::Normal && completion != Completion::Break &&
+      completion != Completion::Continue)
+    return completion;
+
+  completionValue = Value();
+  return Completion::Normal;
 }
 
 // Functions, classes, and modules
 
 Value Evaluator::visit(FunctionStmt &node) {
-  auto moduleKey = activeModuleKey();
-  if (moduleKey.has_value()) {
-    ModuleState *state = getModuleState(moduleKey.value());
-    if (state != nullptr) {
-      state->functions[node.name] = &node;
-      return Value();
-    }
+  if (node.memo && std::find(memoForms.begin(), memoForms.end(), &node) ==
+                       memoForms.end())
+    memoForms.push_back(&node);
+
+  if (!node.jit)
+    node.jit = jit_precompiled_form(filename, node.span.getLineNum(),
+                                    node.span.getStartCol(),
+                                    node.params.size());
+
+  ModuleState *state = activeModule();
+  if (state != nullptr) {
+    state->functions[node.name] = &node;
+    return Value();
   }
 
   functions[node.name] = &node;
   return Value();
 }
 
-Value Evaluator::visit(ReturnStmt &node) {
-  Value v = evalExpr(node.value.get()).setSpan(node.span);
-  v.isReturn = true;
-  return v;
+Completion Evaluator::execReturn(ReturnStmt &node) {
+  // calls in tail position of a form reuse the caller's frame, so tail
+  // recursion runs in constant space
+  if (!callStack.empty() && callStack.top().kind == FrameKind::Form &&
+      enterTailCall(node.value.get()))
+    return Completion::TailCall;
+
+  completionValue = evalExpr(node.value.get()).setSpan(node.span);
+  return Completion::Return;
 }
 
 Value Evaluator::visit(ClassStmt &node) {
-  auto moduleKey = activeModuleKey();
-  if (moduleKey.has_value()) {
-    ModuleState *state = getModuleState(moduleKey.value());
-    if (state != nullptr) {
-      state->classes[node.name] = &node;
-      return Value();
-    }
+  ModuleState *state = activeModule();
+  if (state != nullptr) {
+    state->classes[node.name] = &node;
+    return Value();
   }
 
   classes[node.name] = &node;
@@ -696,39 +1870,33 @@ Value Evaluator::visit(ClassStmt &node) {
 }
 
 Value Evaluator::visit(FunctionCall &node) {
-  std::optional<std::string> moduleKey = activeModuleKey();
-
-  if (moduleKey.has_value()) {
-    const ModuleState *state = getModuleState(moduleKey.value());
-    if (state != nullptr) {
-      auto classIt = state->classes.find(node.name);
-      if (classIt != state->classes.end()) {
-        return instantiateClass(classIt->second, node.params, node.span,
-                                moduleKey.value());
-      }
+  ModuleState *state = activeModule();
 
-      auto fnIt = state->functions.find(node.name);
-      if (fnIt != state->functions.end()) {
-        return executeFunction(fnIt->second, node.params, node.span,
-                               "form " + node.name + "()", moduleKey.value());
-      }
+  if (state != nullptr) {
+    auto classIt = state->classes.find(node.name);
+    if (classIt != state->classes.end()) {
+      return instantiateClass(classIt->second, node.params, node, state);
+    }
 
-      auto nativeIt = state->nativeFunctions.find(node.name);
-      if (nativeIt != state->nativeFunctions.end()) {
-        return callNative(nativeIt->second, node.params);
-      }
+    auto fnIt = state->functions.find(node.name);
+    if (fnIt != state->functions.end()) {
+      return executeFunction(fnIt->second, node.params, node, state);
+    }
+
+    auto nativeIt = state->nativeFunctions.find(node.name);
+    if (nativeIt != state->nativeFunctions.end()) {
+      return callNative(nativeIt->second, node.params);
     }
   }
 
   auto classIt = classes.find(node.name);
   if (classIt != classes.end()) {
-    return instantiateClass(classIt->second, node.params, node.span, "");
+    return instantiateClass(classIt->second, node.params, node, nullptr);
   }
 
   auto fnIt = functions.find(node.name);
   if (fnIt != functions.end()) {
-    return executeFunction(fnIt->second, node.params, node.span,
-                           "form " + node.name + "()", "");
+    return executeFunction(fnIt->second, node.params, node, nullptr);
   }
 
   auto nativeIt = nativeFunctions.find(node.name);
@@ -736,34 +1904,76 @@ Value Evaluator::visit(FunctionCall &node) {
     return callNative(nativeIt->second, node.params);
   }
 
+  // a form or class of the same name takes precedence over the builtin
+  if (node.name == "range")
+    return makeRange(node);
+
   diags.report<Error>("Undefined function: " + node.name, node.span, "",
                       filename);
   exitErrors();
   return Value();
 }
 
+Value Evaluator::makeRange(FunctionCall &node) {
+  std::vector<Value> args;
+  for (const ASTPtr &param : node.params)
+    args.push_back(evalExpr(param.get()));
+
+  if (!checkIntArgs("range([start,] stop[, step])", args, 1, 2, node.span))
+    exitErrors();
+
+  tn_int_t start = 0, stop, step = 1;
+  if (args.size() == 1) {
+    stop = std::get<tn_int_t>(args[0].v);
+  } else {
+    start = std::get<tn_int_t>(args[0].v);
+    stop = std::get<tn_int_t>(args[1].v);
+    if (args.size() == 3)
+      step = std::get<tn_int_t>(args[2].v);
+  }
+
+  if (step == 0) {
+    reportRuntimeError("range step cannot be zero", node.span);
+    exitErrors();
+  }
+
+  return Value(Value::IterT(std::make_shared<RangeIter>(start, stop, step)));
+}
+
+void Evaluator::embedModule(const std::string &name, std::string source) {
+  embeddedModules[name] = std::move(source);
+}
+
 Value Evaluator::visit(LoadStmt &node) {
   const std::string bindingName = moduleBindingNameFor(node.fname);
 
   if (std::filesystem::path(node.fname).extension() == ".tent") {
-    const auto foundFile = checkSearchPathsFor(node.fname, file_search_dirs);
-    if (!foundFile.has_value()) {
-      std::cerr << "File error: could not find file'" << node.fname << "'"
-                << std::endl;
-      exit(1);
-    }
+    // a module built into the executable is known by the name it is loaded
+    // by, and never looked for on disk
+    auto embeddedIt = embeddedModules.find(node.fname);
+    std::string moduleKey = node.fname;
+
+    if (embeddedIt == embeddedModules.end()) {
+      const auto foundFile = checkSearchPathsFor(node.fname, file_search_dirs);
+      if (!foundFile.has_value()) {
+        std::cerr << "File error: could not find file'" << node.fname << "'"
+                  << std::endl;
+        exit(1);
+      }
 
-    const std::filesystem::path foundPath =
-        std::filesystem::path(foundFile.value().first) /
-        foundFile.value().second;
-    std::error_code canonicalErr;
-    std::filesystem::path canonicalPath =
-        std::filesystem::weakly_canonical(foundPath, canonicalErr);
-    if (canonicalErr) {
-      canonicalPath = foundPath.lexically_normal();
+      const std::filesystem::path foundPath =
+          std::filesystem::path(foundFile.value().first) /
+          foundFile.value().second;
+      std::error_code canonicalErr;
+      std::filesystem::path canonicalPath =
+          std::filesystem::weakly_canonical(foundPath, canonicalErr);
+      if (canonicalErr) {
+        canonicalPath = foundPath.lexically_normal();
+      }
+
+      moduleKey = canonicalPath.string();
     }
 
-    const std::string moduleKey = canonicalPath.string();
     auto moduleIt = modules.find(moduleKey);
     if (moduleIt != modules.end()) {
       return bindModuleValue(bindingName, moduleKey, node.span);
@@ -779,16 +1989,21 @@ Value Evaluator::visit(LoadStmt &node) {
 
     {
       ScopedSetMembership loadingGuard(modules_in_progress, moduleKey);
-      ScopedModuleContext scopedModule(module_context_stack, moduleKey);
-      ScopedFilename scopedFile(filename, moduleKey);
+      ScopedModuleContext scopedModule(module_context_stack, &state);
+      ScopedFilename scopedFile(filename, filenameRef, state.key);
 
-      std::ifstream fileHandle(canonicalPath.string());
+      std::string output;
 
-      std::string output, line;
+      if (embeddedIt != embeddedModules.end()) {
+        output = embeddedIt->second;
+      } else {
+        std::ifstream fileHandle(moduleKey);
+        std::string line;
 
-      while (std::getline(fileHandle, line)) {
-        output += line;
-        output.push_back('\n');
+        while (std::getline(fileHandle, line)) {
+          output += line;
+          output.push_back('\n');
+        }
       }
 
       Lexer lexer(output, diags, moduleKey);
@@ -798,11 +2013,19 @@ Value Evaluator::visit(LoadStmt &node) {
       Parser parser(lexer.tokens, diags, moduleKey);
       ASTPtr parsed = parser.parse_program();
       Program *p = static_cast<Program *>(parsed.get());
+      if (!IS_FLAG_SET(NO_OPT)) {
+        optimize_program(*p);
+        hoist_invariants(*p, filename);
+      }
+      if (!IS_FLAG_SET(NO_OPT) && !IS_FLAG_SET(NO_INFER))
+        infer_types(*p);
+      if (IS_FLAG_SET(CLOSURES))
+        compile_closures(*p, closures);
 
       loaded_programs.push_back(std::move(parsed));
 
       for (ExpressionStmt &stmt : p->statements) {
-        evalStmt(stmt);
+        execStmt(stmt);
       }
     }
 
@@ -825,6 +2048,13 @@ Value Evaluator::visit(LoadStmt &node) {
 
     ScopedSetMembership loadingGuard(modules_in_progress, moduleKey);
 
+    // the collector lives in the interpreter, so `gc` has no library
+    if (node.fname == "gc") {
+      registerGcFunctions(state.nativeFunctions);
+      state.initialized = true;
+      return bindModuleValue(bindingName, moduleKey, node.span);
+    }
+
 #if defined(_WIN32) || defined(_WIN64)
     HMODULE handle = LoadLibraryA(("lib" + node.fname).c_str());
     if (!handle)
@@ -883,39 +2113,121 @@ Value Evaluator::visit(LoadStmt &node) {
       exit(1);
     }
 
-    reg(state.nativeFunctions);
-#endif
+    reg(state.nativeFunctions);
+#endif
+
+    nativeLibs.push_back(node.fname);
+    state.initialized = true;
+    return bindModuleValue(bindingName, moduleKey, node.span);
+  }
+}
+
+// Variables and operators
+
+Value *Evaluator::lookupVariable(Variable &var) {
+  if (var.inlineParam != Variable::NOT_INLINED)
+    return &inlineArgs[inlineFrames.back().base + var.inlineParam];
+
+  if (!callStack.empty()) {
+    if (Value *local = callStack.lookup(var.nameId, var.slotHint))
+      return local;
+  }
+
+  ModuleState *state = activeModule();
+  if (state != nullptr) {
+    auto found = state->variables.find(var.name);
+    if (found != state->variables.end()) {
+      return &found->second;
+    }
+  }
+
+  auto found = variables.find(var.name);
+  if (found != variables.end()) {
+    return &found->second;
+  }
+
+  return nullptr;
+}
+
+Value *Evaluator::resolveVariableRef(Variable &var, bool createFallback) {
+  if (Value *found = lookupVariable(var)) {
+    return found;
+  }
+
+  if (!createFallback) {
+    return nullptr;
+  }
+
+  ModuleState *state = activeModule();
+  if (state != nullptr && callStack.empty()) {
+    return &state->variables[var.name];
+  }
+
+  return &variables[var.name];
+}
+
+// The storage of the string variable a string method is called on, when the
+// arguments are only literals and variables: nothing can reassign it while
+// they are evaluated, so the method can act on it without a copy being taken
+// first (it acts on the variable's own storage either way; see evalBinary).
+Value *Evaluator::stringReceiver(BinaryOp &node) {
+  auto var = dynamic_cast<Variable *>(node.left.get());
+  auto fc = dynamic_cast<FunctionCall *>(node.right.get());
+  if (var == nullptr || fc == nullptr)
+    return nullptr;
+
+  for (const ASTPtr &param : fc->params) {
+    if (!reads_only(param.get()))
+      return nullptr;
+  }
+
+  Value *str = lookupVariable(*var);
+  if (str == nullptr || !std::holds_alternative<std::string>(str->v) ||
+      !(nativeMethods["str"].count(fc->name) || strMutators.count(fc->name)))
+    return nullptr;
+
+  return str;
+}
+
+// where `var = ...` stores: a local inside a call, otherwise a module or
+// global variable
+Value &Evaluator::assignTarget(Variable &var) {
+  if (!callStack.empty())
+    return callStack.define(var.nameId, var.slotHint);
 
-    nativeLibs.push_back(node.fname);
-    state.initialized = true;
-    return bindModuleValue(bindingName, moduleKey, node.span);
+  ModuleState *state = activeModule();
+  if (state != nullptr) {
+    return state->variables[var.name];
   }
-}
 
-// Variables and operators
+  return variables[var.name];
+}
 
-Value Evaluator::visit(Variable &node) {
-  if (!callStack.empty()) {
-    auto &frame = callStack.back();
-    auto found = frame.locals.find(node.name);
-    if (found != frame.locals.end()) {
-      return found->second;
-    }
+// `var op= right`, with 'right' already evaluated
+Value Evaluator::compoundAssign(BinaryOp &node, Variable &var,
+                                const Value &right) {
+  Value *target = resolveVariableRef(var, true);
+  if (target == nullptr) {
+    diags.report<SyntaxError>("Undefined variable: " + var.name, var.span, "",
+                              filename);
+    exitErrors();
   }
 
-  auto moduleKey = activeModuleKey();
-  if (moduleKey.has_value()) {
-    ModuleState *state = getModuleState(moduleKey.value());
-    if (state != nullptr) {
-      auto found = state->variables.find(node.name);
-      if (found != state->variables.end()) {
-        return found->second;
-      }
-    }
+  TokenType compoundOp;
+  if (!getCompoundAssignOp(node.op, compoundOp)) {
+    diags.report<SyntaxError>("invalid compound assignment operator: " +
+                                  tokenTypeToString(node.op),
+                              node.span, "", filename);
   }
 
-  if (variables.count(node.name)) {
-    return variables[node.name];
+  *target = evalBinaryOp(*target, right, compoundOp);
+
+  return target->setSpan(node.span);
+}
+
+Value Evaluator::visit(Variable &node) {
+  if (Value *found = lookupVariable(node)) {
+    return *found;
   } else {
     diags.report<SyntaxError>("Undefined variable: " + node.name, node.span, "",
                               filename);
@@ -926,6 +2238,22 @@ Value Evaluator::visit(Variable &node) {
 }
 
 Value Evaluator::visit(UnaryOp &node) {
+  if (node.staticType == StaticType::Int) {
+    tn_int_t result;
+    if (evalRaw(&node, OperandShape::Unary, result)) {
+      inferStats.typed++;
+      return Value(result).setSpan(node.span);
+    }
+    inferStats.fallbacks++;
+  } else if (node.staticType == StaticType::Dec) {
+    tn_dec_t result;
+    if (evalRaw(&node, OperandShape::Unary, result)) {
+      inferStats.typed++;
+      return Value(result).setSpan(node.span);
+    }
+    inferStats.fallbacks++;
+  }
+
   if (node.op != TokenType::INCREMENT && node.op != TokenType::DECREMENT) {
     return evalUnaryOp(evalExpr(node.operand.get()).setSpan(node.operand->span),
                        node.op)
@@ -933,35 +2261,7 @@ Value Evaluator::visit(UnaryOp &node) {
   }
 
   if (auto var = dynamic_cast<Variable *>(node.operand.get())) {
-    Value *target = nullptr;
-
-    if (!callStack.empty()) {
-      auto &frame = callStack.back();
-      auto found = frame.locals.find(var->name);
-      if (found != frame.locals.end()) {
-        target = &found->second;
-      }
-    }
-
-    if (target == nullptr) {
-      auto moduleKey = activeModuleKey();
-      if (moduleKey.has_value()) {
-        ModuleState *state = getModuleState(moduleKey.value());
-        if (state != nullptr) {
-          auto found = state->variables.find(var->name);
-          if (found != state->variables.end()) {
-            target = &found->second;
-          }
-        }
-      }
-    }
-
-    if (target == nullptr) {
-      auto found = variables.find(var->name);
-      if (found != variables.end()) {
-        target = &found->second;
-      }
-    }
+    Value *target = lookupVariable(*var);
 
     if (target == nullptr) {
       diags.report<SyntaxError>("Undefined variable: " + var->name, var->span,
@@ -987,49 +2287,217 @@ Value Evaluator::visit(UnaryOp &node) {
   return Value();
 }
 
-Value Evaluator::visit(BinaryOp &node) {
-  auto resolveVariableRef = [&](const std::string &name,
-                                bool createFallback = false) -> Value * {
-    if (!callStack.empty()) {
-      auto &locals = callStack.back().locals;
-      auto found = locals.find(name);
-      if (found != locals.end()) {
-        return &found->second;
-      }
-    }
+// Evaluates a node type inference marked on raw numbers, reading each
+// variable straight out of its storage. Returns false, with nothing to undo
+// (the marked nodes have no side effects), when a variable holds something
+// other than the type inferred or an operation would fail, for the general
+// path to evaluate (and report) instead.
+template <typename T>
+bool Evaluator::evalRaw(ASTNode *node, OperandShape shape, T &out) {
+  switch (shape) {
+  case OperandShape::Literal:
+    if constexpr (std::is_same_v<T, tn_int_t>)
+      out = static_cast<IntLiteral *>(node)->value;
+    else
+      out = static_cast<FloatLiteral *>(node)->value;
+    return true;
+  case OperandShape::Var: {
+    Value *value = lookupVariable(*static_cast<Variable *>(node));
+    auto raw = value ? std::get_if<T>(&value->v) : nullptr;
+    if (raw == nullptr)
+      return false;
+    out = *raw;
+    return true;
+  }
+  case OperandShape::Unary: {
+    auto &un = static_cast<UnaryOp &>(*node);
+    T operand;
+    if (!evalRaw(un.operand.get(), un.operandShape, operand))
+      return false;
+    if constexpr (std::is_same_v<T, tn_int_t>)
+      out = un.op == TokenType::NEGATE ? -operand : ~operand;
+    else
+      out = -operand;
+    return true;
+  }
+  case OperandShape::Binary: {
+    auto &bin = static_cast<BinaryOp &>(*node);
+    return bin.cache ? evalRawCached(bin, out) : evalRawBinary(bin, out);
+  }
+  }
 
-    auto moduleKey = activeModuleKey();
-    if (moduleKey.has_value()) {
-      ModuleState *state = getModuleState(moduleKey.value());
-      if (state != nullptr) {
-        auto found = state->variables.find(name);
-        if (found != state->variables.end()) {
-          return &found->second;
-        }
+  return false;
+}
 
-        if (createFallback && callStack.empty()) {
-          return &state->variables[name];
-        }
-      }
+// a hoisted or reused operation (see hoist.hpp) under a typed one
+template <typename T>
+bool Evaluator::evalRawCached(BinaryOp &node, T &out) {
+  if (const Value *kept = keptValue(*node.cache)) {
+    if (auto raw = std::get_if<T>(&kept->v)) {
+      reusedValues++;
+      out = *raw;
+      return true;
     }
+  }
+
+  if (!evalRawBinary(node, out))
+    return false;
+
+  ExprCache &cache = *node.cache;
+  if (cache.role != ExprCache::Use) {
+    cache.value = Value(out);
+    cache.valid = true;
+    cache.epoch = cseEpoch;
+  }
+  return true;
+}
+
+template <typename T>
+bool Evaluator::evalRawBinary(BinaryOp &node, T &out) {
+  T a, b;
+  if (!evalRaw(node.left.get(), node.leftShape, a) ||
+      !evalRaw(node.right.get(), node.rightShape, b))
+    return false;
+
+  switch (node.op) {
+  case TokenType::ADD:
+    out = a + b;
+    return true;
+  case TokenType::SUB:
+    out = a - b;
+    return true;
+  case TokenType::MUL:
+    out = a * b;
+    return true;
+  case TokenType::DIV:
+    if (b == 0)
+      return false;
+    out = a / b;
+    return true;
+  default:
+    break;
+  }
 
-    auto foundGlobal = variables.find(name);
-    if (foundGlobal != variables.end()) {
-      return &foundGlobal->second;
+  if constexpr (std::is_same_v<T, tn_int_t>) {
+    switch (node.op) {
+    case TokenType::FLOOR_DIV:
+      if (b == 0)
+        return false;
+      out = a / b;
+      return true;
+    case TokenType::MOD:
+      if (b == 0)
+        return false;
+      out = a % b;
+      return true;
+    case TokenType::BIT_AND:
+      out = a & b;
+      return true;
+    case TokenType::BIT_OR:
+      out = a | b;
+      return true;
+    case TokenType::BIT_XOR:
+      out = a ^ b;
+      return true;
+    default:
+      break;
     }
+  }
+
+  return false;
+}
 
-    if (createFallback) {
-      return &variables[name];
+bool Evaluator::evalTyped(BinaryOp &node, Value &out) {
+  if (node.staticType == StaticType::Int) {
+    tn_int_t result;
+    if (evalRawBinary(node, result)) {
+      inferStats.typed++;
+      out = Value(result);
+      return true;
     }
+  } else {
+    tn_dec_t result;
+    if (evalRawBinary(node, result)) {
+      inferStats.typed++;
+      out = Value(result);
+      return true;
+    }
+  }
 
-    return nullptr;
-  };
+  inferStats.fallbacks++;
+  return false;
+}
+
+// The value kept for a hoisted or reused operation, or null when it has to
+// be evaluated.
+const Value *Evaluator::keptValue(const ExprCache &cache) const {
+  if (cache.role == ExprCache::Use) {
+    const ExprCache &def = *cache.def->cache;
+    return def.valid && def.epoch == cseEpoch ? &def.value : nullptr;
+  }
+
+  return cache.role == ExprCache::Invariant && cache.valid ? &cache.value
+                                                           : nullptr;
+}
+
+void Evaluator::keepValue(BinaryOp &node, const Value &result) {
+  ExprCache &cache = *node.cache;
+  if (cache.role == ExprCache::Use)
+    return;
+
+  // a container is shared, and the operation must make a new one each time
+  bool keep = std::holds_alternative<tn_int_t>(result.v) ||
+              std::holds_alternative<tn_dec_t>(result.v) ||
+              std::holds_alternative<tn_bool_t>(result.v) ||
+              std::holds_alternative<std::string>(result.v);
+
+  // a method of a class instance is the class's own code, not a builtin
+  if (keep && node.op == TokenType::DOT) {
+    Value *receiver = lookupVariable(static_cast<Variable &>(*node.left));
+    keep = receiver != nullptr &&
+           !std::holds_alternative<Value::ClassInstance>(receiver->v) &&
+           !std::holds_alternative<Value::ModuleRef>(receiver->v);
+  }
+
+  cache.valid = keep;
+  if (keep) {
+    cache.value = result;
+    cache.epoch = cseEpoch;
+  }
+}
+
+Value Evaluator::evalCached(BinaryOp &node) {
+  if (const Value *kept = keptValue(*node.cache)) {
+    reusedValues++;
+    return *kept;
+  }
+
+  Value result = evalBinary(node);
+  keepValue(node, result);
+  return result;
+}
+
+Value Evaluator::visit(BinaryOp &node) {
+  if (node.cache)
+    return evalCached(node);
+  return evalBinary(node);
+}
+
+Value Evaluator::evalBinary(BinaryOp &node) {
+  if (node.staticType != StaticType::Unknown) {
+    Value result;
+    if (evalTyped(node, result))
+      return result;
+  }
+
+  if (node.op == TokenType::AND || node.op == TokenType::OR)
+    return evalLogical(node);
 
   if (isRightAssoc(node.op)) {
     if (auto *leftIndex = dynamic_cast<BinaryOp *>(node.left.get())) {
       if (leftIndex->op == TokenType::INDEX && node.op == TokenType::ASSIGN) {
         if (auto *vecVar = dynamic_cast<Variable *>(leftIndex->left.get())) {
-          Value *holder = resolveVariableRef(vecVar->name);
+          Value *holder = resolveVariableRef(*vecVar);
           if (holder == nullptr) {
             diags.report<SyntaxError>("Undefined variable: " + vecVar->name,
                                       vecVar->span, "", filename);
@@ -1057,10 +2525,11 @@ Value Evaluator::visit(BinaryOp &node) {
                                       " is out of bounds for vector of size " +
                                       std::to_string(vecPtr->size()),
                                   vecVar->span, "", filename);
+              return Value();
             }
 
             Value rhs = evalExpr(node.right.get());
-            (*vecPtr)[(size_t)idx] = rhs;
+            vecPtr->set((size_t)idx, rhs);
 
             return rhs;
           } else if (holder != nullptr &&
@@ -1083,6 +2552,40 @@ Value Evaluator::visit(BinaryOp &node) {
 
             Value rhs = evalExpr(node.right.get());
             (*dictPtr)[idx] = rhs;
+
+            return rhs;
+          } else if (holder != nullptr &&
+                     std::holds_alternative<Value::BitsT>(holder->v)) {
+            auto bitsPtr = std::get<Value::BitsT>(holder->v);
+
+            Value idxVal = evalExpr(leftIndex->right.get());
+            if (!std::holds_alternative<tn_int_t>(idxVal.v)) {
+              diags.report<TypeError>("index must be an integer", vecVar->span,
+                                      "", filename);
+              return Value();
+            }
+
+            tn_int_t idx = std::get<tn_int_t>(idxVal.v);
+            if (idx < 0 || (size_t)idx >= bitsPtr->size()) {
+              diags.report<Error>("index " + std::to_string(idx) +
+                                      " is out of bounds for bits of size " +
+                                      std::to_string(bitsPtr->size()),
+                                  vecVar->span, "", filename);
+              return Value();
+            }
+
+            Value rhs = evalExpr(node.right.get());
+            if (auto b = std::get_if<tn_bool_t>(&rhs.v)) {
+              bitsPtr->assign((size_t)idx, *b);
+            } else if (auto i = std::get_if<tn_int_t>(&rhs.v)) {
+              bitsPtr->assign((size_t)idx, *i != 0);
+            } else {
+              diags.report<TypeError>("bits element must be assigned a 'bool' "
+                                      "or 'int'",
+                                      node.right->span, "", filename);
+            }
+
+            return rhs;
           }
         } else {
           diags.report<TypeError>(
@@ -1093,43 +2596,25 @@ Value Evaluator::visit(BinaryOp &node) {
     } else if (auto *varNode = dynamic_cast<Variable *>(node.left.get())) {
       Value right = evalExpr(node.right.get());
 
-      if (node.op == TokenType::ASSIGN) {
-        if (!callStack.empty()) {
-          auto &frame = callStack.back();
-          frame.locals[varNode->name] = right;
-          return right;
-        } else {
-          auto moduleKey = activeModuleKey();
-          if (moduleKey.has_value()) {
-            ModuleState *state = getModuleState(moduleKey.value());
-            if (state != nullptr) {
-              return state->variables[varNode->name] = right;
-            }
-          }
-
-          return variables[varNode->name] = right;
-        }
-      } else {
-        Value *target = resolveVariableRef(varNode->name, true);
-        if (target == nullptr) {
-          diags.report<SyntaxError>("Undefined variable: " + varNode->name,
-                                    varNode->span, "", filename);
-          exitErrors();
-        }
+      if (node.op == TokenType::ASSIGN)
+        return assignTarget(*varNode) = std::move(right);
 
-        TokenType compoundOp;
-        if (!getCompoundAssignOp(node.op, compoundOp)) {
-          diags.report<SyntaxError>("invalid compound assignment operator: " +
-                                        tokenTypeToString(node.op),
-                                    node.span, "", filename);
-        }
+      return compoundAssign(node, *varNode, right);
+    }
+  } else if (node.op == TokenType::DOT) {
+    if (Value *str = stringReceiver(node)) {
+      auto fc = static_cast<FunctionCall *>(node.right.get());
+      std::vector<Value> args;
+      for (auto &param : fc->params)
+        args.push_back(evalExpr(param.get()));
 
-        *target = evalBinaryOp(*target, right, compoundOp);
+      auto mutator = strMutators.find(fc->name);
+      if (mutator != strMutators.end())
+        return mutator->second(*str, args);
 
-        return target->setSpan(node.span);
-      }
+      return nativeMethods["str"][fc->name](*str, args);
     }
-  } else if (node.op == TokenType::DOT) {
+
     Value lhs = evalExpr(node.left.get()).setSpan(node.left->span);
 
     if (auto fc = dynamic_cast<FunctionCall *>(node.right.get())) {
@@ -1145,15 +2630,13 @@ Value Evaluator::visit(BinaryOp &node) {
 
         auto classIt = state->classes.find(name);
         if (classIt != state->classes.end()) {
-          return instantiateClass(classIt->second, fc->params, fc->span,
-                                  module->key);
+          return instantiateClass(classIt->second, fc->params, *fc, state);
         }
 
         auto fnIt = state->functions.find(name);
         if (fnIt != state->functions.end()) {
-          return executeFunction(fnIt->second, fc->params, fc->span,
-                                 "form " + module->name + "." + name + "()",
-                                 module->key);
+          return executeFunction(fnIt->second, fc->params, *fc, state,
+                                 &state->name);
         }
 
         auto nativeIt = state->nativeFunctions.find(name);
@@ -1178,59 +2661,87 @@ Value Evaluator::visit(BinaryOp &node) {
             exitErrors();
           }
 
-          CallFrame frame;
-          frame.callableName = "method " + inst->name + "." + name + "()";
-          frame.callSite = fc->span;
-          frame.callsiteFilename = filename;
-          frame.moduleKey = inst->moduleKey;
-
-          for (auto &[fieldName, fieldVal] : inst->fields) {
-            frame.locals[fieldName] = fieldVal;
-          }
-
-          for (size_t i = 0; i < method->params.size(); i++) {
-            Variable *formalParam =
-                dynamic_cast<Variable *>(method->params[i].get());
-            frame.locals[formalParam->name] = evalExpr(fc->params[i].get());
+          if (!method->hasFrameLayout) {
+            method->frameLayout = frame_layout(method->params, method->stmts);
+            method->hasFrameLayout = true;
           }
 
-          ScopedCallFrame scopedFrame(callStack, std::move(frame));
-          Value result;
-
-          for (ExpressionStmt &stmt : method->stmts) {
-            result = evalStmt(stmt);
+          checkCallDepth(*fc);
 
-            if (result.isReturn) {
-              result.isReturn = false;
+          // a method sees the instance's fields as locals, followed by its
+          // own params and locals
+          ScopedCallFrame scopedFrame(callStack);
+          const size_t base = scopedFrame.slotBase();
 
-              for (auto &[k, v] : callStack.back().locals) {
-                inst->fields[k] = v;
-              }
-
-              return result;
-            }
+          for (auto &[fieldName, fieldVal] : inst->fields) {
+            callStack.addSlot(intern_name(fieldName), fieldVal);
+          }
 
-            if (result.isExit)
-              return result;
+          for (uint32_t slotName : method->frameLayout) {
+            if (callStack.findSlotSince(base, slotName) == callStack.slotTop())
+              callStack.addSlot(slotName);
           }
 
-          for (auto &[k, v] : callStack.back().locals) {
-            inst->fields[k] = v;
+          for (size_t i = 0; i < method->params.size(); i++) {
+            Value arg = evalExpr(fc->params[i].get());
+            Variable *formalParam =
+                static_cast<Variable *>(method->params[i].get());
+            FrameSlot &slot = callStack.slotAt(
+                callStack.findSlotSince(base, formalParam->nameId));
+            slot.value = std::move(arg);
+            slot.defined = true;
           }
 
-          return result;
+          CallFrame frame;
+          frame.kind = FrameKind::Method;
+          frame.callee = method;
+          frame.qualifier = &inst->name;
+          frame.callSite = fc;
+          frame.callsiteFilename = filenameRef;
+          frame.module = inst->moduleKey.empty()
+                             ? nullptr
+                             : getModuleState(inst->moduleKey);
+          scopedFrame.enter(std::move(frame));
+
+          // only locals that were actually bound are written back
+          auto storeFields = [&]() {
+            callStack.forEachLocal([&](uint32_t local, const Value &value) {
+              inst->fields[interned_name(local)] = value;
+            });
+          };
+
+          completionValue = Value();
+
+          if (execBlock(method->stmts) != Completion::Exit)
+            storeFields();
+
+          return std::move(completionValue);
         } else {
           diags.report<TypeError>("Unknown method '" + name + "' for class '" +
                                       inst->name + "'",
                                   fc->span, "", filename);
         }
-      } else if (auto strPtr = std::get_if<std::string>(&lhs.v)) {
-        if (nativeMethods["str"].count(name)) {
+      } else if (std::holds_alternative<std::string>(lhs.v)) {
+        auto mutator = strMutators.find(name);
+        if (nativeMethods["str"].count(name) || mutator != strMutators.end()) {
           std::vector<Value> args;
           for (auto &param : fc->params)
             args.push_back(evalExpr(param.get()));
 
-          return nativeMethods["str"][name](*strPtr, args);
+          // a string held in a variable is handed over as the variable's own
+          // storage, so str.capacity reads it and str.reserve/str.shrink act
+          // on it in place
+          Value *target = nullptr;
+          if (auto var = dynamic_cast<Variable *>(node.left.get()))
+            target = resolveVariableRef(*var);
+          if (target == nullptr ||
+              !std::holds_alternative<std::string>(target->v))
+            target = &lhs;
+
+          if (mutator != strMutators.end())
+            return mutator->second(*target, args);
+
+          return nativeMethods["str"][name](*target, args);
         } else {
           diags.report<TypeError>("Unknown string method: " + name, fc->span,
                                   "", filename);
@@ -1246,6 +2757,44 @@ Value Evaluator::visit(BinaryOp &node) {
           diags.report<TypeError>("Unknown vector method: " + name, fc->span,
                                   "", filename);
         }
+      } else if (std::holds_alternative<Value::DicT>(lhs.v)) {
+        if (nativeMethods["dic"].count(name)) {
+          std::vector<Value> args;
+          for (auto &param : fc->params)
+            args.push_back(evalExpr(param.get()).setSpan(param->span));
+
+          return nativeMethods["dic"][name](lhs, args);
+        } else {
+          diags.report<TypeError>("Unknown dictionary method: " + name,
+                                  fc->span, "", filename);
+        }
+      } else if (std::holds_alternative<Value::BitsT>(lhs.v)) {
+        if (nativeMethods["bits"].count(name)) {
+          std::vector<Value> args;
+          for (auto &param : fc->params)
+            args.push_back(evalExpr(param.get()).setSpan(param->span));
+
+          return nativeMethods["bits"][name](lhs, args);
+        } else {
+          diags.report<TypeError>("Unknown bits method: " + name, fc->span, "",
+                                  filename);
+        }
+      } else if (std::holds_alternative<Value::DequeT>(lhs.v) ||
+                 std::holds_alternative<Value::HeapT>(lhs.v) ||
+                 std::holds_alternative<Value::SetT>(lhs.v)) {
+        const std::string typeName = lhs.getTypeName();
+        auto &methods = nativeMethods[typeName];
+
+        if (methods.count(name)) {
+          std::vector<Value> args;
+          for (auto &param : fc->params)
+            args.push_back(evalExpr(param.get()).setSpan(param->span));
+
+          return methods[name](lhs, args);
+        } else {
+          diags.report<TypeError>("Unknown " + typeName + " method: " + name,
+                                  fc->span, "", filename);
+        }
       } else if (std::get_if<NullLiteral>(&lhs.v)) {
         if (lhs.typeInt) {
           if (nativeMethods["type_int"].count(name)) {
@@ -1263,6 +2812,25 @@ Value Evaluator::visit(BinaryOp &node) {
 
             return nativeMethods["type_vec"][name](Value(), args);
           }
+        } else if (lhs.typeBits) {
+          if (nativeMethods["type_bits"].count(name)) {
+            std::vector<Value> args;
+            for (auto &param : fc->params)
+              args.push_back(evalExpr(param.get()).setSpan(param->span));
+
+            return nativeMethods["type_bits"][name](Value(), args);
+          }
+        } else if (lhs.typeDeque || lhs.typeHeap || lhs.typeSet) {
+          auto &methods = nativeMethods[lhs.typeDeque  ? "type_deque"
+                                        : lhs.typeHeap ? "type_heap"
+                                                       : "type_set"];
+          if (methods.count(name)) {
+            std::vector<Value> args;
+            for (auto &param : fc->params)
+              args.push_back(evalExpr(param.get()).setSpan(param->span));
+
+            return methods[name](Value(), args);
+          }
         }
       } else {
         diags.report<TypeError>("Method call not supported on this type",
@@ -1307,31 +2875,110 @@ Value Evaluator::visit(BinaryOp &node) {
     }
   }
 
+  // Indexing a variable reads the element straight out of its storage
+  // rather than out of a copy (of a whole string, say). The index goes
+  // first, since evaluating it could move that storage.
+  if (node.op == TokenType::INDEX) {
+    if (auto var = dynamic_cast<Variable *>(node.left.get())) {
+      Value index = evalExpr(node.right.get());
+      if (Value *holder = lookupVariable(*var))
+        return evalBinaryOp(*holder, index, node.op);
+
+      return evalBinaryOp(evalExpr(var), index, node.op);
+    }
+  }
+
+  // The same goes for any operator whose operands cannot reassign each
+  // other's variables (`s + "!"`, `a == b`).
+  if (node.readsOnly) {
+    Value leftCopy, rightCopy;
+    return evalBinaryOp(readOperand(node.leftVar, node.left.get(), leftCopy),
+                        readOperand(node.rightVar, node.right.get(), rightCopy),
+                        node.op);
+  }
+
   Value left = evalExpr(node.left.get());
   Value right = evalExpr(node.right.get());
 
-  return evalBinaryOp(std::move(left), std::move(right), node.op);
+  return evalBinaryOp(left, right, node.op);
+}
+
+// the storage of 'var' when the operand 'node' is one, otherwise the
+// operand's value, left in 'copy'
+const Value &Evaluator::readOperand(Variable *var, ASTNode *node,
+                                    Value &copy) {
+  if (var != nullptr) {
+    if (Value *held = lookupVariable(*var))
+      return *held;
+  }
+
+  return copy = evalExpr(node);
 }
 
 // ── Nodes not reached through evalExpr ───────────────────────────────────────
 
 Value Evaluator::visit(Program &node) {
-  Value last;
   for (ExpressionStmt &stmt : node.statements) {
-    last = evalStmt(stmt);
-    if (last.isExit)
+    if (execStmt(stmt) == Completion::Exit)
       break;
   }
-  return last;
+  return std::move(completionValue);
+}
+
+Value Evaluator::visit(ExpressionStmt &node) {
+  execStmt(node);
+  return std::move(completionValue);
+}
+
+// statements run through execStmt; visiting one directly runs it for its
+// value alone
+
+Value Evaluator::visit(IfStmt &node) {
+  execIf(node);
+  return std::move(completionValue);
+}
+
+Value Evaluator::visit(WhileStmt &node) {
+  execWhile(node);
+  return Value();
+}
+
+Value Evaluator::visit(ForStmt &node) {
+  execFor(node);
+  return Value();
+}
+
+Value Evaluator::visit(ReturnStmt &node) {
+  execReturn(node);
+  return std::move(completionValue);
 }
 
-Value Evaluator::visit(ExpressionStmt &node) { return evalStmt(node); }
+Value Evaluator::visit(YieldStmt &node) {
+  reportRuntimeError("yield outside of a form", node.span,
+                     "only the body of a form can yield");
+  exitErrors();
+  return Value();
+}
 
 Value Evaluator::visit(NoOp &) { return Value(); }
 
-Value Evaluator::evalBinaryOp(const Value &left, const Value &right,
-                              TokenType op) {
-  auto visitor = [&op, &left, &right, this](auto l, auto r) -> Value {
+// Binary operators for every pair of value types. Each (left, right) pair
+// of variant alternatives gets its own kernel, stamped out from one template
+// and found through a table indexed by the two tags, so no operand is copied
+// on the way to the operator switch.
+struct BinaryKernels {
+  using Kernel = Value (*)(Evaluator &, const Value &, const Value &,
+                           TokenType);
+  static constexpr size_t TYPES = std::variant_size_v<decltype(Value::v)>;
+  using Table = std::array<std::array<Kernel, TYPES>, TYPES>;
+
+  template <size_t LI, size_t RI>
+  static Value kernel(Evaluator &ev, const Value &left, const Value &right,
+                      TokenType op) {
+    const auto &l = *std::get_if<LI>(&left.v);
+    const auto &r = *std::get_if<RI>(&right.v);
+    Diagnostics &diags = ev.diags;
+    const std::string &filename = ev.filename;
     using L = std::decay_t<decltype(l)>;
     using R = std::decay_t<decltype(r)>;
 
@@ -1351,10 +2998,10 @@ Value Evaluator::evalBinaryOp(const Value &left, const Value &right,
         return Value(l != r);
         break;
       default:
-        reportRuntimeError("invalid operator for string type: " +
-                               tokenTypeToString(op),
-                           Span::combine(left.span, right.span));
-        exitErrors();
+        ev.reportRuntimeError("invalid operator for string type: " +
+                                  tokenTypeToString(op),
+                              Span::combine(left.span, right.span));
+        ev.exitErrors();
       }
     } else if constexpr (std::is_same_v<L, std::string> &&
                          std::is_integral_v<R>) {
@@ -1364,6 +3011,7 @@ Value Evaluator::evalBinaryOp(const Value &left, const Value &right,
           diags.report<Error>("string index out of bounds",
                               Span::combine(left.span, right.span), "",
                               filename);
+          return Value();
         }
 
         return Value(std::string(1, l[(size_t)idx]));
@@ -1416,15 +3064,15 @@ Value Evaluator::evalBinaryOp(const Value &left, const Value &right,
         return a * b;
       case TokenType::DIV:
         if (b == 0) {
-          reportRuntimeError("Division by zero",
-                             Span::combine(left.span, right.span));
-          exitErrors();
+          ev.reportRuntimeError("Division by zero",
+                                Span::combine(left.span, right.span));
+          ev.exitErrors();
         }
         return a / b;
       case TokenType::MOD:
-        return std::fmodf(a, b);
+        return std::fmod(a, b);
       case TokenType::POW:
-        return std::powf(a, b);
+        return std::pow(a, b);
 
       case TokenType::EQEQ:
         return a == b;
@@ -1452,7 +3100,7 @@ Value Evaluator::evalBinaryOp(const Value &left, const Value &right,
                          std::is_integral_v<R>) {
       // op is vector index it just doesn't say so
       assert(op == TokenType::INDEX);
-      auto vecPtr = l;
+      const Value::VecT &vecPtr = l;
 
       if (!vecPtr) {
         diags.report<Error>("null vector", Span::combine(left.span, right.span),
@@ -1466,18 +3114,33 @@ Value Evaluator::evalBinaryOp(const Value &left, const Value &right,
                                 " is out of bounds for vector of size " +
                                 std::to_string(vecPtr->size()),
                             Span::combine(left.span, right.span), "", filename);
+        return Value();
       }
 
       return (*vecPtr)[(size_t)idx];
+    } else if constexpr (std::is_same_v<L, Value::BitsT> &&
+                         std::is_integral_v<R>) {
+      assert(op == TokenType::INDEX);
+      tn_int_t idx = static_cast<tn_int_t>(r);
+
+      if (idx < 0 || (size_t)idx >= l->size()) {
+        diags.report<Error>("index " + std::to_string(idx) +
+                                " is out of bounds for bits of size " +
+                                std::to_string(l->size()),
+                            Span::combine(left.span, right.span), "", filename);
+        return Value();
+      }
+
+      return Value(l->get((size_t)idx));
     } else if constexpr (std::is_same_v<L, Value::DicT> &&
                          std::is_same_v<R, std::string>) {
       assert(op == TokenType::INDEX);
-      Value::DicT dictPtr = l;
+      const Value::DicT &dictPtr = l;
       if (!dictPtr) {
         diags.report<Error>("null dictionary",
                             Span::combine(left.span, right.span), "", filename);
       }
-      std::string idx = static_cast<std::string>(r);
+      const std::string &idx = r;
 
       try {
         return dictPtr->at(idx);
@@ -1492,11 +3155,72 @@ Value Evaluator::evalBinaryOp(const Value &left, const Value &right,
                                 right.getTypeName(),
                             Span::combine(left.span, right.span), "", filename);
 
-    exitErrors();
+    ev.exitErrors();
     return Value();
-  };
+  }
+
+  template <size_t LI, size_t... RIs>
+  static constexpr std::array<Kernel, TYPES> row(std::index_sequence<RIs...>) {
+    return {{&kernel<LI, RIs>...}};
+  }
+
+  template <size_t... LIs>
+  static constexpr Table table(std::index_sequence<LIs...>) {
+    return {{row<LIs>(std::make_index_sequence<TYPES>())...}};
+  }
+};
+
+Value Evaluator::evalBinaryOp(const Value &left, const Value &right,
+                              TokenType op) {
+  // int and float arithmetic, by far the most common, skip the table
+  if (auto a = std::get_if<tn_int_t>(&left.v)) {
+    if (auto b = std::get_if<tn_int_t>(&right.v)) {
+      switch (op) {
+      case TokenType::ADD:
+        return Value(*a + *b);
+      case TokenType::SUB:
+        return Value(*a - *b);
+      case TokenType::MUL:
+        return Value(*a * *b);
+      case TokenType::EQEQ:
+        return Value(*a == *b);
+      case TokenType::NOTEQ:
+        return Value(*a != *b);
+      case TokenType::LESS:
+        return Value(*a < *b);
+      case TokenType::LESSEQ:
+        return Value(*a <= *b);
+      case TokenType::GREATER:
+        return Value(*a > *b);
+      case TokenType::GREATEREQ:
+        return Value(*a >= *b);
+      default:
+        break;
+      }
+    }
+  } else if (auto a = std::get_if<tn_dec_t>(&left.v)) {
+    if (auto b = std::get_if<tn_dec_t>(&right.v)) {
+      switch (op) {
+      case TokenType::ADD:
+        return Value(*a + *b);
+      case TokenType::SUB:
+        return Value(*a - *b);
+      case TokenType::MUL:
+        return Value(*a * *b);
+      case TokenType::LESS:
+        return Value(*a < *b);
+      case TokenType::GREATER:
+        return Value(*a > *b);
+      default:
+        break;
+      }
+    }
+  }
 
-  return Value(std::visit(visitor, left.v, right.v));
+  static constexpr BinaryKernels::Table kernels = BinaryKernels::table(
+      std::make_index_sequence<BinaryKernels::TYPES>());
+
+  return kernels[left.v.index()][right.v.index()](*this, left, right, op);
 }
 
 Value Evaluator::evalUnaryOp(const Value &operand, TokenType op) {
@@ -1526,6 +3250,44 @@ Value Evaluator::evalUnaryOp(const Value &operand, TokenType op) {
   return Value();
 }
 
+void Evaluator::printStats(std::ostream &out) const {
+  static const char *const superNames[] = {"update", "increment",
+                                           "store-index", "compare-branch"};
+
+  out << "superinstructions:\n";
+  for (size_t i = 0; i < superHits.size(); i++)
+    out << "  " << superNames[i] << ": " << superHits[i] << "\n";
+
+  out << "type inference:\n"
+      << "  typed: " << inferStats.typed << "\n"
+      << "  fallbacks: " << inferStats.fallbacks << "\n";
+
+  out << "reused values: " << reusedValues << "\n";
+  out << "deep copies: " << deep_value_copies << "\n";
+
+  out << "gc:\n"
+      << "  collections: " << gc_stats.collections << "\n"
+      << "  freed: " << gc_stats.freed << "\n";
+
+  if (jitEnabled) {
+    out << "jit:\n"
+        << "  compiled loops: " << jitStats.loops << "\n"
+        << "  compiled forms: " << jitStats.forms << "\n"
+        << "  deopts: " << jitStats.deopts << "\n";
+  }
+
+  if (memoForms.empty())
+    return;
+
+  out << "memo:\n";
+  for (const FunctionStmt *func : memoForms) {
+    const MemoCache &memo = *func->memo;
+    out << "  " << func->name << ": " << memo.hits << " hits, " << memo.misses
+        << " misses, " << memo.evictions << " evictions, " << memo.size()
+        << " cached\n";
+  }
+}
+
 void Evaluator::exitErrors() {
   diags.print_errors();
   exit(1);
@@ -0,0 +1,170 @@
+#include "frame.hpp"
+
+#include <algorithm>
+
+#include "ast.hpp"
+#include "names.hpp"
+
+size_t FrameStack::findSlotSince(size_t base, uint32_t name) const {
+  for (size_t i = base; i < slots.size(); i++) {
+    if (slots[i].name == name)
+      return i;
+  }
+
+  return slots.size();
+}
+
+void FrameStack::pushFrame(CallFrame frame) {
+  frame.count = slots.size() - frame.base;
+  frames.push_back(std::move(frame));
+}
+
+void FrameStack::popFrame() {
+  truncate(frames.back().base);
+  frames.pop_back();
+}
+
+void FrameStack::truncate(size_t base) {
+  slots.erase(slots.begin() + base, slots.end());
+}
+
+void FrameStack::replaceTop(size_t argBase) {
+  CallFrame &frame = frames.back();
+  const size_t count = slots.size() - argBase;
+
+  std::move(slots.begin() + argBase, slots.end(), slots.begin() + frame.base);
+  truncate(frame.base + count);
+  frame.count = count;
+  frame.overflow.reset();
+}
+
+Value *FrameStack::lookup(uint32_t name, uint32_t &hint) {
+  CallFrame &frame = frames.back();
+
+  if (hint < frame.count && slots[frame.base + hint].name == name) {
+    FrameSlot &slot = slots[frame.base + hint];
+    return slot.defined ? &slot.value : nullptr;
+  }
+
+  for (size_t i = 0; i < frame.count; i++) {
+    FrameSlot &slot = slots[frame.base + i];
+    if (slot.name == name) {
+      hint = (uint32_t)i;
+      return slot.defined ? &slot.value : nullptr;
+    }
+  }
+
+  if (frame.overflow) {
+    auto found = frame.overflow->find(name);
+    if (found != frame.overflow->end())
+      return &found->second;
+  }
+
+  return nullptr;
+}
+
+Value &FrameStack::define(uint32_t name, uint32_t &hint) {
+  CallFrame &frame = frames.back();
+
+  if (!(hint < frame.count && slots[frame.base + hint].name == name)) {
+    hint = (uint32_t)frame.count;
+    for (size_t i = 0; i < frame.count; i++) {
+      if (slots[frame.base + i].name == name) {
+        hint = (uint32_t)i;
+        break;
+      }
+    }
+  }
+
+  if (hint < frame.count) {
+    FrameSlot &slot = slots[frame.base + hint];
+    slot.defined = true;
+    return slot.value;
+  }
+
+  // a name the layout missed: grow the window if it is still on top,
+  // otherwise (a callee's arguments are being built above it) spill
+  if (frame.base + frame.count == slots.size()) {
+    addSlot(name, Value());
+    frame.count++;
+    return slots.back().value;
+  }
+
+  if (!frame.overflow)
+    frame.overflow = std::make_unique<std::unordered_map<uint32_t, Value>>();
+
+  return (*frame.overflow)[name];
+}
+
+namespace {
+void addName(std::vector<uint32_t> &names, uint32_t name) {
+  if (std::find(names.begin(), names.end(), name) == names.end())
+    names.push_back(name);
+}
+
+void collectNames(ASTNode *node, std::vector<uint32_t> &names);
+
+void collectStmts(const std::vector<ExpressionStmt> &stmts,
+                  std::vector<uint32_t> &names) {
+  for (const ExpressionStmt &stmt : stmts)
+    collectNames(stmt.expr.get(), names);
+}
+
+void collectNames(ASTNode *node, std::vector<uint32_t> &names) {
+  if (node == nullptr)
+    return;
+
+  if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+    if (bin->op == TokenType::ASSIGN) {
+      if (auto var = dynamic_cast<Variable *>(bin->left.get()))
+        addName(names, var->nameId);
+    }
+
+    collectNames(bin->left.get(), names);
+    collectNames(bin->right.get(), names);
+  } else if (auto unary = dynamic_cast<UnaryOp *>(node)) {
+    collectNames(unary->operand.get(), names);
+  } else if (auto ifStmt = dynamic_cast<IfStmt *>(node)) {
+    collectNames(ifStmt->condition.get(), names);
+    collectStmts(ifStmt->thenClauseStmts, names);
+    collectStmts(ifStmt->elseClauseStmts, names);
+  } else if (auto whileStmt = dynamic_cast<WhileStmt *>(node)) {
+    collectNames(whileStmt->condition.get(), names);
+    collectStmts(whileStmt->stmts, names);
+  } else if (auto forStmt = dynamic_cast<ForStmt *>(node)) {
+    addName(names, forStmt->varId);
+    collectNames(forStmt->iter.get(), names);
+    collectStmts(forStmt->stmts, names);
+  } else if (auto call = dynamic_cast<FunctionCall *>(node)) {
+    for (const ASTPtr &param : call->params)
+      collectNames(param.get(), names);
+  } else if (auto ret = dynamic_cast<ReturnStmt *>(node)) {
+    collectNames(ret->value.get(), names);
+  } else if (auto yield = dynamic_cast<YieldStmt *>(node)) {
+    collectNames(yield->value.get(), names);
+  } else if (auto vec = dynamic_cast<VecLiteral *>(node)) {
+    for (const ASTPtr &elem : vec->elems)
+      collectNames(elem.get(), names);
+  } else if (auto dic = dynamic_cast<DicLiteral *>(node)) {
+    for (const auto &[key, value] : dic->dic) {
+      collectNames(key.get(), names);
+      collectNames(value.get(), names);
+    }
+  } else if (auto stmt = dynamic_cast<ExpressionStmt *>(node)) {
+    collectNames(stmt->expr.get(), names);
+  }
+}
+} // namespace
+
+std::vector<uint32_t> frame_layout(const std::vector<ASTPtr> &params,
+                                   const std::vector<ExpressionStmt> &stmts) {
+  std::vector<uint32_t> names;
+
+  for (const ASTPtr &param : params) {
+    if (auto var = dynamic_cast<Variable *>(param.get()))
+      addName(names, var->nameId);
+  }
+
+  collectStmts(stmts, names);
+  return names;
+}
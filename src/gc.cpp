@@ -0,0 +1,152 @@
+#include "gc.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include "args.hpp"
+#include "native.hpp"
+#include "types.hpp"
+
+namespace {
+// the containers 'value' holds directly, or through the fields of an
+// instance (which is held by value)
+template <typename F> void for_each_held(const Value &value, F &&visit) {
+  if (auto vec = std::get_if<Value::VecT>(&value.v)) {
+    if (*vec)
+      visit(vec->get());
+  } else if (auto dic = std::get_if<Value::DicT>(&value.v)) {
+    if (*dic)
+      visit(dic->get());
+  } else if (auto inst = std::get_if<Value::ClassInstance>(&value.v)) {
+    for (const auto &[name, field] : inst->fields)
+      for_each_held(field, visit);
+  }
+}
+} // namespace
+
+class CycleCollector {
+  struct Node {
+    Collectable *object;
+    // references to it from outside the tracked containers
+    int64_t external;
+    bool live = false;
+  };
+
+  std::vector<Node> nodes;
+  std::unordered_map<const Collectable *, size_t> index;
+
+  // the containers 'object' holds; the buffer of a vector is shared by its
+  // slices, so each buffer is only walked for the first of them when
+  // 'buffers' is given
+  template <typename F>
+  static void forEachChild(const Collectable *object, F &&visit,
+                           std::unordered_set<const void *> *buffers) {
+    if (object->kind == Collectable::Kind::Vec) {
+      const auto &elems = static_cast<const ValueVec *>(object)->buffer();
+      if (buffers != nullptr && !buffers->insert(&elems).second)
+        return;
+
+      for (const Value &elem : elems)
+        for_each_held(elem, visit);
+    } else {
+      for (const auto &[key, value] : *static_cast<const ValueDic *>(object))
+        for_each_held(value, visit);
+    }
+  }
+
+public:
+  size_t collect() {
+    for (Collectable *object = gc_objects; object != nullptr;
+         object = object->gcNext) {
+      index[object] = nodes.size();
+      nodes.push_back(Node{object, object->useCount()});
+    }
+
+    // what is left of a count once the references from other containers
+    // are taken out of it
+    std::unordered_set<const void *> buffers;
+    for (Node &node : nodes) {
+      forEachChild(
+          node.object,
+          [&](const Collectable *child) { nodes[index[child]].external--; },
+          &buffers);
+    }
+
+    // A container with no handles at all is not on the heap (a temporary
+    // the interpreter is building), so it counts as held from outside too.
+    std::vector<size_t> work;
+    for (size_t i = 0; i < nodes.size(); i++) {
+      if (nodes[i].external > 0 || nodes[i].object->useCount() == 0) {
+        nodes[i].live = true;
+        work.push_back(i);
+      }
+    }
+
+    while (!work.empty()) {
+      const Collectable *object = nodes[work.back()].object;
+      work.pop_back();
+
+      forEachChild(
+          object,
+          [&](const Collectable *child) {
+            Node &node = nodes[index[child]];
+            if (!node.live) {
+              node.live = true;
+              work.push_back(index[child]);
+            }
+          },
+          nullptr);
+    }
+
+    // Hold on to the garbage while it is emptied, so none of it is freed
+    // while another piece still refers to it; letting go frees it all.
+    std::vector<Value::VecT> vecs;
+    std::vector<Value::DicT> dics;
+    for (const Node &node : nodes) {
+      if (node.live)
+        continue;
+
+      if (node.object->kind == Collectable::Kind::Vec)
+        vecs.emplace_back(static_cast<ValueVec *>(node.object));
+      else
+        dics.emplace_back(static_cast<ValueDic *>(node.object));
+    }
+
+    for (const Value::VecT &vec : vecs)
+      vec->clear();
+    for (const Value::DicT &dic : dics)
+      dic->clear();
+
+    const size_t freed = vecs.size() + dics.size();
+    gc_stats.collections++;
+    gc_stats.freed += freed;
+    gc_allocated = 0;
+    return freed;
+  }
+};
+
+size_t gc_collect() { return CycleCollector().collect(); }
+
+namespace {
+Value gc_collect_fn(const std::vector<Value> &) {
+  return Value(tn_int_t(gc_collect()));
+}
+
+Value gc_stats_fn(const std::vector<Value> &) {
+  auto stats = make_rc<ValueDic>();
+  (*stats)["collections"] = Value(tn_int_t(gc_stats.collections));
+  (*stats)["freed"] = Value(tn_int_t(gc_stats.freed));
+  (*stats)["tracked"] = Value(tn_int_t(gc_tracked));
+  // 0 when only gc.collect() collects, as on the command line
+  (*stats)["threshold"] =
+      Value(tn_int_t(gc_threshold == UINT64_MAX ? 0 : gc_threshold));
+  return Value(stats);
+}
+} // namespace
+
+void registerGcFunctions(std::unordered_map<std::string, NativeFn> &functions) {
+  functions["collect"] = gc_collect_fn;
+  functions["stats"] = gc_stats_fn;
+}
@@ -0,0 +1,811 @@
+#include "hoist.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+#include "args.hpp"
+#include "ast.hpp"
+#include "types.hpp"
+#include "value_string.hpp"
+
+namespace {
+
+// methods of the builtin types that only read their receiver
+const std::unordered_set<std::string> READ_ONLY_METHODS = {
+    "len", "get", "has", "front", "back", "peek", "min", "max", "popcount",
+    "lower_bound", "bsearch", "find_next_set"};
+
+// operators without side effects that a cached result can stand in for
+bool pure_op(TokenType op) {
+  switch (op) {
+  case TokenType::ADD:
+  case TokenType::SUB:
+  case TokenType::MUL:
+  case TokenType::DIV:
+  case TokenType::FLOOR_DIV:
+  case TokenType::MOD:
+  case TokenType::POW:
+  case TokenType::BIT_AND:
+  case TokenType::BIT_OR:
+  case TokenType::BIT_XOR:
+  case TokenType::LSHIFT:
+  case TokenType::RSHIFT:
+  case TokenType::LESS:
+  case TokenType::LESSEQ:
+  case TokenType::GREATER:
+  case TokenType::GREATEREQ:
+  case TokenType::EQEQ:
+  case TokenType::NOTEQ:
+  case TokenType::INDEX:
+    return true;
+  default:
+    return false;
+  }
+}
+
+const char *op_text(TokenType op) {
+  switch (op) {
+  case TokenType::ADD:
+    return "+";
+  case TokenType::SUB:
+  case TokenType::NEGATE:
+    return "-";
+  case TokenType::MUL:
+    return "*";
+  case TokenType::DIV:
+    return "/";
+  case TokenType::FLOOR_DIV:
+    return "//";
+  case TokenType::MOD:
+    return "%";
+  case TokenType::POW:
+    return "**";
+  case TokenType::BIT_AND:
+    return "&";
+  case TokenType::BIT_OR:
+    return "|";
+  case TokenType::BIT_XOR:
+    return "^";
+  case TokenType::BIT_NOT:
+    return "~";
+  case TokenType::NOT:
+    return "!";
+  case TokenType::LSHIFT:
+    return "<<";
+  case TokenType::RSHIFT:
+    return ">>";
+  case TokenType::LESS:
+    return "<";
+  case TokenType::LESSEQ:
+    return "<=";
+  case TokenType::GREATER:
+    return ">";
+  case TokenType::GREATEREQ:
+    return ">=";
+  case TokenType::EQEQ:
+    return "==";
+  case TokenType::NOTEQ:
+    return "!=";
+  default:
+    return "?";
+  }
+}
+
+// 'node' written back out as source, for --explain-opt
+std::string describe(ASTNode *node) {
+  if (auto lit = dynamic_cast<IntLiteral *>(node))
+    return std::to_string(lit->value);
+  if (auto lit = dynamic_cast<FloatLiteral *>(node))
+    return value_to_string(Value(lit->value));
+  if (auto lit = dynamic_cast<StrLiteral *>(node))
+    return value_to_string(Value(lit->value), true);
+  if (auto lit = dynamic_cast<BoolLiteral *>(node))
+    return lit->value ? "true" : "false";
+  if (auto var = dynamic_cast<Variable *>(node))
+    return var->name;
+  if (auto un = dynamic_cast<UnaryOp *>(node))
+    return op_text(un->op) + describe(un->operand.get());
+
+  if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+    auto operand = [](ASTNode *side) {
+      auto inner = dynamic_cast<BinaryOp *>(side);
+      const bool group = inner && inner->op != TokenType::INDEX &&
+                         inner->op != TokenType::DOT;
+      return group ? "(" + describe(side) + ")" : describe(side);
+    };
+
+    if (bin->op == TokenType::INDEX)
+      return operand(bin->left.get()) + "@" + operand(bin->right.get());
+
+    if (bin->op == TokenType::DOT) {
+      auto call = dynamic_cast<FunctionCall *>(bin->right.get());
+      if (call == nullptr)
+        return describe(bin->left.get()) + "." + describe(bin->right.get());
+
+      std::string args;
+      for (const ASTPtr &param : call->params)
+        args += (args.empty() ? "" : ", ") + describe(param.get());
+      return describe(bin->left.get()) + "." + call->name + "(" + args + ")";
+    }
+
+    return operand(bin->left.get()) + " " + op_text(bin->op) + " " +
+           operand(bin->right.get());
+  }
+
+  return "...";
+}
+
+bool same_expr(ASTNode *a, ASTNode *b) {
+  if (auto x = dynamic_cast<IntLiteral *>(a)) {
+    auto y = dynamic_cast<IntLiteral *>(b);
+    return y && x->value == y->value;
+  }
+  if (auto x = dynamic_cast<FloatLiteral *>(a)) {
+    auto y = dynamic_cast<FloatLiteral *>(b);
+    return y && x->value == y->value;
+  }
+  if (auto x = dynamic_cast<StrLiteral *>(a)) {
+    auto y = dynamic_cast<StrLiteral *>(b);
+    return y && x->value == y->value;
+  }
+  if (auto x = dynamic_cast<BoolLiteral *>(a)) {
+    auto y = dynamic_cast<BoolLiteral *>(b);
+    return y && x->value == y->value;
+  }
+  if (auto x = dynamic_cast<Variable *>(a)) {
+    auto y = dynamic_cast<Variable *>(b);
+    return y && x->nameId == y->nameId;
+  }
+  if (auto x = dynamic_cast<UnaryOp *>(a)) {
+    auto y = dynamic_cast<UnaryOp *>(b);
+    return y && x->op == y->op &&
+           same_expr(x->operand.get(), y->operand.get());
+  }
+  if (auto x = dynamic_cast<BinaryOp *>(a)) {
+    auto y = dynamic_cast<BinaryOp *>(b);
+    return y && x->op == y->op && same_expr(x->left.get(), y->left.get()) &&
+           same_expr(x->right.get(), y->right.get());
+  }
+
+  return false;
+}
+
+// Literals, variables and pure operators on them; no calls, methods or
+// assignments. A result cached from one evaluation is good for another as
+// long as none of its variables (nor, with an index, any container) changed.
+bool pure_expr(ASTNode *node) {
+  if (dynamic_cast<IntLiteral *>(node) || dynamic_cast<FloatLiteral *>(node) ||
+      dynamic_cast<StrLiteral *>(node) || dynamic_cast<BoolLiteral *>(node) ||
+      dynamic_cast<Variable *>(node))
+    return true;
+
+  if (auto un = dynamic_cast<UnaryOp *>(node)) {
+    return un->op != TokenType::INCREMENT && un->op != TokenType::DECREMENT &&
+           pure_expr(un->operand.get());
+  }
+
+  if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+    return pure_op(bin->op) && pure_expr(bin->left.get()) &&
+           pure_expr(bin->right.get());
+  }
+
+  return false;
+}
+
+bool reads_name(ASTNode *node, uint32_t name) {
+  if (auto var = dynamic_cast<Variable *>(node))
+    return var->nameId == name;
+  if (auto un = dynamic_cast<UnaryOp *>(node))
+    return reads_name(un->operand.get(), name);
+  if (auto bin = dynamic_cast<BinaryOp *>(node))
+    return reads_name(bin->left.get(), name) ||
+           reads_name(bin->right.get(), name);
+  return false;
+}
+
+bool reads_heap(ASTNode *node) {
+  if (auto un = dynamic_cast<UnaryOp *>(node))
+    return reads_heap(un->operand.get());
+  if (auto bin = dynamic_cast<BinaryOp *>(node))
+    return bin->op == TokenType::INDEX || reads_heap(bin->left.get()) ||
+           reads_heap(bin->right.get());
+  return false;
+}
+
+// what running some code can change
+struct Effects {
+  std::unordered_set<uint32_t> written;
+  // calls a form, a native or a method that may do anything
+  bool calls = false;
+  // may change the contents of a container (any container: they are shared)
+  bool heapWrites = false;
+
+  void call() { calls = heapWrites = true; }
+};
+} // namespace
+
+class Hoister {
+  const std::string &filename;
+  const bool explain;
+
+  // names a form, method or class body assigns, so a call may change them
+  std::unordered_set<uint32_t> formWritten;
+  // a .tent module is loaded, whose forms may change any global
+  bool loadsModules = false;
+  // a for loop may be resuming a generator, which may do anything
+  bool generators = false;
+  // a class has a method named like a read-only one
+  std::unordered_set<std::string> shadowedMethods;
+
+  // names the form being optimized has surely assigned (so made local) by
+  // the time the loop being hoisted runs; null at the top level. Any other
+  // name of the form still reads the global until its first assignment.
+  const std::unordered_set<uint32_t> *assigned = nullptr;
+
+  bool readOnlyMethod(const std::string &name) const {
+    return !loadsModules && READ_ONLY_METHODS.count(name) &&
+           !shadowedMethods.count(name);
+  }
+
+  // what --explain-opt prints, by line and column
+  std::vector<std::tuple<size_t, size_t, std::string>> reports;
+
+  void report(ASTNode *node, const std::string &what) {
+    reports.emplace_back(node->span.getLineNum(), node->span.getStartCol(),
+                         what);
+  }
+
+  void effects(const std::vector<ExpressionStmt> &stmts, Effects &out) {
+    for (const ExpressionStmt &stmt : stmts)
+      effects(stmt.expr.get(), out);
+  }
+
+  void effects(ASTNode *node, Effects &out) {
+    if (node == nullptr)
+      return;
+
+    if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+      if (isRightAssoc(bin->op)) {
+        ASTNode *target = bin->left.get();
+        auto index = dynamic_cast<BinaryOp *>(target);
+
+        if (auto var = dynamic_cast<Variable *>(target)) {
+          out.written.insert(var->nameId);
+        } else if (index && index->op == TokenType::INDEX) {
+          if (auto var = dynamic_cast<Variable *>(index->left.get()))
+            out.written.insert(var->nameId);
+          out.heapWrites = true;
+          effects(index->right.get(), out);
+        } else {
+          out.call();
+          effects(target, out);
+        }
+
+        effects(bin->right.get(), out);
+        return;
+      }
+
+      if (bin->op == TokenType::DOT) {
+        if (auto call = dynamic_cast<FunctionCall *>(bin->right.get())) {
+          if (!readOnlyMethod(call->name)) {
+            // string methods may change the variable they are called on
+            if (auto var = dynamic_cast<Variable *>(bin->left.get()))
+              out.written.insert(var->nameId);
+            out.call();
+          }
+
+          for (const ASTPtr &param : call->params)
+            effects(param.get(), out);
+        }
+
+        effects(bin->left.get(), out);
+        return;
+      }
+
+      effects(bin->left.get(), out);
+      effects(bin->right.get(), out);
+    } else if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      if (un->op == TokenType::INCREMENT || un->op == TokenType::DECREMENT) {
+        if (auto var = dynamic_cast<Variable *>(un->operand.get()))
+          out.written.insert(var->nameId);
+      }
+      effects(un->operand.get(), out);
+    } else if (auto call = dynamic_cast<FunctionCall *>(node)) {
+      out.call();
+      for (const ASTPtr &param : call->params)
+        effects(param.get(), out);
+    } else if (auto vec = dynamic_cast<VecLiteral *>(node)) {
+      for (const ASTPtr &elem : vec->elems)
+        effects(elem.get(), out);
+    } else if (auto dic = dynamic_cast<DicLiteral *>(node)) {
+      for (const auto &[key, value] : dic->dic) {
+        effects(key.get(), out);
+        effects(value.get(), out);
+      }
+    } else if (auto ifStmt = dynamic_cast<IfStmt *>(node)) {
+      effects(ifStmt->condition.get(), out);
+      effects(ifStmt->thenClauseStmts, out);
+      effects(ifStmt->elseClauseStmts, out);
+    } else if (auto whileStmt = dynamic_cast<WhileStmt *>(node)) {
+      effects(whileStmt->condition.get(), out);
+      effects(whileStmt->stmts, out);
+    } else if (auto forStmt = dynamic_cast<ForStmt *>(node)) {
+      out.written.insert(forStmt->varId);
+      if (generators)
+        out.call();
+      effects(forStmt->iter.get(), out);
+      effects(forStmt->stmts, out);
+    } else if (auto ret = dynamic_cast<ReturnStmt *>(node)) {
+      effects(ret->value.get(), out);
+    } else if (auto yield = dynamic_cast<YieldStmt *>(node)) {
+      effects(yield->value.get(), out);
+    } else if (dynamic_cast<FunctionStmt *>(node) ||
+               dynamic_cast<ClassStmt *>(node) ||
+               dynamic_cast<LoadStmt *>(node)) {
+      out.call();
+    }
+  }
+
+  // finds the forms, classes and loads anywhere in 'stmts'
+  void survey(std::vector<ExpressionStmt> &stmts) {
+    for (ExpressionStmt &stmt : stmts) {
+      ASTNode *node = stmt.expr.get();
+      Effects written;
+
+      if (auto func = dynamic_cast<FunctionStmt *>(node)) {
+        generators = generators || func->isGenerator;
+        effects(func->stmts, written);
+        survey(func->stmts);
+      } else if (auto cls = dynamic_cast<ClassStmt *>(node)) {
+        for (ExpressionStmt &member : cls->stmts) {
+          if (auto method = dynamic_cast<FunctionStmt *>(member.expr.get())) {
+            shadowedMethods.insert(method->name);
+            effects(method->stmts, written);
+            survey(method->stmts);
+          } else {
+            effects(member.expr.get(), written);
+          }
+        }
+      } else if (auto load = dynamic_cast<LoadStmt *>(node)) {
+        if (std::filesystem::path(load->fname).extension() == ".tent")
+          loadsModules = true;
+      } else if (auto ifStmt = dynamic_cast<IfStmt *>(node)) {
+        survey(ifStmt->thenClauseStmts);
+        survey(ifStmt->elseClauseStmts);
+      } else if (auto whileStmt = dynamic_cast<WhileStmt *>(node)) {
+        survey(whileStmt->stmts);
+      } else if (auto forStmt = dynamic_cast<ForStmt *>(node)) {
+        survey(forStmt->stmts);
+      }
+
+      formWritten.insert(written.written.begin(), written.written.end());
+    }
+  }
+
+  // whether a call could change 'name' here: a global some form assigns
+  bool callMayChange(uint32_t name) const {
+    if (assigned != nullptr && assigned->count(name))
+      return false;
+    return loadsModules || formWritten.count(name);
+  }
+
+  // Whether 'node' gives the same value every time a loop with 'loop' as
+  // its effects evaluates it.
+  bool invariant(ASTNode *node, const Effects &loop) const {
+    if (dynamic_cast<IntLiteral *>(node) || dynamic_cast<FloatLiteral *>(node) ||
+        dynamic_cast<StrLiteral *>(node) || dynamic_cast<BoolLiteral *>(node))
+      return true;
+
+    if (auto var = dynamic_cast<Variable *>(node)) {
+      return !loop.written.count(var->nameId) &&
+             !(loop.calls && callMayChange(var->nameId));
+    }
+
+    if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      return un->op != TokenType::INCREMENT && un->op != TokenType::DECREMENT &&
+             invariant(un->operand.get(), loop);
+    }
+
+    auto bin = dynamic_cast<BinaryOp *>(node);
+    if (bin == nullptr)
+      return false;
+
+    if (bin->op == TokenType::DOT) {
+      auto call = dynamic_cast<FunctionCall *>(bin->right.get());
+      if (call == nullptr || loop.heapWrites || !readOnlyMethod(call->name) ||
+          !dynamic_cast<Variable *>(bin->left.get()) ||
+          !invariant(bin->left.get(), loop))
+        return false;
+
+      for (const ASTPtr &param : call->params) {
+        if (!invariant(param.get(), loop))
+          return false;
+      }
+      return true;
+    }
+
+    if (bin->op == TokenType::INDEX && loop.heapWrites)
+      return false;
+
+    return pure_op(bin->op) && invariant(bin->left.get(), loop) &&
+           invariant(bin->right.get(), loop);
+  }
+
+  // Loop-invariant code motion
+
+  struct Loop {
+    Effects effects;
+    std::vector<BinaryOp *> &invariants;
+    size_t line;
+  };
+
+  void hoistIn(std::vector<ExpressionStmt> &stmts, Loop &loop) {
+    for (ExpressionStmt &stmt : stmts) {
+      switch (stmt.kind) {
+      case StmtKind::Fused:
+        hoistIn(stmt.fused.index, loop);
+        hoistIn(stmt.fused.operand, loop);
+        break;
+      case StmtKind::If: {
+        auto ifStmt = static_cast<IfStmt *>(stmt.expr.get());
+        hoistIn(*ifStmt->test, loop);
+        hoistIn(ifStmt->thenClauseStmts, loop);
+        hoistIn(ifStmt->elseClauseStmts, loop);
+        break;
+      }
+      case StmtKind::While:
+        // its condition and body belong to it
+        break;
+      case StmtKind::For:
+        hoistIn(static_cast<ForStmt *>(stmt.expr.get())->iter.get(), loop);
+        break;
+      case StmtKind::Return:
+        hoistIn(static_cast<ReturnStmt *>(stmt.expr.get())->value.get(), loop);
+        break;
+      case StmtKind::Yield:
+        hoistIn(static_cast<YieldStmt *>(stmt.expr.get())->value.get(), loop);
+        break;
+      default:
+        hoistIn(stmt.expr.get(), loop);
+        break;
+      }
+    }
+  }
+
+  // the nodes a Condition evaluates are its operands, not the comparison or
+  // && that holds them
+  void hoistIn(Condition &cond, Loop &loop) {
+    if (cond.kind == Condition::Compare || cond.kind == Condition::Expr) {
+      hoistIn(cond.expr, loop);
+      hoistIn(cond.rhs, loop);
+    }
+    if (cond.left)
+      hoistIn(*cond.left, loop);
+    if (cond.right)
+      hoistIn(*cond.right, loop);
+  }
+
+  void hoistIn(ASTNode *node, Loop &loop) {
+    if (node == nullptr)
+      return;
+
+    if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+      if (isRightAssoc(bin->op)) {
+        // a target is stored to, not evaluated, but an index into it is
+        auto index = dynamic_cast<BinaryOp *>(bin->left.get());
+        if (index && index->op == TokenType::INDEX)
+          hoistIn(index->right.get(), loop);
+        hoistIn(bin->right.get(), loop);
+        return;
+      }
+
+      if (bin->cache == nullptr && bin->op != TokenType::AND &&
+          bin->op != TokenType::OR && invariant(bin, loop.effects)) {
+        bin->cache = std::make_unique<ExprCache>();
+        loop.invariants.push_back(bin);
+        if (explain)
+          report(bin, "hoisted `" + describe(bin) +
+                          "` out of the loop on line " +
+                          std::to_string(loop.line));
+        return;
+      }
+
+      if (bin->op == TokenType::DOT) {
+        hoistIn(bin->left.get(), loop);
+        if (auto call = dynamic_cast<FunctionCall *>(bin->right.get())) {
+          for (ASTPtr &param : call->params)
+            hoistIn(param.get(), loop);
+        }
+        return;
+      }
+
+      hoistIn(bin->left.get(), loop);
+      hoistIn(bin->right.get(), loop);
+    } else if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      hoistIn(un->operand.get(), loop);
+    } else if (auto call = dynamic_cast<FunctionCall *>(node)) {
+      for (ASTPtr &param : call->params)
+        hoistIn(param.get(), loop);
+    } else if (auto vec = dynamic_cast<VecLiteral *>(node)) {
+      for (ASTPtr &elem : vec->elems)
+        hoistIn(elem.get(), loop);
+    } else if (auto dic = dynamic_cast<DicLiteral *>(node)) {
+      for (auto &[key, value] : dic->dic) {
+        hoistIn(key.get(), loop);
+        hoistIn(value.get(), loop);
+      }
+    }
+  }
+
+  // the loops in 'stmts', innermost first, so an operation goes to the
+  // innermost loop it is invariant in. 'definite' holds the names surely
+  // assigned before 'stmts' runs, or is null at the top level.
+  void hoistLoops(std::vector<ExpressionStmt> &stmts,
+                  const std::unordered_set<uint32_t> *definite) {
+    std::unordered_set<uint32_t> block;
+    if (definite != nullptr)
+      block = *definite;
+    const std::unordered_set<uint32_t> *here =
+        definite != nullptr ? &block : nullptr;
+
+    for (ExpressionStmt &stmt : stmts) {
+      if (stmt.kind == StmtKind::If) {
+        auto ifStmt = static_cast<IfStmt *>(stmt.expr.get());
+        hoistLoops(ifStmt->thenClauseStmts, here);
+        hoistLoops(ifStmt->elseClauseStmts, here);
+      } else if (stmt.kind == StmtKind::While) {
+        auto whileStmt = static_cast<WhileStmt *>(stmt.expr.get());
+        hoistLoops(whileStmt->stmts, here);
+
+        Loop loop{{}, whileStmt->invariants, whileStmt->span.getLineNum()};
+        effects(whileStmt->condition.get(), loop.effects);
+        effects(whileStmt->stmts, loop.effects);
+        assigned = here;
+        hoistIn(*whileStmt->test, loop);
+        hoistIn(whileStmt->stmts, loop);
+      } else if (stmt.kind == StmtKind::For) {
+        auto forStmt = static_cast<ForStmt *>(stmt.expr.get());
+        if (here != nullptr) {
+          std::unordered_set<uint32_t> body = block;
+          body.insert(forStmt->varId);
+          hoistLoops(forStmt->stmts, &body);
+        } else {
+          hoistLoops(forStmt->stmts, nullptr);
+        }
+
+        Loop loop{{}, forStmt->invariants, forStmt->span.getLineNum()};
+        loop.effects.written.insert(forStmt->varId);
+        if (generators)
+          loop.effects.call();
+        effects(forStmt->stmts, loop.effects);
+        assigned = here;
+        hoistIn(forStmt->stmts, loop);
+      } else if (here != nullptr &&
+                 (stmt.kind == StmtKind::Expr ||
+                  stmt.kind == StmtKind::Fused)) {
+        // a name is local from its first assignment in the form on
+        auto assign = dynamic_cast<BinaryOp *>(stmt.expr.get());
+        if (assign && isRightAssoc(assign->op)) {
+          if (auto var = dynamic_cast<Variable *>(assign->left.get()))
+            block.insert(var->nameId);
+        }
+      }
+    }
+  }
+
+  // Common-subexpression elimination
+
+  // Looks through 'node', evaluated after everything in 'available', for
+  // operations repeating one of them. Those it passes that will surely be
+  // evaluated ('define') become available to the ones after.
+  void reuseIn(ASTNode *node, std::vector<BinaryOp *> &available,
+               bool define) {
+    if (node == nullptr)
+      return;
+
+    if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+      // a hoisted operation's operands are only evaluated in its first
+      // iteration
+      if (bin->cache != nullptr)
+        return;
+
+      if (pure_op(bin->op) && pure_expr(bin)) {
+        for (BinaryOp *def : available) {
+          if (!same_expr(def, bin))
+            continue;
+
+          if (def->cache == nullptr) {
+            def->cache = std::make_unique<ExprCache>();
+            def->cache->role = ExprCache::Def;
+          }
+          bin->cache = std::make_unique<ExprCache>();
+          bin->cache->role = ExprCache::Use;
+          bin->cache->def = def;
+
+          if (explain)
+            report(bin, "reused `" + describe(bin) + "` from line " +
+                            std::to_string(def->span.getLineNum()) + ":" +
+                            std::to_string(def->span.getStartCol()));
+          return;
+        }
+
+        reuseIn(bin->left.get(), available, define);
+        reuseIn(bin->right.get(), available, define);
+        if (define)
+          available.push_back(bin);
+        return;
+      }
+
+      const bool shortCircuit =
+          bin->op == TokenType::AND || bin->op == TokenType::OR;
+      reuseIn(bin->left.get(), available, define);
+      reuseIn(bin->right.get(), available, define && !shortCircuit);
+    } else if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      reuseIn(un->operand.get(), available, define);
+    } else if (auto vec = dynamic_cast<VecLiteral *>(node)) {
+      for (ASTPtr &elem : vec->elems)
+        reuseIn(elem.get(), available, define);
+    }
+  }
+
+  // Runs of plain statements in 'stmts' and the blocks nested in them. An
+  // if, loop or call ends a run: a call might run this same block again
+  // (recursively) between an operation and its reuse.
+  void reuseBlocks(std::vector<ExpressionStmt> &stmts) {
+    std::vector<BinaryOp *> available;
+
+    for (ExpressionStmt &stmt : stmts) {
+      ASTNode *expr = stmt.expr.get();
+
+      switch (stmt.kind) {
+      case StmtKind::If: {
+        auto ifStmt = static_cast<IfStmt *>(expr);
+        reuseBlocks(ifStmt->thenClauseStmts);
+        reuseBlocks(ifStmt->elseClauseStmts);
+        available.clear();
+        continue;
+      }
+      case StmtKind::While:
+        reuseBlocks(static_cast<WhileStmt *>(expr)->stmts);
+        available.clear();
+        continue;
+      case StmtKind::For:
+        reuseBlocks(static_cast<ForStmt *>(expr)->stmts);
+        available.clear();
+        continue;
+      case StmtKind::Return:
+        expr = static_cast<ReturnStmt *>(expr)->value.get();
+        break;
+      case StmtKind::Expr:
+      case StmtKind::Fused:
+        break;
+      default:
+        available.clear();
+        continue;
+      }
+
+      // the one store allowed is the statement's own, after its operands
+      auto assign = dynamic_cast<BinaryOp *>(expr);
+      if (assign && !isRightAssoc(assign->op))
+        assign = nullptr;
+
+      Variable *target = nullptr;
+      ASTNode *index = nullptr;
+      Effects operands;
+
+      if (assign) {
+        target = dynamic_cast<Variable *>(assign->left.get());
+        auto indexed = dynamic_cast<BinaryOp *>(assign->left.get());
+        if (indexed && indexed->op == TokenType::INDEX) {
+          target = dynamic_cast<Variable *>(indexed->left.get());
+          index = indexed->right.get();
+          effects(index, operands);
+        }
+        effects(assign->right.get(), operands);
+      } else {
+        effects(expr, operands);
+      }
+
+      if ((assign && target == nullptr) || operands.calls ||
+          operands.heapWrites || !operands.written.empty()) {
+        available.clear();
+        continue;
+      }
+
+      if (assign) {
+        reuseIn(index, available, true);
+        reuseIn(assign->right.get(), available, true);
+      } else {
+        reuseIn(expr, available, true);
+      }
+
+      if (stmt.kind == StmtKind::Return) {
+        available.clear();
+        continue;
+      }
+
+      if (target != nullptr) {
+        const uint32_t name = target->nameId;
+        const bool heap = index != nullptr;
+        available.erase(std::remove_if(available.begin(), available.end(),
+                                       [&](BinaryOp *def) {
+                                         return reads_name(def, name) ||
+                                                (heap && reads_heap(def));
+                                       }),
+                        available.end());
+      }
+    }
+  }
+
+  // a form's body (or the program's top level, with no parameters)
+  void optimizeBody(std::vector<ExpressionStmt> &stmts,
+                    const std::unordered_set<uint32_t> *params) {
+    const std::unordered_set<uint32_t> *outer = assigned;
+    hoistLoops(stmts, params);
+    reuseBlocks(stmts);
+    assigned = outer;
+
+    forEachForm(stmts);
+  }
+
+  void optimizeForm(const std::vector<ASTPtr> &params,
+                    std::vector<ExpressionStmt> &stmts) {
+    std::unordered_set<uint32_t> paramNames;
+    for (const ASTPtr &param : params) {
+      if (auto var = dynamic_cast<Variable *>(param.get()))
+        paramNames.insert(var->nameId);
+    }
+    optimizeBody(stmts, &paramNames);
+  }
+
+  // the forms and classes defined in 'stmts', at any depth
+  void forEachForm(std::vector<ExpressionStmt> &stmts) {
+    for (ExpressionStmt &stmt : stmts) {
+      ASTNode *node = stmt.expr.get();
+
+      if (auto func = dynamic_cast<FunctionStmt *>(node)) {
+        // a generator's loops are stepped outside execWhile and execFor,
+        // and it may be suspended between an operation and its reuse
+        if (!func->isGenerator)
+          optimizeForm(func->params, func->stmts);
+      } else if (auto cls = dynamic_cast<ClassStmt *>(node)) {
+        // its methods are found in its body
+        optimizeForm(cls->params, cls->stmts);
+      } else if (auto ifStmt = dynamic_cast<IfStmt *>(node)) {
+        forEachForm(ifStmt->thenClauseStmts);
+        forEachForm(ifStmt->elseClauseStmts);
+      } else if (auto whileStmt = dynamic_cast<WhileStmt *>(node)) {
+        forEachForm(whileStmt->stmts);
+      } else if (auto forStmt = dynamic_cast<ForStmt *>(node)) {
+        forEachForm(forStmt->stmts);
+      }
+    }
+  }
+
+public:
+  Hoister(const std::string &file)
+      : filename(file), explain(IS_FLAG_SET(EXPLAIN_OPT)) {}
+
+  void run(Program &program) {
+    // again once every class and load is known, since they decide which
+    // method calls count as writes
+    survey(program.statements);
+    survey(program.statements);
+    optimizeBody(program.statements, nullptr);
+
+    std::sort(reports.begin(), reports.end());
+    for (const auto &[line, column, what] : reports)
+      std::cerr << filename << ":" << line << ":" << column << ": " << what
+                << "\n";
+  }
+};
+
+void hoist_invariants(Program &program, const std::string &filename) {
+  Hoister(filename).run(program);
+}
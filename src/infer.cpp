@@ -0,0 +1,548 @@
+#include "infer.hpp"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.hpp"
+#include "types.hpp"
+
+namespace {
+
+// what a variable may hold at some point: nothing yet, only ints, only
+// floats, or anything at all
+enum class Inferred : uint8_t { None, Int, Dec, Any };
+
+Inferred join_types(Inferred a, Inferred b) {
+  if (a == b || b == Inferred::None)
+    return a;
+  if (a == Inferred::None)
+    return b;
+  return Inferred::Any;
+}
+
+struct Env {
+  std::unordered_map<uint32_t, Inferred> vars;
+  // no path gets here: it follows a return, break or continue
+  bool dead = false;
+
+  Inferred get(uint32_t name) const {
+    auto found = vars.find(name);
+    return found == vars.end() ? Inferred::None : found->second;
+  }
+
+  // where control flow from 'other' meets this
+  void join(const Env &other) {
+    if (other.dead)
+      return;
+    if (dead) {
+      *this = other;
+      return;
+    }
+
+    for (const auto &[name, type] : other.vars)
+      vars[name] = join_types(get(name), type);
+  }
+
+  bool operator==(const Env &other) const {
+    return dead == other.dead && vars == other.vars;
+  }
+};
+
+// the type arithmetic on an 'l' and an 'r' gives, as the evaluator does it
+Inferred arith(TokenType op, Inferred l, Inferred r) {
+  if (l == Inferred::Int && r == Inferred::Int) {
+    switch (op) {
+    case TokenType::ADD:
+    case TokenType::SUB:
+    case TokenType::MUL:
+    case TokenType::DIV:
+    case TokenType::FLOOR_DIV:
+    case TokenType::MOD:
+    case TokenType::POW:
+    case TokenType::BIT_AND:
+    case TokenType::BIT_OR:
+    case TokenType::BIT_XOR:
+    case TokenType::LSHIFT:
+    case TokenType::RSHIFT:
+      return Inferred::Int;
+    default:
+      return Inferred::Any;
+    }
+  }
+
+  const bool numbers = (l == Inferred::Int || l == Inferred::Dec) &&
+                       (r == Inferred::Int || r == Inferred::Dec);
+  if (numbers) {
+    switch (op) {
+    case TokenType::ADD:
+    case TokenType::SUB:
+    case TokenType::MUL:
+    case TokenType::DIV:
+    case TokenType::MOD:
+    case TokenType::POW:
+      return Inferred::Dec;
+    default:
+      return Inferred::Any;
+    }
+  }
+
+  return Inferred::Any;
+}
+
+// the operators the evaluator works out on raw numbers of type 't'
+bool raw_op(TokenType op, Inferred t) {
+  switch (op) {
+  case TokenType::ADD:
+  case TokenType::SUB:
+  case TokenType::MUL:
+  case TokenType::DIV:
+    return true;
+  case TokenType::FLOOR_DIV:
+  case TokenType::MOD:
+  case TokenType::BIT_AND:
+  case TokenType::BIT_OR:
+  case TokenType::BIT_XOR:
+    return t == Inferred::Int;
+  default:
+    return false;
+  }
+}
+
+StaticType static_type(Inferred t) {
+  return t == Inferred::Int   ? StaticType::Int
+         : t == Inferred::Dec ? StaticType::Dec
+                              : StaticType::Unknown;
+}
+
+// calls 'fn' on every node under 'node', statements and all
+void each_node(ASTNode *node, const std::function<void(ASTNode *)> &fn);
+
+void each_node(std::vector<ExpressionStmt> &stmts,
+               const std::function<void(ASTNode *)> &fn) {
+  for (ExpressionStmt &stmt : stmts)
+    each_node(stmt.expr.get(), fn);
+}
+
+void each_node(ASTNode *node, const std::function<void(ASTNode *)> &fn) {
+  if (node == nullptr)
+    return;
+  fn(node);
+
+  if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+    each_node(bin->left.get(), fn);
+    each_node(bin->right.get(), fn);
+  } else if (auto un = dynamic_cast<UnaryOp *>(node)) {
+    each_node(un->operand.get(), fn);
+  } else if (auto call = dynamic_cast<FunctionCall *>(node)) {
+    for (ASTPtr &param : call->params)
+      each_node(param.get(), fn);
+  } else if (auto vec = dynamic_cast<VecLiteral *>(node)) {
+    for (ASTPtr &elem : vec->elems)
+      each_node(elem.get(), fn);
+  } else if (auto ifStmt = dynamic_cast<IfStmt *>(node)) {
+    each_node(ifStmt->condition.get(), fn);
+    each_node(ifStmt->thenClauseStmts, fn);
+    each_node(ifStmt->elseClauseStmts, fn);
+  } else if (auto whileStmt = dynamic_cast<WhileStmt *>(node)) {
+    each_node(whileStmt->condition.get(), fn);
+    each_node(whileStmt->stmts, fn);
+  } else if (auto forStmt = dynamic_cast<ForStmt *>(node)) {
+    each_node(forStmt->iter.get(), fn);
+    each_node(forStmt->stmts, fn);
+  } else if (auto ret = dynamic_cast<ReturnStmt *>(node)) {
+    each_node(ret->value.get(), fn);
+  } else if (auto yield = dynamic_cast<YieldStmt *>(node)) {
+    each_node(yield->value.get(), fn);
+  } else if (auto func = dynamic_cast<FunctionStmt *>(node)) {
+    each_node(func->stmts, fn);
+  } else if (auto cls = dynamic_cast<ClassStmt *>(node)) {
+    each_node(cls->stmts, fn);
+  }
+}
+
+using ParamTypes = std::unordered_map<std::string, std::vector<Inferred>>;
+
+// One pass over a program under assumed types for the forms' parameters,
+// marking nodes as it goes and collecting the argument types of the calls
+// it sees.
+class Inference {
+  const ParamTypes &assumed;
+  // names a form may change in place (x++, x += e), which may be globals:
+  // a call at the top level could change them
+  const std::unordered_set<uint32_t> &changedByForms;
+  bool topLevel = true;
+
+  struct Loop {
+    Env breaks;
+    Env continues;
+  };
+  std::vector<Loop> loops;
+
+  // an expression's type, and whether the evaluator can work it out on raw
+  // numbers (then 'shape' says how)
+  struct Typed {
+    Inferred type = Inferred::Any;
+    bool raw = false;
+    OperandShape shape = OperandShape::Literal;
+  };
+
+  void assign(Env &env, Variable &var, Inferred type) {
+    env.vars[var.nameId] = type == Inferred::None ? Inferred::Any : type;
+  }
+
+  void afterCall(Env &env) {
+    if (!topLevel)
+      return;
+    for (uint32_t name : changedByForms) {
+      if (env.vars.count(name))
+        env.vars[name] = Inferred::Any;
+    }
+  }
+
+  Typed call(FunctionCall &call, Env &env, bool byName) {
+    std::vector<Inferred> args;
+    for (ASTPtr &param : call.params)
+      args.push_back(expr(param.get(), env).type);
+
+    auto form = byName ? assumed.find(call.name) : assumed.end();
+    if (form != assumed.end() && form->second.size() == args.size()) {
+      std::vector<Inferred> &types = seenArgs[call.name];
+      types.resize(args.size(), Inferred::None);
+      for (size_t i = 0; i < args.size(); i++)
+        types[i] = join_types(types[i], args[i]);
+    }
+
+    afterCall(env);
+    return Typed();
+  }
+
+  Typed binary(BinaryOp &bin, Env &env) {
+    bin.staticType = StaticType::Unknown;
+    auto var = dynamic_cast<Variable *>(bin.left.get());
+    TokenType compoundOp;
+
+    if (bin.op == TokenType::ASSIGN) {
+      if (var == nullptr) {
+        expr(bin.left.get(), env);
+        expr(bin.right.get(), env);
+        return Typed();
+      }
+
+      assign(env, *var, expr(bin.right.get(), env).type);
+      return Typed();
+    }
+
+    if (getCompoundAssignOp(bin.op, compoundOp)) {
+      Inferred right = expr(bin.right.get(), env).type;
+      if (var == nullptr) {
+        expr(bin.left.get(), env);
+        return Typed();
+      }
+
+      assign(env, *var, arith(compoundOp, env.get(var->nameId), right));
+      return Typed();
+    }
+
+    if (bin.op == TokenType::DOT) {
+      expr(bin.left.get(), env);
+      if (auto fc = dynamic_cast<FunctionCall *>(bin.right.get()))
+        return call(*fc, env, false);
+      return Typed();
+    }
+
+    if (bin.op == TokenType::AND || bin.op == TokenType::OR) {
+      expr(bin.left.get(), env);
+      // the right side may not run at all
+      Env right = env;
+      expr(bin.right.get(), right);
+      env.join(right);
+      return Typed();
+    }
+
+    Typed l = expr(bin.left.get(), env);
+    Typed r = expr(bin.right.get(), env);
+
+    Typed out;
+    out.type = arith(bin.op, l.type, r.type);
+    if (l.raw && r.raw && l.type == out.type && r.type == out.type &&
+        raw_op(bin.op, out.type)) {
+      bin.staticType = static_type(out.type);
+      bin.leftShape = l.shape;
+      bin.rightShape = r.shape;
+      out.raw = true;
+      out.shape = OperandShape::Binary;
+    }
+    return out;
+  }
+
+  Typed unary(UnaryOp &un, Env &env) {
+    un.staticType = StaticType::Unknown;
+
+    if (un.op == TokenType::INCREMENT || un.op == TokenType::DECREMENT) {
+      if (auto var = dynamic_cast<Variable *>(un.operand.get())) {
+        assign(env, *var,
+               env.get(var->nameId) == Inferred::Int ? Inferred::Int
+                                                     : Inferred::Any);
+      }
+      return Typed();
+    }
+
+    Typed operand = expr(un.operand.get(), env);
+    const bool numeric =
+        (un.op == TokenType::NEGATE &&
+         (operand.type == Inferred::Int || operand.type == Inferred::Dec)) ||
+        (un.op == TokenType::BIT_NOT && operand.type == Inferred::Int);
+    if (!numeric)
+      return Typed();
+
+    Typed out;
+    out.type = operand.type;
+    if (operand.raw) {
+      un.staticType = static_type(operand.type);
+      un.operandShape = operand.shape;
+      out.raw = true;
+      out.shape = OperandShape::Unary;
+    }
+    return out;
+  }
+
+  Typed expr(ASTNode *node, Env &env) {
+    Typed out;
+
+    if (dynamic_cast<IntLiteral *>(node)) {
+      out.type = Inferred::Int;
+      out.raw = true;
+    } else if (dynamic_cast<FloatLiteral *>(node)) {
+      out.type = Inferred::Dec;
+      out.raw = true;
+    } else if (auto var = dynamic_cast<Variable *>(node)) {
+      Inferred type = env.get(var->nameId);
+      if (!var->value && (type == Inferred::Int || type == Inferred::Dec)) {
+        out.type = type;
+        out.raw = true;
+        out.shape = OperandShape::Var;
+      }
+    } else if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+      out = binary(*bin, env);
+    } else if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      out = unary(*un, env);
+    } else if (auto fc = dynamic_cast<FunctionCall *>(node)) {
+      out = call(*fc, env, true);
+    } else if (auto vec = dynamic_cast<VecLiteral *>(node)) {
+      for (ASTPtr &elem : vec->elems)
+        expr(elem.get(), env);
+    }
+
+    return out;
+  }
+
+  void condition(Condition &cond, Env &env) {
+    switch (cond.kind) {
+    case Condition::Compare: {
+      cond.staticType = StaticType::Unknown;
+      Typed l = expr(cond.expr, env);
+      Typed r = expr(cond.rhs, env);
+      if (l.raw && r.raw && l.type == r.type) {
+        cond.staticType = static_type(l.type);
+        cond.lhsShape = l.shape;
+        cond.rhsShape = r.shape;
+      }
+      return;
+    }
+    case Condition::And:
+    case Condition::Or: {
+      condition(*cond.left, env);
+      Env right = env;
+      condition(*cond.right, right);
+      env.join(right);
+      return;
+    }
+    case Condition::Not:
+      condition(*cond.left, env);
+      return;
+    case Condition::Expr:
+      expr(cond.expr, env);
+      return;
+    }
+  }
+
+  // a while loop, or with no 'test' a for loop over 'loopVarId', run to a
+  // fixed point of what its variables hold at the top of the body
+  void loop(Condition *test, uint32_t loopVarId,
+            std::vector<ExpressionStmt> &stmts, Env &env) {
+    Env head = env;
+
+    while (true) {
+      Env body = head;
+      if (test)
+        condition(*test, body);
+      Env exit = body;
+      if (!test)
+        body.vars[loopVarId] = Inferred::Any;
+
+      loops.emplace_back();
+      block(stmts, body);
+      Loop done = std::move(loops.back());
+      loops.pop_back();
+
+      Env next = head;
+      next.join(body);
+      next.join(done.continues);
+      if (next == head) {
+        env = exit;
+        env.join(done.breaks);
+        return;
+      }
+      head = std::move(next);
+    }
+  }
+
+  void stmt(ExpressionStmt &stmt, Env &env) {
+    switch (stmt.kind) {
+    case StmtKind::NoOp:
+      return;
+    case StmtKind::Break:
+    case StmtKind::Continue:
+      if (!loops.empty()) {
+        Loop &loop = loops.back();
+        (stmt.kind == StmtKind::Break ? loop.breaks : loop.continues)
+            .join(env);
+      }
+      env.dead = true;
+      return;
+    case StmtKind::If: {
+      auto &ifStmt = static_cast<IfStmt &>(*stmt.expr);
+      condition(*ifStmt.test, env);
+      Env thenEnv = env;
+      block(ifStmt.thenClauseStmts, thenEnv);
+      block(ifStmt.elseClauseStmts, env);
+      env.join(thenEnv);
+      return;
+    }
+    case StmtKind::While: {
+      auto &whileStmt = static_cast<WhileStmt &>(*stmt.expr);
+      loop(whileStmt.test.get(), 0, whileStmt.stmts, env);
+      return;
+    }
+    case StmtKind::For: {
+      auto &forStmt = static_cast<ForStmt &>(*stmt.expr);
+      expr(forStmt.iter.get(), env);
+      loop(nullptr, forStmt.varId, forStmt.stmts, env);
+      return;
+    }
+    case StmtKind::Return:
+      expr(static_cast<ReturnStmt &>(*stmt.expr).value.get(), env);
+      env.dead = true;
+      return;
+    case StmtKind::Yield:
+      expr(static_cast<YieldStmt &>(*stmt.expr).value.get(), env);
+      return;
+    case StmtKind::Expr:
+    case StmtKind::Fused:
+      break;
+    }
+
+    if (auto func = dynamic_cast<FunctionStmt *>(stmt.expr.get()))
+      form(*func);
+    else if (!dynamic_cast<ClassStmt *>(stmt.expr.get()))
+      expr(stmt.expr.get(), env);
+  }
+
+  void block(std::vector<ExpressionStmt> &stmts, Env &env) {
+    for (ExpressionStmt &s : stmts)
+      stmt(s, env);
+  }
+
+  void form(FunctionStmt &func) {
+    Env env;
+    auto types = assumed.find(func.name);
+
+    for (size_t i = 0; i < func.params.size(); i++) {
+      Inferred type = Inferred::Any;
+      if (types != assumed.end() && i < types->second.size() &&
+          types->second[i] != Inferred::None)
+        type = types->second[i];
+      env.vars[static_cast<Variable *>(func.params[i].get())->nameId] = type;
+    }
+
+    // the body is a scope of its own
+    const bool outerTopLevel = topLevel;
+    std::vector<Loop> outerLoops = std::move(loops);
+    topLevel = false;
+    loops.clear();
+
+    block(func.stmts, env);
+
+    topLevel = outerTopLevel;
+    loops = std::move(outerLoops);
+  }
+
+public:
+  ParamTypes seenArgs;
+
+  Inference(const ParamTypes &assumedTypes,
+            const std::unordered_set<uint32_t> &changed)
+      : assumed(assumedTypes), changedByForms(changed) {}
+
+  void run(Program &program) {
+    Env env;
+    block(program.statements, env);
+  }
+};
+
+} // namespace
+
+void infer_types(Program &program) {
+  // forms defined once by a name get their parameters' types from the calls
+  // by that name; with more definitions there is no telling which is called
+  std::unordered_map<std::string, std::vector<FunctionStmt *>> forms;
+  std::unordered_set<uint32_t> changedByForms;
+
+  each_node(program.statements, [&](ASTNode *node) {
+    if (auto func = dynamic_cast<FunctionStmt *>(node)) {
+      forms[func->name].push_back(func);
+
+      each_node(func->stmts, [&](ASTNode *inner) {
+        Variable *var = nullptr;
+        TokenType op;
+        if (auto un = dynamic_cast<UnaryOp *>(inner)) {
+          if (un->op == TokenType::INCREMENT || un->op == TokenType::DECREMENT)
+            var = dynamic_cast<Variable *>(un->operand.get());
+        } else if (auto bin = dynamic_cast<BinaryOp *>(inner)) {
+          if (getCompoundAssignOp(bin->op, op))
+            var = dynamic_cast<Variable *>(bin->left.get());
+        }
+        if (var)
+          changedByForms.insert(var->nameId);
+      });
+    }
+  });
+
+  ParamTypes assumed;
+  for (const auto &[name, defs] : forms) {
+    if (defs.size() == 1)
+      assumed[name].assign(defs[0]->params.size(), Inferred::None);
+  }
+
+  // assumptions only ever widen, so this stops
+  while (true) {
+    Inference pass(assumed, changedByForms);
+    pass.run(program);
+
+    ParamTypes next = assumed;
+    for (auto &[name, types] : next) {
+      auto seen = pass.seenArgs.find(name);
+      if (seen == pass.seenArgs.end())
+        continue;
+      for (size_t i = 0; i < types.size(); i++)
+        types[i] = join_types(types[i], seen->second[i]);
+    }
+
+    if (next == assumed)
+      return;
+    assumed = std::move(next);
+  }
+}
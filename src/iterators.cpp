@@ -0,0 +1,44 @@
+#include "iterators.hpp"
+
+#include <limits>
+
+#include "ast.hpp"
+#include "evaluator.hpp"
+
+// RangeIter
+
+std::shared_ptr<ValueIter> RangeIter::begin() {
+  return std::make_shared<RangeIter>(start, stop, step);
+}
+
+bool RangeIter::next(Value &out) {
+  if (step > 0 ? cur >= stop : cur <= stop)
+    return false;
+
+  out = Value(cur);
+
+  // stepping past the end of tn_int_t's range ends the sequence
+  if (step > 0 ? cur > std::numeric_limits<tn_int_t>::max() - step
+               : cur < std::numeric_limits<tn_int_t>::min() - step) {
+    cur = stop;
+  } else {
+    cur += step;
+  }
+
+  return true;
+}
+
+std::string RangeIter::describe() const {
+  return "range(" + std::to_string(start) + ", " + std::to_string(stop) +
+         ", " + std::to_string(step) + ")";
+}
+
+// GeneratorIter
+
+bool GeneratorIter::next(Value &out) {
+  return evaluator.resumeGenerator(*this, out);
+}
+
+std::string GeneratorIter::describe() const {
+  return "<generator " + func->name + ">";
+}
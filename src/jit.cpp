@@ -0,0 +1,1421 @@
+#include "jit.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "ast.hpp"
+#include "native_stack.hpp"
+#include "types.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define TENT_JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// What compiled code shares with the C++ that calls it; the code keeps a
+// pointer to it in r12.
+struct JitContext {
+  // stack pointer of the entry thunk, which a deopt unwinds to
+  uint64_t savedRsp = 0;
+  int64_t depth = 0;
+  int64_t depthLimit = 0;
+  // a call that would take the stack below this gives up as one too deep
+  uint64_t stackLimit = 0;
+  int64_t result = 0;
+  // out parameter of the vec helpers
+  int64_t scratch = 0;
+};
+
+constexpr int32_t CTX_SAVED_RSP = offsetof(JitContext, savedRsp);
+constexpr int32_t CTX_DEPTH = offsetof(JitContext, depth);
+constexpr int32_t CTX_DEPTH_LIMIT = offsetof(JitContext, depthLimit);
+constexpr int32_t CTX_STACK_LIMIT = offsetof(JitContext, stackLimit);
+constexpr int32_t CTX_RESULT = offsetof(JitContext, result);
+constexpr int32_t CTX_SCRATCH = offsetof(JitContext, scratch);
+
+// Called from compiled code for vec elements. Each returns false, without
+// touching the vec, when the interpreter has to take over.
+bool vec_load(ValueVec *vec, int64_t idx, int64_t *out) {
+  if (idx < 0 || (uint64_t)idx >= vec->size())
+    return false;
+
+  auto value = std::get_if<tn_int_t>(&(*vec)[(size_t)idx].v);
+  if (value == nullptr)
+    return false;
+
+  *out = *value;
+  return true;
+}
+
+bool vec_store_int(ValueVec *vec, int64_t idx, int64_t value) {
+  if (idx < 0 || (uint64_t)idx >= vec->size())
+    return false;
+
+  vec->set((size_t)idx, Value(tn_int_t(value)));
+  return true;
+}
+
+bool vec_store_dec(ValueVec *vec, int64_t idx, int64_t bits) {
+  if (idx < 0 || (uint64_t)idx >= vec->size())
+    return false;
+
+  tn_dec_t value;
+  std::memcpy(&value, &bits, sizeof(value));
+  vec->set((size_t)idx, Value(value));
+  return true;
+}
+
+enum Reg : uint8_t {
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+enum Xmm : uint8_t { XMM0, XMM1, XMM2 };
+
+enum Cond : uint8_t {
+  CC_B = 0x2,
+  CC_AE = 0x3,
+  CC_E = 0x4,
+  CC_NE = 0x5,
+  CC_BE = 0x6,
+  CC_A = 0x7,
+  CC_P = 0xA,
+  CC_NP = 0xB,
+  CC_L = 0xC,
+  CC_GE = 0xD,
+  CC_LE = 0xE,
+  CC_G = 0xF
+};
+
+// the opposite condition differs only in the lowest bit
+Cond negate(Cond cc) { return Cond(cc ^ 1); }
+
+// a two-operand integer instruction: the opcode of `op r64, r/m64` and the
+// /digit of `op r/m64, imm32`
+struct AluOp {
+  uint8_t rm;
+  uint8_t ext;
+};
+
+constexpr AluOp ALU_ADD{0x03, 0};
+constexpr AluOp ALU_OR{0x0B, 1};
+constexpr AluOp ALU_AND{0x23, 4};
+constexpr AluOp ALU_SUB{0x2B, 5};
+constexpr AluOp ALU_XOR{0x33, 6};
+constexpr AluOp ALU_CMP{0x3B, 7};
+
+// scalar double instructions, all `op xmm, xmm/m64` after their prefix
+constexpr uint8_t SD_PREFIX = 0xF2;
+constexpr uint8_t SD_MOV = 0x10;
+constexpr uint8_t SD_ADD = 0x58;
+constexpr uint8_t SD_MUL = 0x59;
+constexpr uint8_t SD_SUB = 0x5C;
+constexpr uint8_t SD_DIV = 0x5E;
+
+// Emits x86-64 machine code. Memory operands are always [base + disp32].
+class Assembler {
+  std::vector<int64_t> labels;
+  // offsets of rel32 fields and the label each jumps to
+  std::vector<std::pair<size_t, size_t>> fixups;
+
+  void imm32(int32_t v) {
+    uint8_t b[4];
+    std::memcpy(b, &v, 4);
+    bytes.insert(bytes.end(), b, b + 4);
+  }
+
+  void imm64(int64_t v) {
+    uint8_t b[8];
+    std::memcpy(b, &v, 8);
+    bytes.insert(bytes.end(), b, b + 8);
+  }
+
+  void rex(bool w, unsigned reg, unsigned rm) {
+    uint8_t prefix = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+    if (prefix != 0x40)
+      byte(prefix);
+  }
+
+  void modrmReg(unsigned reg, unsigned rm) {
+    byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+  }
+
+  void modrmMem(unsigned reg, Reg base, int32_t disp) {
+    byte(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP)
+      byte(0x24);
+    imm32(disp);
+  }
+
+  void rel32(size_t target) {
+    fixups.emplace_back(bytes.size(), target);
+    imm32(0);
+  }
+
+public:
+  using Label = size_t;
+
+  std::vector<uint8_t> bytes;
+
+  Label label() {
+    labels.push_back(-1);
+    return labels.size() - 1;
+  }
+
+  void bind(Label l) { labels[l] = bytes.size(); }
+
+  // patches every jump and call to its label
+  void finish() {
+    for (auto [at, target] : fixups) {
+      int32_t rel = (int32_t)(labels[target] - (int64_t)(at + 4));
+      std::memcpy(&bytes[at], &rel, 4);
+    }
+  }
+
+  void byte(uint8_t b) { bytes.push_back(b); }
+
+  void mov(Reg dst, Reg src) {
+    rex(true, src, dst);
+    byte(0x89);
+    modrmReg(src, dst);
+  }
+
+  void movImm(Reg dst, int64_t v) {
+    if (v >= INT32_MIN && v <= INT32_MAX) {
+      rex(true, 0, dst);
+      byte(0xC7);
+      modrmReg(0, dst);
+      imm32((int32_t)v);
+    } else {
+      rex(true, 0, dst);
+      byte(0xB8 + (dst & 7));
+      imm64(v);
+    }
+  }
+
+  void load(Reg dst, Reg base, int32_t disp) {
+    rex(true, dst, base);
+    byte(0x8B);
+    modrmMem(dst, base, disp);
+  }
+
+  void store(Reg base, int32_t disp, Reg src) {
+    rex(true, src, base);
+    byte(0x89);
+    modrmMem(src, base, disp);
+  }
+
+  void lea(Reg dst, Reg base, int32_t disp) {
+    rex(true, dst, base);
+    byte(0x8D);
+    modrmMem(dst, base, disp);
+  }
+
+  void alu(AluOp op, Reg dst, Reg src) {
+    rex(true, dst, src);
+    byte(op.rm);
+    modrmReg(dst, src);
+  }
+
+  void aluMem(AluOp op, Reg dst, Reg base, int32_t disp) {
+    rex(true, dst, base);
+    byte(op.rm);
+    modrmMem(dst, base, disp);
+  }
+
+  void aluImm(AluOp op, Reg dst, int32_t v) {
+    rex(true, 0, dst);
+    byte(0x81);
+    modrmReg(op.ext, dst);
+    imm32(v);
+  }
+
+  void aluMemImm(AluOp op, Reg base, int32_t disp, int32_t v) {
+    rex(true, 0, base);
+    byte(0x81);
+    modrmMem(op.ext, base, disp);
+    imm32(v);
+  }
+
+  void imul(Reg dst, Reg src) {
+    rex(true, dst, src);
+    byte(0x0F);
+    byte(0xAF);
+    modrmReg(dst, src);
+  }
+
+  void imulMem(Reg dst, Reg base, int32_t disp) {
+    rex(true, dst, base);
+    byte(0x0F);
+    byte(0xAF);
+    modrmMem(dst, base, disp);
+  }
+
+  void imulImm(Reg dst, Reg src, int32_t v) {
+    rex(true, dst, src);
+    byte(0x69);
+    modrmReg(dst, src);
+    imm32(v);
+  }
+
+  // neg (3), not (2) and idiv (7) share an opcode
+  void unary(unsigned ext, Reg r) {
+    rex(true, 0, r);
+    byte(0xF7);
+    modrmReg(ext, r);
+  }
+
+  void cqo() {
+    byte(0x48);
+    byte(0x99);
+  }
+
+  void testAl() {
+    byte(0x84);
+    byte(0xC0);
+  }
+
+  void test(Reg a, Reg b) {
+    rex(true, b, a);
+    byte(0x85);
+    modrmReg(b, a);
+  }
+
+  void push(Reg r) {
+    rex(false, 0, r);
+    byte(0x50 + (r & 7));
+  }
+
+  void pop(Reg r) {
+    rex(false, 0, r);
+    byte(0x58 + (r & 7));
+  }
+
+  void pushMem(Reg base, int32_t disp) {
+    rex(false, 0, base);
+    byte(0xFF);
+    modrmMem(6, base, disp);
+  }
+
+  void callReg(Reg r) {
+    rex(false, 0, r);
+    byte(0xFF);
+    modrmReg(2, r);
+  }
+
+  void call(Label l) {
+    byte(0xE8);
+    rel32(l);
+  }
+
+  void jmp(Label l) {
+    byte(0xE9);
+    rel32(l);
+  }
+
+  void jcc(Cond cc, Label l) {
+    byte(0x0F);
+    byte(0x80 | cc);
+    rel32(l);
+  }
+
+  void ret() { byte(0xC3); }
+
+  void sd(uint8_t op, Xmm dst, Xmm src) {
+    byte(SD_PREFIX);
+    byte(0x0F);
+    byte(op);
+    modrmReg(dst, src);
+  }
+
+  void sdMem(uint8_t op, Xmm dst, Reg base, int32_t disp) {
+    byte(SD_PREFIX);
+    rex(false, dst, base);
+    byte(0x0F);
+    byte(op);
+    modrmMem(dst, base, disp);
+  }
+
+  void movsdStore(Reg base, int32_t disp, Xmm src) {
+    byte(SD_PREFIX);
+    rex(false, src, base);
+    byte(0x0F);
+    byte(0x11);
+    modrmMem(src, base, disp);
+  }
+
+  void ucomisd(Xmm a, Xmm b) {
+    byte(0x66);
+    byte(0x0F);
+    byte(0x2E);
+    modrmReg(a, b);
+  }
+
+  void xorpd(Xmm dst, Xmm src) {
+    byte(0x66);
+    byte(0x0F);
+    byte(0x57);
+    modrmReg(dst, src);
+  }
+
+  void cvtsi2sd(Xmm dst, Reg src) {
+    byte(SD_PREFIX);
+    rex(true, dst, src);
+    byte(0x0F);
+    byte(0x2A);
+    modrmReg(dst, src);
+  }
+
+  void movqToXmm(Xmm dst, Reg src) {
+    byte(0x66);
+    rex(true, dst, src);
+    byte(0x0F);
+    byte(0x6E);
+    modrmReg(dst, src);
+  }
+
+  void movqFromXmm(Reg dst, Xmm src) {
+    byte(0x66);
+    rex(true, src, dst);
+    byte(0x0F);
+    byte(0x7E);
+    modrmReg(src, dst);
+  }
+};
+
+using Label = Assembler::Label;
+
+void collect_vars(ASTNode *node, std::vector<Variable *> &vars,
+                  std::vector<bool> &written);
+
+void collect_block(std::vector<ExpressionStmt> &stmts,
+                   std::vector<Variable *> &vars, std::vector<bool> &written) {
+  for (ExpressionStmt &stmt : stmts)
+    collect_vars(stmt.expr.get(), vars, written);
+}
+
+void add_var(Variable *var, bool isWritten, std::vector<Variable *> &vars,
+             std::vector<bool> &written) {
+  for (size_t i = 0; i < vars.size(); i++) {
+    if (vars[i]->nameId == var->nameId) {
+      written[i] = written[i] || isWritten;
+      return;
+    }
+  }
+
+  vars.push_back(var);
+  written.push_back(isWritten);
+}
+
+// every variable under 'node', in order of first appearance, and whether
+// anything assigns to it
+void collect_vars(ASTNode *node, std::vector<Variable *> &vars,
+                  std::vector<bool> &written) {
+  if (node == nullptr)
+    return;
+
+  if (auto var = dynamic_cast<Variable *>(node)) {
+    add_var(var, false, vars, written);
+  } else if (auto un = dynamic_cast<UnaryOp *>(node)) {
+    auto var = dynamic_cast<Variable *>(un->operand.get());
+    if (var && (un->op == TokenType::INCREMENT ||
+                un->op == TokenType::DECREMENT))
+      add_var(var, true, vars, written);
+    collect_vars(un->operand.get(), vars, written);
+  } else if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+    TokenType op;
+    auto var = dynamic_cast<Variable *>(bin->left.get());
+    if (var && (bin->op == TokenType::ASSIGN ||
+                getCompoundAssignOp(bin->op, op)))
+      add_var(var, true, vars, written);
+    collect_vars(bin->left.get(), vars, written);
+    collect_vars(bin->right.get(), vars, written);
+  } else if (auto call = dynamic_cast<FunctionCall *>(node)) {
+    for (ASTPtr &param : call->params)
+      collect_vars(param.get(), vars, written);
+  } else if (auto ifStmt = dynamic_cast<IfStmt *>(node)) {
+    collect_vars(ifStmt->condition.get(), vars, written);
+    collect_block(ifStmt->thenClauseStmts, vars, written);
+    collect_block(ifStmt->elseClauseStmts, vars, written);
+  } else if (auto whileStmt = dynamic_cast<WhileStmt *>(node)) {
+    collect_vars(whileStmt->condition.get(), vars, written);
+    collect_block(whileStmt->stmts, vars, written);
+  } else if (auto ret = dynamic_cast<ReturnStmt *>(node)) {
+    collect_vars(ret->value.get(), vars, written);
+  }
+}
+
+// Translates one loop or form. Every emit method returns false, giving up
+// on the whole translation, at the first thing it cannot compile.
+//
+// Variables live in 8-byte slots at [rbx + 8*i]: for a loop, an array the
+// evaluator fills from the bound variables; for a form, the native frame
+// of each call. Ints are computed in rax and floats in xmm0, with pending
+// operands pushed on the native stack.
+class Compiler {
+public:
+  enum Unit { LoopUnit, FormUnit };
+
+private:
+  Unit unit;
+  Assembler as;
+
+  std::unordered_map<uint32_t, size_t> slotOf;
+  std::vector<JitType> types;
+  // form locals only get a type (and become readable) once assigned
+  std::vector<bool> typed;
+  std::vector<bool> defined;
+
+  // loop unit
+  JitLoop *loop = nullptr;
+  std::vector<JitResumeStep> path;
+  std::optional<Label> stmtDeopt;
+  std::vector<std::pair<Label, uint32_t>> deoptStubs;
+
+  // form unit
+  FunctionStmt *form = nullptr;
+  JitType resultType = JitType::Int;
+  bool sawReturn = false;
+  bool recursive = false;
+  Label formEntry = 0;
+  Label abort = 0;
+
+  Label unwind = 0;
+  Label epilogue = 0;
+
+  struct LoopLabels {
+    Label next;
+    Label exit;
+  };
+  std::vector<LoopLabels> loops;
+
+  static int32_t slotDisp(size_t slot) { return (int32_t)(slot * 8); }
+
+  // where a failing check jumps: the deopt of the statement being compiled,
+  // or giving up the whole call in a form
+  Label fail() {
+    if (unit == FormUnit)
+      return abort;
+
+    if (!stmtDeopt) {
+      stmtDeopt = as.label();
+      loop->resumePoints.push_back(path);
+      deoptStubs.emplace_back(*stmtDeopt, (uint32_t)loop->resumePoints.size());
+    }
+
+    return *stmtDeopt;
+  }
+
+  void callHelper(uintptr_t fn) {
+    // the helpers follow the C ABI: the stack is realigned around them, r13
+    // (callee-saved) keeping the unaligned pointer
+    as.mov(R13, RSP);
+    as.aluImm(ALU_AND, RSP, -16);
+    as.movImm(RAX, (int64_t)fn);
+    as.callReg(RAX);
+    as.mov(RSP, R13);
+  }
+
+  // pushes the value of an expression of type 't'
+  void spill(JitType t) {
+    if (t == JitType::Dec)
+      as.movqFromXmm(RAX, XMM0);
+    as.push(RAX);
+  }
+
+  bool readable(Variable &var, JitType &type, size_t &slot) {
+    auto found = slotOf.find(var.nameId);
+    if (found == slotOf.end() || var.value)
+      return false;
+
+    slot = found->second;
+    if (unit == FormUnit && !defined[slot])
+      return false;
+
+    type = types[slot];
+    return type == JitType::Int || type == JitType::Dec;
+  }
+
+  // an operand that instructions can take in place: a variable's slot or
+  // an int literal that fits in 32 bits
+  struct Leaf {
+    JitType type;
+    bool isImm;
+    int32_t imm;
+    int32_t disp;
+  };
+
+  bool leaf(ASTNode *node, Leaf &out) {
+    if (auto lit = dynamic_cast<IntLiteral *>(node)) {
+      if (lit->value < INT32_MIN || lit->value > INT32_MAX)
+        return false;
+      out = Leaf{JitType::Int, true, (int32_t)lit->value, 0};
+      return true;
+    }
+
+    if (auto var = dynamic_cast<Variable *>(node)) {
+      size_t slot;
+      JitType type;
+      if (!readable(*var, type, slot))
+        return false;
+      out = Leaf{type, false, 0, slotDisp(slot)};
+      return true;
+    }
+
+    return false;
+  }
+
+  // Evaluates the right operand of a binary operator before the left one,
+  // which leaves it pushed (or, if it is a leaf, nowhere yet).
+  bool rightFirst(ASTNode *right, Leaf &rl, bool &isLeaf) {
+    isLeaf = leaf(right, rl);
+    if (isLeaf)
+      return true;
+
+    JitType type;
+    if (!expr(right, type) || type == JitType::Vec)
+      return false;
+
+    spill(type);
+    rl = Leaf{type, false, 0, 0};
+    return true;
+  }
+
+  // the right operand, as a float, into xmm1
+  void rightToXmm1(const Leaf &rl, bool isLeaf) {
+    if (!isLeaf) {
+      as.pop(RCX);
+      if (rl.type == JitType::Int)
+        as.cvtsi2sd(XMM1, RCX);
+      else
+        as.movqToXmm(XMM1, RCX);
+    } else if (rl.isImm) {
+      as.movImm(RCX, rl.imm);
+      as.cvtsi2sd(XMM1, RCX);
+    } else if (rl.type == JitType::Int) {
+      as.load(RCX, RBX, rl.disp);
+      as.cvtsi2sd(XMM1, RCX);
+    } else {
+      as.sdMem(SD_MOV, XMM1, RBX, rl.disp);
+    }
+  }
+
+  // the right operand, as an int, into rcx
+  void rightToRcx(const Leaf &rl, bool isLeaf) {
+    if (!isLeaf)
+      as.pop(RCX);
+    else if (rl.isImm)
+      as.movImm(RCX, rl.imm);
+    else
+      as.load(RCX, RBX, rl.disp);
+  }
+
+  bool binary(TokenType op, ASTNode *left, ASTNode *right, JitType &type) {
+    if (op == TokenType::INDEX)
+      return index(left, right, type);
+
+    Leaf rl;
+    bool isLeaf;
+    if (!rightFirst(right, rl, isLeaf))
+      return false;
+
+    JitType lt;
+    if (!expr(left, lt) || lt == JitType::Vec)
+      return false;
+
+    if (lt == JitType::Int && rl.type == JitType::Int) {
+      type = JitType::Int;
+      AluOp alu;
+
+      switch (op) {
+      case TokenType::ADD:
+        alu = ALU_ADD;
+        break;
+      case TokenType::SUB:
+        alu = ALU_SUB;
+        break;
+      case TokenType::BIT_AND:
+        alu = ALU_AND;
+        break;
+      case TokenType::BIT_OR:
+        alu = ALU_OR;
+        break;
+      case TokenType::BIT_XOR:
+        alu = ALU_XOR;
+        break;
+      case TokenType::MUL:
+        if (isLeaf && rl.isImm) {
+          as.imulImm(RAX, RAX, rl.imm);
+        } else if (isLeaf) {
+          as.imulMem(RAX, RBX, rl.disp);
+        } else {
+          as.pop(RCX);
+          as.imul(RAX, RCX);
+        }
+        return true;
+      case TokenType::DIV:
+      case TokenType::FLOOR_DIV:
+      case TokenType::MOD:
+        rightToRcx(rl, isLeaf);
+        as.test(RCX, RCX);
+        as.jcc(CC_E, fail());
+        as.cqo();
+        as.unary(7, RCX);
+        if (op == TokenType::MOD)
+          as.mov(RAX, RDX);
+        return true;
+      default:
+        return false;
+      }
+
+      if (isLeaf && rl.isImm) {
+        as.aluImm(alu, RAX, rl.imm);
+      } else if (isLeaf) {
+        as.aluMem(alu, RAX, RBX, rl.disp);
+      } else {
+        as.pop(RCX);
+        as.alu(alu, RAX, RCX);
+      }
+      return true;
+    }
+
+    uint8_t sdOp;
+    switch (op) {
+    case TokenType::ADD:
+      sdOp = SD_ADD;
+      break;
+    case TokenType::SUB:
+      sdOp = SD_SUB;
+      break;
+    case TokenType::MUL:
+      sdOp = SD_MUL;
+      break;
+    case TokenType::DIV:
+      sdOp = SD_DIV;
+      break;
+    default:
+      return false;
+    }
+
+    if (lt == JitType::Int)
+      as.cvtsi2sd(XMM0, RAX);
+    rightToXmm1(rl, isLeaf);
+
+    if (op == TokenType::DIV) {
+      // a NaN divisor is unordered (PF set), not zero
+      Label nonZero = as.label();
+      as.xorpd(XMM2, XMM2);
+      as.ucomisd(XMM1, XMM2);
+      as.jcc(CC_P, nonZero);
+      as.jcc(CC_E, fail());
+      as.bind(nonZero);
+    }
+
+    as.sd(sdOp, XMM0, XMM1);
+    type = JitType::Dec;
+    return true;
+  }
+
+  // `v@i` for a vec v whose element is an int
+  bool index(ASTNode *left, ASTNode *right, JitType &type) {
+    auto var = dynamic_cast<Variable *>(left);
+    auto found = var ? slotOf.find(var->nameId) : slotOf.end();
+    if (found == slotOf.end() || types[found->second] != JitType::Vec)
+      return false;
+
+    JitType it;
+    if (!expr(right, it) || it != JitType::Int)
+      return false;
+
+    as.mov(RSI, RAX);
+    as.load(RDI, RBX, slotDisp(found->second));
+    as.lea(RDX, R12, CTX_SCRATCH);
+    callHelper(reinterpret_cast<uintptr_t>(&vec_load));
+    as.testAl();
+    as.jcc(CC_E, fail());
+    as.load(RAX, R12, CTX_SCRATCH);
+    type = JitType::Int;
+    return true;
+  }
+
+  bool call(FunctionCall &call, JitType &type) {
+    if (unit != FormUnit || call.name != form->name ||
+        call.params.size() != form->params.size())
+      return false;
+
+    for (size_t i = 0; i < call.params.size(); i++) {
+      JitType at;
+      if (!expr(call.params[i].get(), at) || at != types[i])
+        return false;
+      spill(at);
+    }
+
+    as.call(formEntry);
+    if (!call.params.empty())
+      as.aluImm(ALU_ADD, RSP, (int32_t)(8 * call.params.size()));
+
+    if (resultType == JitType::Dec)
+      as.movqToXmm(XMM0, RAX);
+
+    recursive = true;
+    type = resultType;
+    return true;
+  }
+
+  bool expr(ASTNode *node, JitType &type) {
+    if (auto lit = dynamic_cast<IntLiteral *>(node)) {
+      as.movImm(RAX, lit->value);
+      type = JitType::Int;
+      return true;
+    }
+
+    if (auto lit = dynamic_cast<FloatLiteral *>(node)) {
+      int64_t bits;
+      std::memcpy(&bits, &lit->value, sizeof(bits));
+      as.movImm(RAX, bits);
+      as.movqToXmm(XMM0, RAX);
+      type = JitType::Dec;
+      return true;
+    }
+
+    if (auto var = dynamic_cast<Variable *>(node)) {
+      size_t slot;
+      if (!readable(*var, type, slot))
+        return false;
+
+      if (type == JitType::Int)
+        as.load(RAX, RBX, slotDisp(slot));
+      else
+        as.sdMem(SD_MOV, XMM0, RBX, slotDisp(slot));
+      return true;
+    }
+
+    if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      if (!expr(un->operand.get(), type))
+        return false;
+
+      if (un->op == TokenType::NEGATE && type == JitType::Int) {
+        as.unary(3, RAX);
+      } else if (un->op == TokenType::NEGATE && type == JitType::Dec) {
+        as.movImm(RAX, INT64_MIN);
+        as.movqToXmm(XMM1, RAX);
+        as.xorpd(XMM0, XMM1);
+      } else if (un->op == TokenType::BIT_NOT && type == JitType::Int) {
+        as.unary(2, RAX);
+      } else {
+        return false;
+      }
+      return true;
+    }
+
+    if (auto bin = dynamic_cast<BinaryOp *>(node))
+      return binary(bin->op, bin->left.get(), bin->right.get(), type);
+
+    if (auto fc = dynamic_cast<FunctionCall *>(node))
+      return call(*fc, type);
+
+    return false;
+  }
+
+  static Cond intCond(TokenType op) {
+    switch (op) {
+    case TokenType::EQEQ:
+      return CC_E;
+    case TokenType::NOTEQ:
+      return CC_NE;
+    case TokenType::LESS:
+      return CC_L;
+    case TokenType::LESSEQ:
+      return CC_LE;
+    case TokenType::GREATER:
+      return CC_G;
+    default:
+      return CC_GE;
+    }
+  }
+
+  bool compare(const Condition &cond, bool sense, Label target) {
+    Leaf rl;
+    bool isLeaf;
+    if (!rightFirst(cond.rhs, rl, isLeaf))
+      return false;
+
+    JitType lt;
+    if (!expr(cond.expr, lt) || lt == JitType::Vec)
+      return false;
+
+    if (lt == JitType::Int && rl.type == JitType::Int) {
+      if (isLeaf && rl.isImm) {
+        as.aluImm(ALU_CMP, RAX, rl.imm);
+      } else if (isLeaf) {
+        as.aluMem(ALU_CMP, RAX, RBX, rl.disp);
+      } else {
+        as.pop(RCX);
+        as.alu(ALU_CMP, RAX, RCX);
+      }
+
+      Cond cc = intCond(cond.op);
+      as.jcc(sense ? cc : negate(cc), target);
+      return true;
+    }
+
+    if (lt == JitType::Int)
+      as.cvtsi2sd(XMM0, RAX);
+    rightToXmm1(rl, isLeaf);
+
+    // ucomisd sets CF, ZF and PF all for NaN, so only A and AE (and E
+    // with PF clear) hold just for ordered operands
+    switch (cond.op) {
+    case TokenType::GREATER:
+    case TokenType::GREATEREQ:
+    case TokenType::LESS:
+    case TokenType::LESSEQ: {
+      bool less = cond.op == TokenType::LESS || cond.op == TokenType::LESSEQ;
+      bool strict = cond.op == TokenType::GREATER || cond.op == TokenType::LESS;
+      if (less)
+        as.ucomisd(XMM1, XMM0);
+      else
+        as.ucomisd(XMM0, XMM1);
+
+      Cond cc = strict ? CC_A : CC_AE;
+      as.jcc(sense ? cc : negate(cc), target);
+      return true;
+    }
+    default: {
+      as.ucomisd(XMM0, XMM1);
+      bool jumpIfEqual = (cond.op == TokenType::EQEQ) == sense;
+      if (jumpIfEqual) {
+        Label skip = as.label();
+        as.jcc(CC_P, skip);
+        as.jcc(CC_E, target);
+        as.bind(skip);
+      } else {
+        as.jcc(CC_P, target);
+        as.jcc(CC_NE, target);
+      }
+      return true;
+    }
+    }
+  }
+
+  // jumps to 'target' when 'cond' evaluates to 'sense'
+  bool branch(const Condition &cond, bool sense, Label target) {
+    switch (cond.kind) {
+    case Condition::Compare:
+      return compare(cond, sense, target);
+    case Condition::Not:
+      return branch(*cond.left, !sense, target);
+    case Condition::And:
+    case Condition::Or: {
+      // the left side alone decides when it is false for &&, true for ||
+      bool decides = cond.kind == Condition::Or;
+      if (sense == decides) {
+        return branch(*cond.left, sense, target) &&
+               branch(*cond.right, sense, target);
+      }
+
+      Label skip = as.label();
+      if (!branch(*cond.left, decides, skip) ||
+          !branch(*cond.right, sense, target))
+        return false;
+      as.bind(skip);
+      return true;
+    }
+    case Condition::Expr:
+      break;
+    }
+
+    return false;
+  }
+
+  bool storeVar(Variable &var, JitType type) {
+    auto found = slotOf.find(var.nameId);
+    if (found == slotOf.end() || var.value)
+      return false;
+
+    size_t slot = found->second;
+    if (unit == FormUnit && !typed[slot]) {
+      types[slot] = type;
+      typed[slot] = true;
+    }
+
+    if (types[slot] != type || type == JitType::Vec)
+      return false;
+
+    if (type == JitType::Int)
+      as.store(RBX, slotDisp(slot), RAX);
+    else
+      as.movsdStore(RBX, slotDisp(slot), XMM0);
+
+    defined[slot] = true;
+    return true;
+  }
+
+  // `v@i = e`
+  bool storeIndex(BinaryOp &target, ASTNode *value) {
+    auto var = dynamic_cast<Variable *>(target.left.get());
+    auto found = var ? slotOf.find(var->nameId) : slotOf.end();
+    if (found == slotOf.end() || types[found->second] != JitType::Vec)
+      return false;
+
+    JitType vt;
+    if (!expr(value, vt) || vt == JitType::Vec)
+      return false;
+    spill(vt);
+
+    JitType it;
+    if (!expr(target.right.get(), it) || it != JitType::Int)
+      return false;
+
+    as.mov(RSI, RAX);
+    as.pop(RDX);
+    as.load(RDI, RBX, slotDisp(found->second));
+    callHelper(vt == JitType::Int ? reinterpret_cast<uintptr_t>(&vec_store_int)
+                                  : reinterpret_cast<uintptr_t>(&vec_store_dec));
+    as.testAl();
+    as.jcc(CC_E, fail());
+    return true;
+  }
+
+  bool exprStmt(ASTNode *node) {
+    if (auto un = dynamic_cast<UnaryOp *>(node)) {
+      auto var = dynamic_cast<Variable *>(un->operand.get());
+      size_t slot;
+      JitType type;
+      if (var == nullptr || !readable(*var, type, slot) ||
+          type != JitType::Int)
+        return false;
+
+      if (un->op == TokenType::INCREMENT)
+        as.aluMemImm(ALU_ADD, RBX, slotDisp(slot), 1);
+      else if (un->op == TokenType::DECREMENT)
+        as.aluMemImm(ALU_SUB, RBX, slotDisp(slot), 1);
+      else
+        return false;
+      return true;
+    }
+
+    auto bin = dynamic_cast<BinaryOp *>(node);
+    if (bin == nullptr)
+      return false;
+
+    auto var = dynamic_cast<Variable *>(bin->left.get());
+    JitType type;
+
+    if (bin->op == TokenType::ASSIGN) {
+      if (var)
+        return expr(bin->right.get(), type) && storeVar(*var, type);
+
+      auto target = dynamic_cast<BinaryOp *>(bin->left.get());
+      return target && target->op == TokenType::INDEX &&
+             storeIndex(*target, bin->right.get());
+    }
+
+    TokenType op;
+    if (var == nullptr || !getCompoundAssignOp(bin->op, op))
+      return false;
+
+    return binary(op, var, bin->right.get(), type) && storeVar(*var, type);
+  }
+
+  bool ifStmt(IfStmt &node) {
+    Label elseLabel = as.label();
+    Label end = as.label();
+
+    if (!branch(*node.test, false, elseLabel))
+      return false;
+
+    std::vector<bool> before = defined;
+    if (!block(node.thenClauseStmts))
+      return false;
+    defined = before;
+
+    as.jmp(end);
+    as.bind(elseLabel);
+    if (!block(node.elseClauseStmts))
+      return false;
+    defined = before;
+
+    as.bind(end);
+    return true;
+  }
+
+  bool whileStmt(WhileStmt &node) {
+    Label top = as.label();
+    Label exit = as.label();
+
+    as.bind(top);
+    if (!branch(*node.test, false, exit))
+      return false;
+
+    std::vector<bool> before = defined;
+    loops.push_back({top, exit});
+    if (!block(node.stmts))
+      return false;
+    loops.pop_back();
+    defined = before;
+
+    as.jmp(top);
+    as.bind(exit);
+    return true;
+  }
+
+  bool returnStmt(ReturnStmt &node) {
+    JitType type;
+    if (unit != FormUnit || !node.value || !expr(node.value.get(), type) ||
+        type != resultType)
+      return false;
+
+    if (type == JitType::Dec)
+      as.movqFromXmm(RAX, XMM0);
+
+    as.aluMemImm(ALU_ADD, R12, CTX_DEPTH, -1);
+    as.lea(RSP, RBP, -8);
+    as.pop(RBX);
+    as.pop(RBP);
+    as.ret();
+    sawReturn = true;
+    return true;
+  }
+
+  bool stmt(ExpressionStmt &stmt) {
+    switch (stmt.kind) {
+    case StmtKind::NoOp:
+      return true;
+    case StmtKind::Break:
+    case StmtKind::Continue:
+      if (loops.empty())
+        return false;
+      as.jmp(stmt.kind == StmtKind::Break ? loops.back().exit
+                                          : loops.back().next);
+      return true;
+    case StmtKind::If:
+      return ifStmt(static_cast<IfStmt &>(*stmt.expr));
+    case StmtKind::While:
+      return whileStmt(static_cast<WhileStmt &>(*stmt.expr));
+    case StmtKind::Return:
+      return returnStmt(static_cast<ReturnStmt &>(*stmt.expr));
+    case StmtKind::Expr:
+    case StmtKind::Fused:
+      return exprStmt(stmt.expr.get());
+    default:
+      return false;
+    }
+  }
+
+  bool block(std::vector<ExpressionStmt> &stmts) {
+    for (size_t i = 0; i < stmts.size(); i++) {
+      path.push_back({&stmts, i});
+      std::optional<Label> outer = stmtDeopt;
+      stmtDeopt.reset();
+
+      bool ok = stmt(stmts[i]);
+
+      stmtDeopt = outer;
+      path.pop_back();
+      if (!ok)
+        return false;
+    }
+
+    return true;
+  }
+
+  // `uint32_t entry(JitContext *ctx, int64_t *slots)`: saves the
+  // callee-saved registers and the stack pointer deopts unwind to
+  void thunkPrologue() {
+    as.push(RBP);
+    as.push(RBX);
+    as.push(R12);
+    as.push(R13);
+    as.push(R14);
+    as.push(R15);
+    as.aluImm(ALU_SUB, RSP, 8);
+    as.mov(R12, RDI);
+    as.store(R12, CTX_SAVED_RSP, RSP);
+    as.mov(RBX, RSI);
+  }
+
+  // 'unwind' returns eax from anywhere in the code
+  void thunkEpilogue() {
+    as.bind(unwind);
+    as.load(RSP, R12, CTX_SAVED_RSP);
+    as.bind(epilogue);
+    as.aluImm(ALU_ADD, RSP, 8);
+    as.pop(R15);
+    as.pop(R14);
+    as.pop(R13);
+    as.pop(R12);
+    as.pop(RBX);
+    as.pop(RBP);
+    as.ret();
+  }
+
+  void assignSlots(std::vector<Variable *> &vars) {
+    for (size_t i = 0; i < vars.size(); i++)
+      slotOf.emplace(vars[i]->nameId, i);
+
+    types.assign(vars.size(), JitType::Int);
+    typed.assign(vars.size(), false);
+    defined.assign(vars.size(), false);
+  }
+
+public:
+  explicit Compiler(Unit u) : unit(u) {
+    unwind = as.label();
+    epilogue = as.label();
+  }
+
+  bool compileLoop(WhileStmt &node, JitLoop &out,
+                   const std::function<bool(Variable &, JitType &)> &typeOf) {
+    loop = &out;
+
+    std::vector<Variable *> vars;
+    std::vector<bool> written;
+    collect_vars(&node, vars, written);
+    assignSlots(vars);
+
+    for (size_t i = 0; i < vars.size(); i++) {
+      if (!typeOf(*vars[i], types[i]))
+        return false;
+      if (written[i] && types[i] == JitType::Vec)
+        return false;
+      typed[i] = defined[i] = true;
+      out.bindings.push_back({vars[i], types[i], written[i]});
+    }
+
+    thunkPrologue();
+
+    Label top = as.label();
+    Label done = as.label();
+
+    as.bind(top);
+    if (!branch(*node.test, false, done))
+      return false;
+
+    loops.push_back({top, done});
+    if (!block(node.stmts))
+      return false;
+    loops.pop_back();
+
+    as.jmp(top);
+    as.bind(done);
+    as.alu(ALU_XOR, RAX, RAX);
+    as.jmp(epilogue);
+
+    for (auto [label, id] : deoptStubs) {
+      as.bind(label);
+      as.movImm(RAX, id);
+      as.jmp(unwind);
+    }
+
+    thunkEpilogue();
+    as.finish();
+    return out.code.load(as.bytes);
+  }
+
+  bool compileForm(FunctionStmt &func, JitForm &out, JitType result) {
+    form = &func;
+    resultType = result;
+    formEntry = as.label();
+    abort = as.label();
+
+    std::vector<Variable *> vars;
+    std::vector<bool> written;
+    for (ASTPtr &param : func.params)
+      vars.push_back(static_cast<Variable *>(param.get()));
+    written.assign(vars.size(), false);
+    collect_block(func.stmts, vars, written);
+    assignSlots(vars);
+
+    for (size_t i = 0; i < out.params.size(); i++) {
+      types[i] = out.params[i];
+      typed[i] = defined[i] = true;
+    }
+
+    thunkPrologue();
+    for (size_t i = 0; i < func.params.size(); i++)
+      as.pushMem(RBX, slotDisp(i));
+    as.call(formEntry);
+    if (!func.params.empty())
+      as.aluImm(ALU_ADD, RSP, (int32_t)(8 * func.params.size()));
+    as.store(R12, CTX_RESULT, RAX);
+    as.alu(ALU_XOR, RAX, RAX);
+    as.jmp(epilogue);
+
+    as.bind(abort);
+    as.movImm(RAX, 1);
+    as.jmp(unwind);
+
+    // a call's frame: the arguments the caller pushed above the return
+    // address, the slots below rbx
+    as.bind(formEntry);
+    as.push(RBP);
+    as.mov(RBP, RSP);
+    as.push(RBX);
+    as.aluImm(ALU_SUB, RSP, (int32_t)(8 * vars.size()));
+    as.mov(RBX, RSP);
+
+    as.load(RAX, R12, CTX_DEPTH);
+    as.aluImm(ALU_ADD, RAX, 1);
+    as.store(R12, CTX_DEPTH, RAX);
+    as.aluMem(ALU_CMP, RAX, R12, CTX_DEPTH_LIMIT);
+    as.jcc(CC_G, abort);
+    as.aluMem(ALU_CMP, RSP, R12, CTX_STACK_LIMIT);
+    as.jcc(CC_B, abort);
+
+    const size_t params = func.params.size();
+    for (size_t i = 0; i < params; i++) {
+      as.load(RAX, RBP, (int32_t)(16 + 8 * (params - 1 - i)));
+      as.store(RBX, slotDisp(i), RAX);
+    }
+
+    if (!block(func.stmts) || !sawReturn)
+      return false;
+
+    // the end of the body returns the last statement's value, which only
+    // the interpreter keeps track of
+    as.jmp(abort);
+
+    thunkEpilogue();
+    as.finish();
+
+    out.result = resultType;
+    out.recursive = recursive;
+    return out.code.load(as.bytes);
+  }
+};
+
+} // namespace
+
+JitCode::~JitCode() {
+#ifdef TENT_JIT_X86_64
+  if (mem != nullptr)
+    munmap(mem, size);
+#endif
+}
+
+bool JitCode::load(const std::vector<uint8_t> &bytes) {
+#ifdef TENT_JIT_X86_64
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size = (bytes.size() + page - 1) / page * page;
+
+  void *pages = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pages == MAP_FAILED)
+    return false;
+
+  std::memcpy(pages, bytes.data(), bytes.size());
+  if (mprotect(pages, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(pages, size);
+    return false;
+  }
+
+  mem = pages;
+  return true;
+#else
+  (void)bytes;
+  return false;
+#endif
+}
+
+uint32_t JitCode::call(void *context, int64_t *slots) const {
+  using Entry = uint32_t (*)(void *, int64_t *);
+  Entry entry;
+  std::memcpy(&entry, &mem, sizeof(entry));
+  return entry(context, slots);
+}
+
+uint32_t JitLoop::run(int64_t *slots) const {
+  JitContext ctx;
+  return code.call(&ctx, slots);
+}
+
+bool JitForm::run(const int64_t *args, int64_t depthLimit,
+                  int64_t &result) const {
+  if (precompiled != nullptr)
+    return precompiled(args, depthLimit, result);
+
+  JitContext ctx;
+  ctx.depthLimit = depthLimit;
+  ctx.stackLimit = native_stack_limit();
+
+  if (code.call(&ctx, const_cast<int64_t *>(args)) != 0)
+    return false;
+
+  result = ctx.result;
+  return true;
+}
+
+bool jit_available() {
+#ifdef TENT_JIT_X86_64
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::unique_ptr<JitLoop>
+jit_compile_loop(WhileStmt &loop,
+                 const std::function<bool(Variable &, JitType &)> &typeOf) {
+  if (!jit_available())
+    return nullptr;
+
+  auto out = std::make_unique<JitLoop>();
+  if (!Compiler(Compiler::LoopUnit).compileLoop(loop, *out, typeOf))
+    return nullptr;
+
+  return out;
+}
+
+std::unique_ptr<JitForm> jit_compile_form(FunctionStmt &func,
+                                          const std::vector<JitType> &params) {
+  if (!jit_available() || func.params.size() != params.size())
+    return nullptr;
+
+  for (JitType type : params) {
+    if (type == JitType::Vec)
+      return nullptr;
+  }
+
+  // what the form returns is only known from its return statements, which
+  // may call the form itself: try an int result, then a float one
+  for (JitType result : {JitType::Int, JitType::Dec}) {
+    auto out = std::make_unique<JitForm>();
+    out->params = params;
+    if (Compiler(Compiler::FormUnit).compileForm(func, *out, result))
+      return out;
+  }
+
+  return nullptr;
+}
+
+static std::vector<PrecompiledForm> precompiledForms;
+
+void jit_add_precompiled(const PrecompiledForm *forms, size_t count) {
+  precompiledForms.insert(precompiledForms.end(), forms, forms + count);
+}
+
+std::unique_ptr<JitForm> jit_precompiled_form(const std::string &file,
+                                              size_t line, size_t column,
+                                              size_t arity) {
+  for (const PrecompiledForm &form : precompiledForms) {
+    if (form.line != line || form.column != column || form.arity != arity ||
+        file != form.file)
+      continue;
+
+    auto out = std::make_unique<JitForm>();
+    out->params.assign(arity, JitType::Int);
+    out->result = JitType::Int;
+    out->recursive = form.recursive;
+    out->precompiled = form.run;
+    return out;
+  }
+
+  return nullptr;
+}
@@ -1,6 +1,7 @@
 #include "lexer.hpp"
 
 #include <cctype>
+#include <initializer_list>
 
 #include "opcodes.hpp"
 #include "types.hpp"
@@ -292,6 +293,26 @@ Token Lexer::getToken() {
                 std::string text = source.substr(startPos, curPos-startPos+1);
 
                 TokenType kind;
+                // The container type names are only types as the receiver
+                // of one of their constructors (bits.new, heap.min, ...);
+                // anywhere else they are plain identifiers, so `set = ...`
+                // or `b.set(i)` still work.
+                auto constructs = [&](std::initializer_list<const char *> methods) {
+                    size_t pos = curPos + 1;
+                    if (pos >= source.size() || source[pos] != '.')
+                        return false;
+
+                    size_t end = ++pos;
+                    while (end < source.size() && (isalnum(source[end]) || source[end] == '_'))
+                        end++;
+
+                    const std::string method = source.substr(pos, end - pos);
+                    for (const char *name : methods) {
+                        if (method == name)
+                            return true;
+                    }
+                    return false;
+                };
 
                 if (text == "int") {
                     kind = TokenType::TYPE_INT;
@@ -303,6 +324,14 @@ Token Lexer::getToken() {
                     kind = TokenType::TYPE_BOOL;
                 } else if (text == "vec") {
                     kind = TokenType::TYPE_VEC;
+                } else if (text == "bits" && constructs({"new"})) {
+                    kind = TokenType::TYPE_BITS;
+                } else if (text == "deque" && constructs({"new"})) {
+                    kind = TokenType::TYPE_DEQUE;
+                } else if (text == "heap" && constructs({"min", "max"})) {
+                    kind = TokenType::TYPE_HEAP;
+                } else if (text == "set" && constructs({"new"})) {
+                    kind = TokenType::TYPE_SET;
                 } else if (text == "load") {
                     kind = TokenType::LOAD;
                 } else if (text == "form") {
@@ -311,6 +340,8 @@ Token Lexer::getToken() {
                     kind = TokenType::WITH;
                 } else if (text == "return") {
                     kind = TokenType::RETURN;
+                } else if (text == "yield") {
+                    kind = TokenType::YIELD;
                 } else if (text == "class") {
                     kind = TokenType::CLASS;
                 } else if (text == "if") {
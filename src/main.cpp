@@ -1,169 +1,3 @@
-#include <fstream>
-#include <iostream>
+#include "driver.hpp"
 
-#include <cstdint>
-#include <string>
-
-#define TENT_MAIN_CPP_FILE
-#include "args.hpp"
-#include "diagnostics.hpp"
-#include "errors.hpp"
-#include "evaluator.hpp"
-#include "lexer.hpp"
-#include "parser.hpp"
-
-uint64_t runtime_flags = 0;
-
-std::string SRC_FILENAME, PROG_NAME;
-std::vector<std::string> prog_args, search_dirs;
-
-void start_repl(const std::vector<std::string> &search_dirs) {
-  std::cout << BOLD << CYAN << "Tent Interactive REPL\n"
-            << GRAY << "Type 'exit' or press Ctrl+C to quit.\n\n"
-            << RESET;
-
-  std::string buffer;
-  int openBraces = 0, openParens = 0;
-
-  while (true) {
-    std::string line;
-
-    if (!std::getline(std::cin, line)) {
-      std::cout << "\n" << GRAY << "Exiting REPL..." << RESET << std::endl;
-      break;
-    }
-
-    if (line == "exit") {
-      break;
-    }
-
-    buffer += line + "\n";
-
-    openBraces = openParens = 0;
-
-    for (char c : buffer) {
-      if (c == '{')
-        openBraces++;
-      if (c == '}')
-        openBraces--;
-      if (c == '(')
-        openParens++;
-      if (c == ')')
-        openParens--;
-    }
-
-    if (openBraces > 0 || openParens > 0)
-      continue;
-
-    Diagnostics diags;
-
-    try {
-      Lexer lexer(buffer, diags);
-      lexer.nextChar();
-      lexer.getTokens();
-
-      if (diags.has_errors()) {
-        diags.print_errors();
-        buffer.clear();
-        continue;
-      }
-
-      Parser parser(lexer.tokens, diags, "<stdin>");
-      ASTPtr program = parser.parse_program();
-
-      if (diags.has_errors()) {
-        diags.print_errors();
-        buffer.clear();
-        continue;
-      }
-
-      Evaluator evaluator(buffer, diags, "<stdin>", search_dirs);
-      evaluator.evalProgram(std::move(program), {});
-
-      if (diags.has_errors()) {
-        diags.print_errors();
-        buffer.clear();
-        continue;
-      }
-    } catch (const std::exception &e) {
-      if (!diags.has_errors()) {
-        diags.report<RuntimeError>(e.what(), Span(), "", "<stdin>");
-      }
-      diags.print_errors();
-    }
-
-    buffer.clear();
-  }
-}
-
-int32_t main(int32_t argc, char **argv) {
-  parseArgs(argc, argv);
-
-  if (IS_FLAG_SET(REPL)) {
-    start_repl(search_dirs);
-    return 0;
-  }
-
-  std::ifstream fileHandle(SRC_FILENAME);
-
-  if (!fileHandle.is_open()) {
-    std::cerr << "File error: could not open file '" << SRC_FILENAME << "'."
-              << std::endl;
-    return 1;
-  }
-
-  std::string output;
-  std::string line;
-
-  while (std::getline(fileHandle, line)) {
-    output += line;
-    output.push_back('\n');
-  }
-
-  fileHandle.close();
-
-  ASTPtr program = nullptr;
-
-  Diagnostics diags;
-
-  Lexer lexer(output, diags, SRC_FILENAME);
-
-  lexer.nextChar();
-  lexer.getTokens();
-
-  if (diags.has_errors()) {
-    diags.print_errors();
-    return 1;
-  }
-
-  Parser parser(lexer.tokens, diags, SRC_FILENAME);
-  program = parser.parse_program();
-
-  if (diags.has_errors()) {
-    diags.print_errors();
-    return 1;
-  }
-
-  if (IS_FLAG_SET(DEBUG))
-    program->print(0);
-
-  if (!IS_FLAG_SET(DRY_RUN)) {
-    try {
-      Evaluator evaluator(output, diags, SRC_FILENAME, search_dirs);
-      evaluator.evalProgram(std::move(program), prog_args);
-    } catch (const std::exception &e) {
-      if (!diags.has_errors()) {
-        diags.report<RuntimeError>(e.what(), Span(), "", SRC_FILENAME);
-      }
-      diags.print_errors();
-      return 1;
-    }
-  }
-
-  if (diags.has_errors()) {
-    diags.print_errors();
-    return 1;
-  }
-
-  return 0;
-}
+int32_t main(int32_t argc, char **argv) { return tent_main(argc, argv); }
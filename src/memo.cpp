@@ -0,0 +1,76 @@
+#include "memo.hpp"
+
+#include <cstring>
+#include <variant>
+
+namespace {
+bool is_scalar(const Value &val) {
+  if (val.typeInt || val.typeFloat || val.typeStr || val.typeBool ||
+      val.typeVec || val.typeDic || val.typeBits || val.typeDeque ||
+      val.typeHeap || val.typeSet || val.isExit)
+    return false;
+
+  return std::holds_alternative<tn_int_t>(val.v) ||
+         std::holds_alternative<tn_dec_t>(val.v) ||
+         std::holds_alternative<tn_bool_t>(val.v) ||
+         std::holds_alternative<std::string>(val.v) ||
+         std::holds_alternative<NullLiteral>(val.v);
+}
+
+template <typename T> void append_bytes(std::string &key, const T &value) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  key.append(bytes, sizeof(T));
+}
+} // namespace
+
+bool MemoCache::makeKey(const std::vector<Value> &args, std::string &key) {
+  key.clear();
+
+  for (const Value &arg : args) {
+    if (!is_scalar(arg))
+      return false;
+
+    // the type tag keeps 1, 1.0, true and "1" apart
+    key.push_back((char)arg.v.index());
+
+    if (auto i = std::get_if<tn_int_t>(&arg.v)) {
+      append_bytes(key, *i);
+    } else if (auto d = std::get_if<tn_dec_t>(&arg.v)) {
+      append_bytes(key, *d);
+    } else if (auto b = std::get_if<tn_bool_t>(&arg.v)) {
+      key.push_back(*b ? 1 : 0);
+    } else if (auto s = std::get_if<std::string>(&arg.v)) {
+      append_bytes(key, s->size());
+      key.append(*s);
+    }
+  }
+
+  return true;
+}
+
+const Value *MemoCache::find(const std::string &key) {
+  auto found = index.find(key);
+  if (found == index.end()) {
+    misses++;
+    return nullptr;
+  }
+
+  hits++;
+  entries.splice(entries.begin(), entries, found->second);
+  return &found->second->result;
+}
+
+void MemoCache::insert(std::string key, const Value &result) {
+  if (capacity == 0 || !is_scalar(result) || index.count(key))
+    return;
+
+  if (entries.size() == capacity) {
+    index.erase(entries.back().key);
+    entries.pop_back();
+    evictions++;
+  }
+
+  entries.push_front(Entry{std::move(key), result});
+  index.emplace(entries.front().key, entries.begin());
+}
@@ -0,0 +1,612 @@
+#include "evaluator.hpp"
+
+#include <algorithm>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "bits.hpp"
+#include "containers.hpp"
+#include "errors.hpp"
+#include "sort.hpp"
+#include "types.hpp"
+
+bool Evaluator::checkIntArgs(const std::string &signature,
+                             const std::vector<Value> &args, size_t required,
+                             size_t optional, const Span &span) {
+  if (args.size() < required || args.size() > required + optional) {
+    diags.report<TypeError>(signature + ": invalid argument(s) passed: "
+                                "wrong number of arguments",
+                            span, "", filename);
+    return false;
+  }
+
+  for (const Value &arg : args) {
+    if (!std::holds_alternative<tn_int_t>(arg.v)) {
+      diags.report<TypeError>(signature + ": invalid argument(s) passed: "
+                                  "expected 'int', got '" +
+                                  arg.getTypeName() + "'",
+                              arg.span, "", filename);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool Evaluator::checkSliceArgs(const std::string &signature,
+                               const std::vector<Value> &args, size_t size,
+                               const Span &span, size_t &start, size_t &stop) {
+  if (!checkIntArgs(signature, args, 1, 1, span))
+    return false;
+
+  tn_int_t first = std::get<tn_int_t>(args[0].v);
+  tn_int_t last = args.size() == 2 ? std::get<tn_int_t>(args[1].v)
+                                   : (tn_int_t)size;
+
+  if (first < 0 || last < first || (size_t)last > size) {
+    diags.report<Error>(signature + ": range [" + std::to_string(first) +
+                            ", " + std::to_string(last) +
+                            ") is out of bounds for length " +
+                            std::to_string(size),
+                        span, "", filename);
+    return false;
+  }
+
+  start = (size_t)first;
+  stop = (size_t)last;
+  return true;
+}
+
+void Evaluator::registerBitsMethods() {
+  // bounds check shared by the single-index methods; reports and returns
+  // false when 'idx' is outside of 'bits'
+  auto checkIndex = [this](const Bits &bits, tn_int_t idx, const Span &span) {
+    if (idx < 0 || (size_t)idx >= bits.size()) {
+      diags.report<Error>("index " + std::to_string(idx) +
+                              " is out of bounds for bits of size " +
+                              std::to_string(bits.size()),
+                          span, "", filename);
+      return false;
+    }
+
+    return true;
+  };
+
+  nativeMethods["type_bits"]["new"] = [this](const Value &,
+                                             const std::vector<Value> &rhs) {
+    // bits.new(n: int[, v: bool]): return a bit array of size 'n' with every
+    // bit cleared, or set if 'v' is true.
+    if (rhs.empty() || rhs.size() > 2 ||
+        !std::holds_alternative<tn_int_t>(rhs[0].v) ||
+        std::get<tn_int_t>(rhs[0].v) < 0) {
+      diags.report<TypeError>("bits.new(n: int[, v: bool]): invalid "
+                              "argument(s) passed: first argument must be a "
+                              "non-negative 'int'",
+                              rhs.empty() ? Span() : rhs[0].span, "",
+                              filename);
+      return Value();
+    }
+
+    bool fill = false;
+    if (rhs.size() == 2) {
+      if (auto b = std::get_if<tn_bool_t>(&rhs[1].v)) {
+        fill = *b;
+      } else if (auto i = std::get_if<tn_int_t>(&rhs[1].v)) {
+        fill = *i != 0;
+      } else {
+        diags.report<TypeError>("bits.new(n: int[, v: bool]): invalid "
+                                "argument(s) passed: second argument must be "
+                                "'bool' or 'int'",
+                                rhs[1].span, "", filename);
+        return Value();
+      }
+    }
+
+    return Value(std::make_shared<Bits>(
+        (size_t)std::get<tn_int_t>(rhs[0].v), fill));
+  };
+
+  nativeMethods["bits"]["len"] = [](const Value &lhs,
+                                    const std::vector<Value> &) {
+    return Value((tn_int_t)std::get<Value::BitsT>(lhs.v)->size());
+  };
+
+  nativeMethods["bits"]["get"] = [this, checkIndex](
+                                     const Value &lhs,
+                                     const std::vector<Value> &rhs) {
+    const Bits &bits = *std::get<Value::BitsT>(lhs.v);
+    if (!checkIntArgs("bits.get(i: int)", rhs, 1, 0, lhs.span))
+      return Value();
+
+    tn_int_t idx = std::get<tn_int_t>(rhs[0].v);
+    if (!checkIndex(bits, idx, rhs[0].span))
+      return Value();
+
+    return Value(bits.get((size_t)idx));
+  };
+
+  auto singleBitOp = [this, checkIndex](std::string signature,
+                                        void (Bits::*op)(size_t)) {
+    return [this, checkIndex, signature, op](const Value &lhs,
+                                             const std::vector<Value> &rhs) {
+      Bits &bits = *std::get<Value::BitsT>(lhs.v);
+      if (!checkIntArgs(signature, rhs, 1, 0, lhs.span))
+        return Value();
+
+      tn_int_t idx = std::get<tn_int_t>(rhs[0].v);
+      if (checkIndex(bits, idx, rhs[0].span))
+        (bits.*op)((size_t)idx);
+
+      return Value();
+    };
+  };
+
+  nativeMethods["bits"]["set"] = singleBitOp("bits.set(i: int)", &Bits::set);
+  nativeMethods["bits"]["clear"] =
+      singleBitOp("bits.clear(i: int)", &Bits::clear);
+  nativeMethods["bits"]["flip"] = singleBitOp("bits.flip(i: int)", &Bits::flip);
+
+  auto rangeOp = [this](std::string signature,
+                        void (Bits::*op)(size_t, size_t, size_t)) {
+    return [this, signature, op](const Value &lhs,
+                                 const std::vector<Value> &rhs) {
+      Bits &bits = *std::get<Value::BitsT>(lhs.v);
+      if (!checkIntArgs(signature, rhs, 2, 1, lhs.span))
+        return Value();
+
+      tn_int_t start = std::get<tn_int_t>(rhs[0].v);
+      tn_int_t stop = std::get<tn_int_t>(rhs[1].v);
+      tn_int_t step = rhs.size() == 3 ? std::get<tn_int_t>(rhs[2].v) : 1;
+
+      if (start < 0 || stop < 0 || step < 1) {
+        diags.report<Error>(signature + ": start and stop must be "
+                                        "non-negative and step must be "
+                                        "positive",
+                            lhs.span, "", filename);
+        return Value();
+      }
+
+      (bits.*op)((size_t)start, (size_t)stop, (size_t)step);
+      return Value();
+    };
+  };
+
+  nativeMethods["bits"]["set_range"] = rangeOp(
+      "bits.set_range(start: int, stop: int[, step: int])", &Bits::setRange);
+  nativeMethods["bits"]["clear_range"] =
+      rangeOp("bits.clear_range(start: int, stop: int[, step: int])",
+              &Bits::clearRange);
+
+  nativeMethods["bits"]["popcount"] = [](const Value &lhs,
+                                         const std::vector<Value> &) {
+    return Value((tn_int_t)std::get<Value::BitsT>(lhs.v)->popcount());
+  };
+
+  nativeMethods["bits"]["find_next_set"] =
+      [this](const Value &lhs, const std::vector<Value> &rhs) {
+        // bits.find_next_set(i: int): index of the first set bit at or after
+        // 'i', or -1 if there is none.
+        const Bits &bits = *std::get<Value::BitsT>(lhs.v);
+        if (!checkIntArgs("bits.find_next_set(i: int)", rhs, 1, 0, lhs.span))
+          return Value();
+
+        tn_int_t from = std::get<tn_int_t>(rhs[0].v);
+        size_t found = bits.findNextSet(from < 0 ? 0 : (size_t)from);
+
+        return Value(found == Bits::npos ? tn_int_t(-1) : (tn_int_t)found);
+      };
+}
+
+void Evaluator::registerVecSortMethods() {
+  // reports the first element of 'vec' that has no order; sorting and
+  // searching are only defined over numbers and strings
+  auto checkOrderable = [this](const ValueVec &vec,
+                               const std::string &signature, const Span &span) {
+    for (const Value &elem : vec) {
+      if (!is_orderable_val(elem)) {
+        diags.report<TypeError>(signature + ": cannot order element of type '" +
+                                    elem.getTypeName() + "'",
+                                span, "Only numbers and strings can be sorted",
+                                filename);
+        return false;
+      }
+    }
+
+    return true;
+  };
+
+  auto sortMethod = [checkOrderable](std::string signature,
+                                     bool descending) {
+    return [checkOrderable, signature, descending](
+               const Value &lhs, const std::vector<Value> &) {
+      ValueVec &vec = *std::get<Value::VecT>(lhs.v);
+      if (!checkOrderable(vec, signature, lhs.span))
+        return Value();
+
+      vec.edit([descending](std::vector<Value> &elems) {
+        sort_values(elems, descending);
+      });
+      return Value();
+    };
+  };
+
+  nativeMethods["vec"]["sort"] = sortMethod("vec.sort()", false);
+  nativeMethods["vec"]["sort_desc"] = sortMethod("vec.sort_desc()", true);
+
+  // both searches expect the vector to already be sorted ascending
+  auto searchMethod = [this](std::string signature, bool exact) {
+    return [this, signature, exact](const Value &lhs,
+                                    const std::vector<Value> &rhs) {
+      const ValueVec &vec = *std::get<Value::VecT>(lhs.v);
+      if (rhs.size() != 1 || !is_orderable_val(rhs[0])) {
+        diags.report<TypeError>(signature + ": invalid argument(s) passed: "
+                                            "takes one number or string",
+                                lhs.span, "", filename);
+        return Value();
+      }
+
+      size_t idx = lower_bound_value(vec, rhs[0]);
+      if (exact && (idx == vec.size() || compare_values(vec[idx], rhs[0])))
+        return Value(tn_int_t(-1));
+
+      return Value((tn_int_t)idx);
+    };
+  };
+
+  nativeMethods["vec"]["bsearch"] = searchMethod("vec.bsearch(x: any)", true);
+  nativeMethods["vec"]["lower_bound"] =
+      searchMethod("vec.lower_bound(x: any)", false);
+
+  nativeMethods["vec"]["unique"] = [this, checkOrderable](
+                                       const Value &lhs,
+                                       const std::vector<Value> &) {
+    // vec.unique(): drop adjacent duplicates in place, so a sorted vector
+    // ends up with one copy of each element
+    ValueVec &vec = *std::get<Value::VecT>(lhs.v);
+    if (!checkOrderable(vec, "vec.unique()", lhs.span))
+      return Value();
+
+    vec.edit([](std::vector<Value> &elems) {
+      auto last = std::unique(elems.begin(), elems.end(),
+                              [](const Value &a, const Value &b) {
+                                return compare_values(a, b) == 0;
+                              });
+      elems.erase(last, elems.end());
+    });
+    return Value();
+  };
+}
+
+void Evaluator::registerContainerMethods() {
+  auto checkArgCount = [this](const std::string &signature,
+                              const std::vector<Value> &args, size_t count,
+                              const Span &span) {
+    if (args.size() != count) {
+      diags.report<TypeError>(signature + ": invalid argument(s) passed: "
+                                          "wrong number of arguments",
+                              span, "", filename);
+      return false;
+    }
+
+    return true;
+  };
+
+  // heap keys and set elements are hashed or compared, so they have to be
+  // numbers or strings
+  auto checkOrderableArg = [this](const std::string &signature,
+                                  const Value &arg) {
+    if (!is_orderable_val(arg)) {
+      diags.report<TypeError>(signature + ": invalid argument(s) passed: "
+                                          "expected a number or string, got '" +
+                                  arg.getTypeName() + "'",
+                              arg.span, "", filename);
+      return false;
+    }
+
+    return true;
+  };
+
+  // deque
+
+  nativeMethods["type_deque"]["new"] = [](const Value &,
+                                          const std::vector<Value> &) {
+    return Value(std::make_shared<ValueDeque>());
+  };
+
+  nativeMethods["deque"]["len"] = [](const Value &lhs,
+                                     const std::vector<Value> &) {
+    return Value((tn_int_t)std::get<Value::DequeT>(lhs.v)->size());
+  };
+
+  auto dequePush = [checkArgCount](std::string signature, bool front) {
+    return [checkArgCount, signature, front](const Value &lhs,
+                                             std::vector<Value> &rhs) {
+      ValueDeque &deque = *std::get<Value::DequeT>(lhs.v);
+      if (!checkArgCount(signature, rhs, 1, lhs.span))
+        return Value();
+
+      if (front)
+        deque.pushFront(std::move(rhs[0]));
+      else
+        deque.pushBack(std::move(rhs[0]));
+      return Value();
+    };
+  };
+
+  nativeMethods["deque"]["push_back"] =
+      dequePush("deque.push_back(x: any)", false);
+  nativeMethods["deque"]["push_front"] =
+      dequePush("deque.push_front(x: any)", true);
+
+  // pop_*/front/back on an empty deque report an error and return null
+  auto dequeEnd = [this](std::string signature, bool front, bool remove) {
+    return [this, signature, front, remove](const Value &lhs,
+                                            const std::vector<Value> &) {
+      ValueDeque &deque = *std::get<Value::DequeT>(lhs.v);
+      if (deque.size() == 0) {
+        diags.report<Error>(signature + ": deque is empty", lhs.span, "",
+                            filename);
+        return Value();
+      }
+
+      if (remove)
+        return front ? deque.popFront() : deque.popBack();
+      return front ? deque.front() : deque.back();
+    };
+  };
+
+  nativeMethods["deque"]["pop_front"] =
+      dequeEnd("deque.pop_front()", true, true);
+  nativeMethods["deque"]["pop_back"] = dequeEnd("deque.pop_back()", false, true);
+  nativeMethods["deque"]["front"] = dequeEnd("deque.front()", true, false);
+  nativeMethods["deque"]["back"] = dequeEnd("deque.back()", false, false);
+
+  // checks args[0] as an index into 'deque'
+  auto checkDequeIndex = [this](const std::string &signature,
+                                const ValueDeque &deque,
+                                const std::vector<Value> &rhs) {
+    tn_int_t idx = std::get<tn_int_t>(rhs[0].v);
+    if (idx < 0 || (size_t)idx >= deque.size()) {
+      diags.report<Error>(signature + ": index " + std::to_string(idx) +
+                              " is out of bounds for deque of size " +
+                              std::to_string(deque.size()),
+                          rhs[0].span, "", filename);
+      return false;
+    }
+
+    return true;
+  };
+
+  nativeMethods["deque"]["get"] = [this, checkDequeIndex](
+                                      const Value &lhs,
+                                      const std::vector<Value> &rhs) {
+    const ValueDeque &deque = *std::get<Value::DequeT>(lhs.v);
+    if (!checkIntArgs("deque.get(i: int)", rhs, 1, 0, lhs.span) ||
+        !checkDequeIndex("deque.get(i: int)", deque, rhs))
+      return Value();
+
+    return deque[(size_t)std::get<tn_int_t>(rhs[0].v)];
+  };
+
+  nativeMethods["deque"]["set"] = [this, checkArgCount, checkDequeIndex](
+                                      const Value &lhs,
+                                      std::vector<Value> &rhs) {
+    const std::string signature = "deque.set(i: int, x: any)";
+    ValueDeque &deque = *std::get<Value::DequeT>(lhs.v);
+    if (!checkArgCount(signature, rhs, 2, lhs.span))
+      return Value();
+
+    if (!std::holds_alternative<tn_int_t>(rhs[0].v)) {
+      diags.report<TypeError>(signature + ": invalid argument(s) passed: "
+                                          "expected 'int', got '" +
+                                  rhs[0].getTypeName() + "'",
+                              rhs[0].span, "", filename);
+      return Value();
+    }
+
+    if (checkDequeIndex(signature, deque, rhs))
+      deque.set((size_t)std::get<tn_int_t>(rhs[0].v), std::move(rhs[1]));
+    return Value();
+  };
+
+  // heap
+
+  nativeMethods["type_heap"]["min"] = [](const Value &,
+                                         const std::vector<Value> &) {
+    return Value(std::make_shared<ValueHeap>(false));
+  };
+
+  nativeMethods["type_heap"]["max"] = [](const Value &,
+                                         const std::vector<Value> &) {
+    return Value(std::make_shared<ValueHeap>(true));
+  };
+
+  nativeMethods["heap"]["len"] = [](const Value &lhs,
+                                    const std::vector<Value> &) {
+    return Value((tn_int_t)std::get<Value::HeapT>(lhs.v)->size());
+  };
+
+  nativeMethods["heap"]["push"] = [this, checkOrderableArg](
+                                      const Value &lhs,
+                                      const std::vector<Value> &rhs) {
+    // heap.push(x: any[, key: any]): add 'x' ordered by 'key', which
+    // defaults to 'x' itself
+    const std::string signature = "heap.push(x: any[, key: any])";
+    ValueHeap &heap = *std::get<Value::HeapT>(lhs.v);
+    if (rhs.empty() || rhs.size() > 2) {
+      diags.report<TypeError>(signature + ": invalid argument(s) passed: "
+                                          "wrong number of arguments",
+                              lhs.span, "", filename);
+      return Value();
+    }
+
+    const Value &key = rhs.back();
+    if (!checkOrderableArg(signature, key))
+      return Value();
+
+    heap.push(key, rhs[0]);
+    return Value();
+  };
+
+  auto heapTop = [this](std::string signature, bool remove) {
+    return [this, signature, remove](const Value &lhs,
+                                     const std::vector<Value> &) {
+      ValueHeap &heap = *std::get<Value::HeapT>(lhs.v);
+      if (heap.size() == 0) {
+        diags.report<Error>(signature + ": heap is empty", lhs.span, "",
+                            filename);
+        return Value();
+      }
+
+      return remove ? heap.pop().item : heap.top().item;
+    };
+  };
+
+  nativeMethods["heap"]["pop"] = heapTop("heap.pop()", true);
+  nativeMethods["heap"]["peek"] = heapTop("heap.peek()", false);
+
+  // set
+
+  nativeMethods["type_set"]["new"] = [this, checkOrderableArg](
+                                         const Value &,
+                                         const std::vector<Value> &rhs) {
+    // set.new([elems: vec]): empty set, or one holding the elements of
+    // 'elems'
+    const std::string signature = "set.new([elems: vec])";
+    auto set = std::make_shared<ValueSet>();
+    if (rhs.empty())
+      return Value(set);
+
+    if (rhs.size() > 1 || !std::holds_alternative<Value::VecT>(rhs[0].v)) {
+      diags.report<TypeError>(signature + ": invalid argument(s) passed: "
+                                          "takes an optional 'vec'",
+                              rhs.empty() ? Span() : rhs[0].span, "",
+                              filename);
+      return Value();
+    }
+
+    for (const Value &elem : *std::get<Value::VecT>(rhs[0].v)) {
+      if (!checkOrderableArg(signature, Value(elem).setSpan(rhs[0].span)))
+        return Value();
+      set->insert(elem);
+    }
+
+    return Value(set);
+  };
+
+  nativeMethods["set"]["len"] = [](const Value &lhs,
+                                   const std::vector<Value> &) {
+    return Value((tn_int_t)std::get<Value::SetT>(lhs.v)->size());
+  };
+
+  // add/remove report whether the set changed, has whether 'x' is present
+  auto setOp = [checkArgCount, checkOrderableArg](std::string signature,
+                                                  int op) {
+    return [checkArgCount, checkOrderableArg, signature,
+            op](const Value &lhs, const std::vector<Value> &rhs) {
+      ValueSet &set = *std::get<Value::SetT>(lhs.v);
+      if (!checkArgCount(signature, rhs, 1, lhs.span) ||
+          !checkOrderableArg(signature, rhs[0]))
+        return Value();
+
+      if (op == 0)
+        return Value(set.insert(rhs[0]));
+      if (op == 1)
+        return Value(set.erase(rhs[0]));
+      return Value(set.contains(rhs[0]));
+    };
+  };
+
+  nativeMethods["set"]["add"] = setOp("set.add(x: any)", 0);
+  nativeMethods["set"]["remove"] = setOp("set.remove(x: any)", 1);
+  nativeMethods["set"]["has"] = setOp("set.has(x: any)", 2);
+
+  nativeMethods["set"]["values"] = [](const Value &lhs,
+                                      const std::vector<Value> &) {
+    return make_vec(std::get<Value::SetT>(lhs.v)->values());
+  };
+}
+
+void Evaluator::registerCapacityMethods() {
+  // all three reserve methods take one non-negative size
+  auto checkReserveArg = [this](const std::string &signature,
+                                const std::vector<Value> &rhs,
+                                const Span &span) {
+    if (!checkIntArgs(signature, rhs, 1, 0, span))
+      return false;
+
+    if (std::get<tn_int_t>(rhs[0].v) < 0) {
+      diags.report<Error>(signature + ": size must be non-negative",
+                          rhs[0].span, "", filename);
+      return false;
+    }
+
+    return true;
+  };
+
+  nativeMethods["vec"]["reserve"] = [checkReserveArg](
+                                        const Value &lhs,
+                                        const std::vector<Value> &rhs) {
+    // vec.reserve(n: int): make room for 'n' elements so pushes up to that
+    // size do not reallocate
+    if (checkReserveArg("vec.reserve(n: int)", rhs, lhs.span))
+      std::get<Value::VecT>(lhs.v)->reserve(
+          (size_t)std::get<tn_int_t>(rhs[0].v));
+
+    return Value();
+  };
+
+  nativeMethods["vec"]["capacity"] = [](const Value &lhs,
+                                        const std::vector<Value> &) {
+    return Value((tn_int_t)std::get<Value::VecT>(lhs.v)->capacity());
+  };
+
+  nativeMethods["vec"]["shrink"] = [](const Value &lhs,
+                                      const std::vector<Value> &) {
+    std::get<Value::VecT>(lhs.v)->shrink();
+    return Value();
+  };
+
+  // Dictionaries are node-based (std::map), so there is no spare storage to
+  // reserve or release; the methods exist so scripts can treat all three
+  // container types alike. capacity() is the number of entries.
+  nativeMethods["dic"]["reserve"] = [checkReserveArg](
+                                        const Value &lhs,
+                                        const std::vector<Value> &rhs) {
+    checkReserveArg("dic.reserve(n: int)", rhs, lhs.span);
+    return Value();
+  };
+
+  nativeMethods["dic"]["capacity"] = [](const Value &lhs,
+                                        const std::vector<Value> &) {
+    return Value((tn_int_t)std::get<Value::DicT>(lhs.v)->size());
+  };
+
+  nativeMethods["dic"]["shrink"] = [](const Value &,
+                                      const std::vector<Value> &) {
+    return Value();
+  };
+
+  // A string is a value, not a handle, so these get the variable's own
+  // string when called on a variable (see the DOT dispatch); on any other
+  // expression they change a copy and have no lasting effect.
+  strMutators["reserve"] = [checkReserveArg](Value &lhs,
+                                             const std::vector<Value> &rhs) {
+    if (checkReserveArg("str.reserve(n: int)", rhs, lhs.span))
+      std::get<std::string>(lhs.v).reserve(
+          (size_t)std::get<tn_int_t>(rhs[0].v));
+
+    return Value();
+  };
+
+  nativeMethods["str"]["capacity"] = [](const Value &lhs,
+                                        const std::vector<Value> &) {
+    return Value((tn_int_t)std::get<std::string>(lhs.v).capacity());
+  };
+
+  strMutators["shrink"] = [](Value &lhs, const std::vector<Value> &) {
+    std::get<std::string>(lhs.v).shrink_to_fit();
+    return Value();
+  };
+}
@@ -0,0 +1,28 @@
+#include "names.hpp"
+
+#include <deque>
+#include <unordered_map>
+
+namespace {
+// std::deque keeps references to the stored names valid as it grows
+std::deque<std::string> &nameList() {
+  static std::deque<std::string> names;
+  return names;
+}
+
+std::unordered_map<std::string, uint32_t> &nameIds() {
+  static std::unordered_map<std::string, uint32_t> ids;
+  return ids;
+}
+} // namespace
+
+uint32_t intern_name(const std::string &name) {
+  auto [it, inserted] =
+      nameIds().try_emplace(name, (uint32_t)nameList().size());
+  if (inserted)
+    nameList().push_back(name);
+
+  return it->second;
+}
+
+const std::string &interned_name(uint32_t id) { return nameList()[id]; }
@@ -0,0 +1,103 @@
+#include "native_stack.hpp"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// room left below native_stack_limit() for code between two checks
+constexpr size_t STACK_MARGIN = size_t(1) << 20;
+
+thread_local uintptr_t stack_limit = 0;
+
+struct StackTask {
+  const std::function<int()> *fn;
+  int result;
+  // lowest usable address and usable size of the new stack; Windows only
+  // knows the size up front
+  uintptr_t low;
+  size_t bytes;
+};
+
+#if defined(_WIN32) || defined(_WIN64)
+DWORD WINAPI runTask(LPVOID arg) {
+  StackTask *task = static_cast<StackTask *>(arg);
+  // the reservation ends 'bytes' below where the thread starts
+  const uintptr_t top = (uintptr_t)&task;
+  if (task->bytes > 2 * STACK_MARGIN && top > task->bytes)
+    stack_limit = top - task->bytes + STACK_MARGIN;
+  task->result = (*task->fn)();
+  return 0;
+}
+#else
+void *runTask(void *arg) {
+  StackTask *task = static_cast<StackTask *>(arg);
+  if (task->bytes > 2 * STACK_MARGIN)
+    stack_limit = task->low + STACK_MARGIN;
+  task->result = (*task->fn)();
+  return nullptr;
+}
+#endif
+} // namespace
+
+int run_on_large_stack(size_t bytes, const std::function<int()> &fn) {
+  StackTask task{&fn, 0, 0, bytes};
+
+#if defined(_WIN32) || defined(_WIN64)
+  HANDLE thread = CreateThread(nullptr, bytes, runTask, &task,
+                               STACK_SIZE_PARAM_IS_A_RESERVATION, nullptr);
+  if (thread == nullptr)
+    return fn();
+
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+  return task.result;
+#else
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+  flags |= MAP_NORESERVE;
+#endif
+#ifdef MAP_STACK
+  flags |= MAP_STACK;
+#endif
+
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  bytes = (bytes + page - 1) / page * page;
+
+  void *stack = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (stack == MAP_FAILED)
+    return fn();
+
+  // guard page at the low end, so running off the stack still faults
+  mprotect(stack, page, PROT_NONE);
+  task.low = (uintptr_t)stack + page;
+  task.bytes = bytes - page;
+
+  pthread_attr_t attr;
+  pthread_t thread;
+  bool started = pthread_attr_init(&attr) == 0 &&
+                 pthread_attr_setstack(&attr, stack, bytes) == 0 &&
+                 pthread_create(&thread, &attr, runTask, &task) == 0;
+  pthread_attr_destroy(&attr);
+
+  if (!started) {
+    munmap(stack, bytes);
+    return fn();
+  }
+
+  pthread_join(thread, nullptr);
+  munmap(stack, bytes);
+  return task.result;
+#endif
+}
+
+uintptr_t native_stack_limit() { return stack_limit; }
+
+bool native_stack_exhausted() {
+  volatile char here = 0;
+  return (uintptr_t)&here < stack_limit;
+}
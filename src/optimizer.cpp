@@ -0,0 +1,302 @@
+#include "optimizer.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ast.hpp"
+#include "types.hpp"
+
+namespace {
+// an inlined body has to stay cheap, or copying the call site's work into
+// every caller stops paying off
+constexpr size_t MAX_INLINE_NODES = 32;
+
+// Finds the parameter a variable names. Only parameters may be read: any
+// other name would resolve against the callee's scope when called, but
+// against the caller's frame once inlined.
+int64_t param_index(const FunctionStmt &func, uint32_t nameId) {
+  // with a repeated name the last argument is the one bound
+  for (size_t i = func.params.size(); i-- > 0;) {
+    if (static_cast<Variable *>(func.params[i].get())->nameId == nameId)
+      return (int64_t)i;
+  }
+
+  return -1;
+}
+
+// Whether 'node' can be evaluated with the caller's frame on top: no calls,
+// no assignments and no names but parameters. Adds up its size in 'nodes'.
+bool is_pure(const FunctionStmt &func, ASTNode *node, size_t &nodes) {
+  if (node == nullptr || ++nodes > MAX_INLINE_NODES)
+    return false;
+
+  if (dynamic_cast<IntLiteral *>(node) || dynamic_cast<FloatLiteral *>(node) ||
+      dynamic_cast<StrLiteral *>(node) || dynamic_cast<BoolLiteral *>(node))
+    return true;
+
+  if (auto var = dynamic_cast<Variable *>(node))
+    return param_index(func, var->nameId) >= 0;
+
+  if (auto unary = dynamic_cast<UnaryOp *>(node)) {
+    return unary->op != TokenType::INCREMENT &&
+           unary->op != TokenType::DECREMENT &&
+           is_pure(func, unary->operand.get(), nodes);
+  }
+
+  if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+    // method calls and properties go through DOT
+    return !isRightAssoc(bin->op) && bin->op != TokenType::DOT &&
+           is_pure(func, bin->left.get(), nodes) &&
+           is_pure(func, bin->right.get(), nodes);
+  }
+
+  if (auto vec = dynamic_cast<VecLiteral *>(node)) {
+    for (const ASTPtr &elem : vec->elems) {
+      if (!is_pure(func, elem.get(), nodes))
+        return false;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+ReturnStmt *pure_return(const FunctionStmt &func,
+                        const std::vector<ExpressionStmt> &stmts,
+                        size_t &nodes) {
+  if (stmts.size() != 1 || stmts[0].kind != StmtKind::Return)
+    return nullptr;
+
+  auto ret = static_cast<ReturnStmt *>(stmts[0].expr.get());
+  return is_pure(func, ret->value.get(), nodes) ? ret : nullptr;
+}
+
+// Reduces 'stmts' (from 'first' on) to guarded returns: a chain of
+// `if c { return a; }`, if/else and elif, ending in a return on every path.
+bool reduce_body(const FunctionStmt &func,
+                 const std::vector<ExpressionStmt> &stmts, size_t first,
+                 InlineBody &body, size_t &nodes) {
+  if (first >= stmts.size())
+    return false;
+
+  const ExpressionStmt &stmt = stmts[first];
+
+  if (stmt.kind == StmtKind::Return) {
+    if (first + 1 != stmts.size())
+      return false;
+
+    body.result = static_cast<ReturnStmt *>(stmt.expr.get());
+    return is_pure(func, body.result->value.get(), nodes);
+  }
+
+  if (stmt.kind != StmtKind::If)
+    return false;
+
+  auto ifStmt = static_cast<IfStmt *>(stmt.expr.get());
+  ReturnStmt *ret = pure_return(func, ifStmt->thenClauseStmts, nodes);
+  if (ret == nullptr || !is_pure(func, ifStmt->condition.get(), nodes))
+    return false;
+
+  body.guards.push_back(InlineBody::Guard{ifStmt->test.get(), ret});
+
+  if (ifStmt->elseClauseStmts.empty())
+    return reduce_body(func, stmts, first + 1, body, nodes);
+
+  return first + 1 == stmts.size() &&
+         reduce_body(func, ifStmt->elseClauseStmts, 0, body, nodes);
+}
+
+void mark_params(const FunctionStmt &func, ASTNode *node);
+
+void mark_params(const FunctionStmt &func,
+                 const std::vector<ExpressionStmt> &stmts) {
+  for (const ExpressionStmt &stmt : stmts)
+    mark_params(func, stmt.expr.get());
+}
+
+void mark_params(const FunctionStmt &func, ASTNode *node) {
+  if (auto ret = dynamic_cast<ReturnStmt *>(node)) {
+    mark_params(func, ret->value.get());
+  } else if (auto ifStmt = dynamic_cast<IfStmt *>(node)) {
+    // the guard's Condition holds these same nodes
+    mark_params(func, ifStmt->condition.get());
+    mark_params(func, ifStmt->thenClauseStmts);
+    mark_params(func, ifStmt->elseClauseStmts);
+  } else if (auto var = dynamic_cast<Variable *>(node)) {
+    var->inlineParam = (uint32_t)param_index(func, var->nameId);
+  } else if (auto unary = dynamic_cast<UnaryOp *>(node)) {
+    mark_params(func, unary->operand.get());
+  } else if (auto bin = dynamic_cast<BinaryOp *>(node)) {
+    mark_params(func, bin->left.get());
+    mark_params(func, bin->right.get());
+  } else if (auto vec = dynamic_cast<VecLiteral *>(node)) {
+    for (const ASTPtr &elem : vec->elems)
+      mark_params(func, elem.get());
+  }
+}
+
+void try_inline(FunctionStmt &func) {
+  // a @memo form is asked to go through its cache
+  if (func.isGenerator || func.memo)
+    return;
+
+  for (const ASTPtr &param : func.params) {
+    if (!dynamic_cast<Variable *>(param.get()))
+      return;
+  }
+
+  auto body = std::make_unique<InlineBody>();
+  size_t nodes = 0;
+  if (!reduce_body(func, func.stmts, 0, *body, nodes))
+    return;
+
+  mark_params(func, func.stmts);
+
+  func.inlineBody = std::move(body);
+}
+
+// A comparison of a variable against a variable or an int literal.
+void fuse_condition(Condition &cond) {
+  if (cond.left)
+    fuse_condition(*cond.left);
+  if (cond.right)
+    fuse_condition(*cond.right);
+
+  if (cond.kind != Condition::Compare || !dynamic_cast<Variable *>(cond.expr))
+    return;
+
+  if (auto lit = dynamic_cast<IntLiteral *>(cond.rhs)) {
+    cond.rhsImm = true;
+    cond.imm = lit->value;
+  } else if (!dynamic_cast<Variable *>(cond.rhs)) {
+    return;
+  }
+
+  cond.fused = true;
+}
+
+bool fusable_op(TokenType op) {
+  return op == TokenType::ADD || op == TokenType::SUB || op == TokenType::MUL;
+}
+
+// `x = x op e` or `x op= e`
+bool fuse_update(BinaryOp &bin, FusedStmt &fused) {
+  auto target = dynamic_cast<Variable *>(bin.left.get());
+  if (target == nullptr)
+    return false;
+
+  ASTNode *operand = bin.right.get();
+
+  if (bin.op == TokenType::ASSIGN) {
+    auto rhs = dynamic_cast<BinaryOp *>(operand);
+    auto self = rhs ? dynamic_cast<Variable *>(rhs->left.get()) : nullptr;
+    if (self == nullptr || self->nameId != target->nameId ||
+        !fusable_op(rhs->op))
+      return false;
+
+    fused.op = rhs->op;
+    operand = rhs->right.get();
+  } else {
+    TokenType op;
+    if (!getCompoundAssignOp(bin.op, op) || !fusable_op(op))
+      return false;
+
+    fused.op = op;
+    fused.compound = true;
+  }
+
+  fused.target = target;
+
+  if (auto lit = dynamic_cast<IntLiteral *>(operand)) {
+    fused.kind = Superinstruction::IncrementSlot;
+    fused.imm = lit->value;
+  } else {
+    fused.kind = Superinstruction::UpdateSlot;
+    fused.operand = operand;
+  }
+
+  return true;
+}
+
+// `v@i = e`
+bool fuse_store(BinaryOp &bin, FusedStmt &fused) {
+  auto index = dynamic_cast<BinaryOp *>(bin.left.get());
+  if (bin.op != TokenType::ASSIGN || index == nullptr ||
+      index->op != TokenType::INDEX)
+    return false;
+
+  auto target = dynamic_cast<Variable *>(index->left.get());
+  if (target == nullptr)
+    return false;
+
+  fused.kind = Superinstruction::StoreIndex;
+  fused.target = target;
+  fused.index = index->right.get();
+  fused.operand = bin.right.get();
+  return true;
+}
+
+void fuse_stmt(ExpressionStmt &stmt) {
+  auto bin = dynamic_cast<BinaryOp *>(stmt.expr.get());
+  if (bin == nullptr || !isRightAssoc(bin->op))
+    return;
+
+  FusedStmt fused;
+  if (fuse_update(*bin, fused) || fuse_store(*bin, fused)) {
+    stmt.fused = fused;
+    stmt.kind = StmtKind::Fused;
+  }
+}
+
+void optimize_stmts(std::vector<ExpressionStmt> &stmts);
+
+void optimize_stmt(ExpressionStmt &stmt) {
+  switch (stmt.kind) {
+  case StmtKind::Expr:
+    break;
+  case StmtKind::If: {
+    auto ifStmt = static_cast<IfStmt *>(stmt.expr.get());
+    fuse_condition(*ifStmt->test);
+    optimize_stmts(ifStmt->thenClauseStmts);
+    optimize_stmts(ifStmt->elseClauseStmts);
+    return;
+  }
+  case StmtKind::While: {
+    auto whileStmt = static_cast<WhileStmt *>(stmt.expr.get());
+    fuse_condition(*whileStmt->test);
+    optimize_stmts(whileStmt->stmts);
+    return;
+  }
+  case StmtKind::For:
+    optimize_stmts(static_cast<ForStmt *>(stmt.expr.get())->stmts);
+    return;
+  default:
+    return;
+  }
+
+  if (auto func = dynamic_cast<FunctionStmt *>(stmt.expr.get())) {
+    optimize_stmts(func->stmts);
+    try_inline(*func);
+  } else if (auto cls = dynamic_cast<ClassStmt *>(stmt.expr.get())) {
+    // methods are never inlined: their bodies read the instance's fields
+    for (ExpressionStmt &member : cls->stmts) {
+      if (auto method = dynamic_cast<FunctionStmt *>(member.expr.get()))
+        optimize_stmts(method->stmts);
+      else
+        optimize_stmt(member);
+    }
+  } else {
+    fuse_stmt(stmt);
+  }
+}
+
+void optimize_stmts(std::vector<ExpressionStmt> &stmts) {
+  for (ExpressionStmt &stmt : stmts)
+    optimize_stmt(stmt);
+}
+} // namespace
+
+void optimize_program(Program &program) {
+  optimize_stmts(program.statements);
+}
@@ -134,6 +134,41 @@ ExpressionStmt Parser::parse_statement() {
         std::make_unique<NoOp>(), current().span, true, false, false);
 
     return expressionStmt;
+  } else if (token.kind == TokenType::INDEX) {
+    // an annotation on the form that follows: `@memo form f(...) { ... }`
+    advance();
+    Token annotation = expect(TokenType::IDENT);
+
+    if (annotation.text != "memo") {
+      diags.report<SyntaxError>("Unknown annotation '@" + annotation.text +
+                                    "'",
+                                annotation.span, "The only annotation is @memo",
+                                filename);
+      exitErrors();
+    }
+
+    advance();
+
+    if (current().kind != TokenType::FORM) {
+      diags.report<SyntaxError>("@memo must be followed by a form",
+                                Span::combine(token.span, annotation.span), "",
+                                filename);
+      exitErrors();
+    }
+
+    ExpressionStmt stmt = parse_statement();
+    auto func = static_cast<FunctionStmt *>(stmt.expr.get());
+
+    if (func->isGenerator) {
+      diags.report<SyntaxError>("A generator form cannot be memoized",
+                                Span::combine(token.span, annotation.span),
+                                "Each call has to return a new generator",
+                                filename);
+      exitErrors();
+    }
+
+    func->memo = std::make_unique<MemoCache>();
+    return stmt;
   } else if (token.kind == TokenType::FORM || token.kind == TokenType::CLASS) {
     advance();
     Token name = expect(TokenType::IDENT);
@@ -208,6 +243,27 @@ ExpressionStmt Parser::parse_statement() {
     return ExpressionStmt(std::move(returnStmt),
                           Span::combine(token.span, current().span), false,
                           false, false);
+  } else if (token.kind == TokenType::YIELD) {
+    advance();
+
+    ASTPtr value = parse_expression(0);
+
+    if (peek().kind == TokenType::SEM) {
+      advance();
+    } else {
+      diags.report<MissingTerminatorError>(
+          "Missing statement terminator after yield statement", current().span,
+          "Did you forget a semicolon?", filename);
+
+      advance();
+    }
+
+    ASTPtr yieldStmt = std::make_unique<YieldStmt>(
+        std::move(value), Span::combine(token.span, current().span));
+
+    return ExpressionStmt(std::move(yieldStmt),
+                          Span::combine(token.span, current().span), false,
+                          false, false);
   } else if (token.kind == TokenType::WHILE) {
     advance();
     ASTPtr condition = parse_expression(0);
@@ -391,6 +447,14 @@ ASTPtr Parser::parse_expression(int min_bp) {
     left = std::make_unique<TypeVec>(current().span);
   } else if (token.kind == TokenType::TYPE_DIC) {
     left = std::make_unique<TypeDic>(current().span);
+  } else if (token.kind == TokenType::TYPE_BITS) {
+    left = std::make_unique<TypeBits>(current().span);
+  } else if (token.kind == TokenType::TYPE_DEQUE) {
+    left = std::make_unique<TypeDeque>(current().span);
+  } else if (token.kind == TokenType::TYPE_HEAP) {
+    left = std::make_unique<TypeHeap>(current().span);
+  } else if (token.kind == TokenType::TYPE_SET) {
+    left = std::make_unique<TypeSet>(current().span);
   } else if (token.kind == TokenType::CHR) {
     char c = 0;
     get_escape(token.text, &c);
@@ -0,0 +1,168 @@
+#include "sort.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <variant>
+
+namespace {
+// 0 for numbers, 1 for strings, -1 for values that have no order
+int sortRank(const Value &val) {
+  if (std::holds_alternative<tn_int_t>(val.v) ||
+      std::holds_alternative<tn_dec_t>(val.v) ||
+      std::holds_alternative<tn_bool_t>(val.v))
+    return 0;
+
+  if (std::holds_alternative<std::string>(val.v))
+    return 1;
+
+  return -1;
+}
+
+tn_dec_t asNumber(const Value &val) {
+  if (auto i = std::get_if<tn_int_t>(&val.v))
+    return (tn_dec_t)*i;
+  if (auto d = std::get_if<tn_dec_t>(&val.v))
+    return *d;
+  return std::get<tn_bool_t>(val.v) ? 1 : 0;
+}
+
+// LSD radix sort on the two's complement bits with the sign bit flipped, one
+// byte per pass. Passes where every key has the same byte are skipped, so
+// small ranges of integers only pay for the bytes that actually differ.
+void radixSortInts(Value *first, Value *last) {
+  const size_t n = last - first;
+  const uint64_t signBit = uint64_t(1) << 63;
+
+  std::vector<uint64_t> keys(n), scratch(n);
+  for (size_t i = 0; i < n; i++)
+    keys[i] = (uint64_t)std::get<tn_int_t>(first[i].v) ^ signBit;
+
+  for (unsigned shift = 0; shift < 64; shift += 8) {
+    size_t counts[257] = {0};
+    for (uint64_t key : keys)
+      counts[((key >> shift) & 0xff) + 1]++;
+
+    if (counts[((keys[0] >> shift) & 0xff) + 1] == n)
+      continue;
+
+    for (size_t b = 1; b < 257; b++)
+      counts[b] += counts[b - 1];
+
+    for (uint64_t key : keys)
+      scratch[counts[(key >> shift) & 0xff]++] = key;
+
+    keys.swap(scratch);
+  }
+
+  for (size_t i = 0; i < n; i++)
+    first[i] = Value((tn_int_t)(keys[i] ^ signBit));
+}
+
+void sortRange(Value *first, Value *last, bool allInts) {
+  if (last - first < 2)
+    return;
+
+  if (allInts) {
+    radixSortInts(first, last);
+    return;
+  }
+
+  std::sort(first, last, [](const Value &a, const Value &b) {
+    return compare_values(a, b) < 0;
+  });
+}
+
+// sorts 'chunks' equal slices of the input on their own threads, then merges
+// neighbouring runs pairwise (also in parallel) until one run is left
+void parallelSort(std::vector<Value> &elems, bool allInts, size_t chunks) {
+  const size_t n = elems.size();
+  std::vector<size_t> bounds;
+  for (size_t c = 0; c <= chunks; c++)
+    bounds.push_back(n * c / chunks);
+
+  {
+    std::vector<std::thread> workers;
+    for (size_t c = 0; c < chunks; c++) {
+      workers.emplace_back(sortRange, elems.data() + bounds[c],
+                           elems.data() + bounds[c + 1], allInts);
+    }
+    for (std::thread &worker : workers)
+      worker.join();
+  }
+
+  auto less = [](const Value &a, const Value &b) {
+    return compare_values(a, b) < 0;
+  };
+
+  for (size_t width = 1; width < chunks; width *= 2) {
+    std::vector<std::thread> workers;
+
+    for (size_t c = 0; c + width < chunks; c += 2 * width) {
+      Value *first = elems.data() + bounds[c];
+      Value *middle = elems.data() + bounds[c + width];
+      Value *last = elems.data() + bounds[std::min(c + 2 * width, chunks)];
+      workers.emplace_back([first, middle, last, less]() {
+        std::inplace_merge(first, middle, last, less);
+      });
+    }
+
+    for (std::thread &worker : workers)
+      worker.join();
+  }
+}
+} // namespace
+
+bool is_orderable_val(const Value &val) { return sortRank(val) >= 0; }
+
+int compare_values(const Value &a, const Value &b) {
+  const int rankA = sortRank(a);
+  const int rankB = sortRank(b);
+
+  if (rankA != rankB)
+    return rankA < rankB ? -1 : 1;
+
+  if (rankA == 1)
+    return std::get<std::string>(a.v).compare(std::get<std::string>(b.v));
+
+  auto ia = std::get_if<tn_int_t>(&a.v);
+  auto ib = std::get_if<tn_int_t>(&b.v);
+  if (ia && ib)
+    return *ia < *ib ? -1 : (*ia > *ib ? 1 : 0);
+
+  // NaN compares unordered with everything, so it is placed after every
+  // other number (and equal to itself) to keep the order total
+  tn_dec_t da = asNumber(a), db = asNumber(b);
+  if (std::isnan(da) || std::isnan(db))
+    return std::isnan(da) - std::isnan(db);
+  return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+void sort_values(std::vector<Value> &elems, bool descending) {
+  const bool allInts =
+      std::all_of(elems.begin(), elems.end(), [](const Value &val) {
+        return std::holds_alternative<tn_int_t>(val.v);
+      });
+
+  size_t chunks = std::thread::hardware_concurrency();
+  if (elems.size() >= PARALLEL_SORT_THRESHOLD && chunks > 1) {
+    parallelSort(elems, allInts, std::min<size_t>(chunks, 16));
+  } else {
+    sortRange(elems.data(), elems.data() + elems.size(), allInts);
+  }
+
+  if (descending)
+    std::reverse(elems.begin(), elems.end());
+}
+
+size_t lower_bound_value(const ValueVec &elems, const Value &key) {
+  const Value *found =
+      std::lower_bound(elems.begin(), elems.end(), key,
+                       [](const Value &elem, const Value &target) {
+                         return compare_values(elem, target) < 0;
+                       });
+
+  return found - elems.begin();
+}
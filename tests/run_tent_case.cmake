@@ -14,11 +14,13 @@ endif()
 
 set(PROGRAM_FILE "${CASE_DIR}/program.tent")
 set(ARGS_FILE "${CASE_DIR}/args.txt")
+set(FLAGS_FILE "${CASE_DIR}/flags.txt")
 set(STDIN_FILE "${CASE_DIR}/stdin.txt")
 set(EXPECTED_OUT_FILE "${CASE_DIR}/expected.out")
 set(EXPECTED_ERR_FILE "${CASE_DIR}/expected.err")
 set(EXPECTED_ERR_CONTAINS_FILE "${CASE_DIR}/expected.err.contains")
 set(EXPECTED_CODE_FILE "${CASE_DIR}/expected.code")
+set(BUILT_FILE "${CASE_DIR}/built.txt")
 
 if(NOT EXISTS "${PROGRAM_FILE}")
     message(FATAL_ERROR "missing test program: ${PROGRAM_FILE}")
@@ -29,7 +31,12 @@ if(EXISTS "${ARGS_FILE}")
     file(STRINGS "${ARGS_FILE}" CASE_ARGS)
 endif()
 
-set(COMMAND_ARGS "${PROGRAM_FILE}")
+set(CASE_FLAGS)
+if(EXISTS "${FLAGS_FILE}")
+    file(STRINGS "${FLAGS_FILE}" CASE_FLAGS)
+endif()
+
+set(COMMAND_ARGS ${CASE_FLAGS} "${PROGRAM_FILE}")
 if(CASE_ARGS)
     list(APPEND COMMAND_ARGS -- ${CASE_ARGS})
 endif()
@@ -53,6 +60,42 @@ else()
     )
 endif()
 
+# The command built an executable (`tent build`): it has to succeed, and the
+# expected files then describe a run of what it built instead.
+if(EXISTS "${BUILT_FILE}")
+    file(STRINGS "${BUILT_FILE}" BUILT_NAME LIMIT_COUNT 1)
+    set(BUILT_EXE "${WORK_DIR}/${BUILT_NAME}")
+
+    if(NOT "${ACTUAL_CODE}" STREQUAL "0" OR NOT EXISTS "${BUILT_EXE}")
+        file(REMOVE "${BUILT_EXE}")
+        message(FATAL_ERROR
+            "case '${CASE_DIR}' did not build '${BUILT_NAME}' (exit code ${ACTUAL_CODE})\n"
+            "stderr:\n${ACTUAL_ERR}"
+        )
+    endif()
+
+    if(EXISTS "${STDIN_FILE}")
+        execute_process(
+            COMMAND "${BUILT_EXE}" ${CASE_ARGS}
+            WORKING_DIRECTORY "${WORK_DIR}"
+            INPUT_FILE "${STDIN_FILE}"
+            RESULT_VARIABLE ACTUAL_CODE
+            OUTPUT_VARIABLE ACTUAL_OUT
+            ERROR_VARIABLE ACTUAL_ERR
+        )
+    else()
+        execute_process(
+            COMMAND "${BUILT_EXE}" ${CASE_ARGS}
+            WORKING_DIRECTORY "${WORK_DIR}"
+            RESULT_VARIABLE ACTUAL_CODE
+            OUTPUT_VARIABLE ACTUAL_OUT
+            ERROR_VARIABLE ACTUAL_ERR
+        )
+    endif()
+
+    file(REMOVE "${BUILT_EXE}")
+endif()
+
 set(EXPECTED_OUT "")
 if(EXISTS "${EXPECTED_OUT_FILE}")
     file(READ "${EXPECTED_OUT_FILE}" EXPECTED_OUT)